@@ -28,6 +28,7 @@
 
 #include <QCoreApplication>
 #include <QDir>
+#include <QSocketNotifier>
 #include <QTemporaryFile>
 #include <QThread>
 #include <QUrl>
@@ -35,8 +36,10 @@
 #include <csignal>
 #include <fstream>
 
+#include <fcntl.h>
 #include <sys/socket.h>
 #include <sys/wait.h>
+#include <unistd.h>
 
 namespace linglong {
 namespace builder {
@@ -894,6 +897,65 @@ linglong::util::Error LinglongBuilder::exportBundle(const QString &outputFilePat
     return NoError();
 }
 
+namespace {
+
+// 信号处理函数只能调用异步信号安全的函数，通过管道通知事件循环
+int interruptPipe[2] = { -1, -1 };
+volatile sig_atomic_t interruptRequested = 0;
+
+void onPushInterrupt(int /*sig*/)
+{
+    interruptRequested = 1;
+    const char c = 0;
+    auto ret = ::write(interruptPipe[1], &c, 1);
+    Q_UNUSED(ret);
+}
+
+/*
+ * 推送期间收到 SIGINT 时中止进行中的上传，上传任务随后会从服务端清理
+ */
+class PushInterrupter
+{
+public:
+    explicit PushInterrupter(repo::OSTreeRepo &repo)
+    {
+        if (pipe2(interruptPipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+            qWarning() << "create interrupt pipe failed:" << strerror(errno);
+            return;
+        }
+        notifier.reset(new QSocketNotifier(interruptPipe[0], QSocketNotifier::Read));
+        QObject::connect(notifier.data(), &QSocketNotifier::activated, [this, &repo]() {
+            char c;
+            while (::read(interruptPipe[0], &c, 1) > 0) { }
+            qInfo() << "push interrupted, cancel uploading";
+            repo.cancel();
+        });
+        interruptRequested = 0;
+        oldHandler = signal(SIGINT, onPushInterrupt);
+    }
+
+    ~PushInterrupter()
+    {
+        if (!notifier) {
+            return;
+        }
+        signal(SIGINT, oldHandler);
+        notifier.reset();
+        close(interruptPipe[0]);
+        close(interruptPipe[1]);
+        interruptPipe[0] = interruptPipe[1] = -1;
+    }
+
+    // 不在事件循环中时收到的信号也会记录，之后的推送不再进行
+    static bool interrupted() { return interruptRequested != 0; }
+
+private:
+    QScopedPointer<QSocketNotifier> notifier;
+    sighandler_t oldHandler = SIG_DFL;
+};
+
+} // namespace
+
 util::Error LinglongBuilder::push(const QString &repoUrl,
                                   const QString &repoName,
                                   const QString &channel,
@@ -920,6 +982,7 @@ util::Error LinglongBuilder::push(const QString &repoUrl,
         repo::OSTreeRepo repo(BuilderConfig::instance()->repoPath(),
                               remoteRepoEndpoint,
                               remoteRepoName);
+        PushInterrupter interrupter(repo);
 
         // Fixme: should be buildArch.
         auto refWithRuntime = package::Ref("",
@@ -938,6 +1001,9 @@ util::Error LinglongBuilder::push(const QString &repoUrl,
         // push ostree data by ref
         // ret = repo.push(refWithRuntime, false);
         ret = repo.push(refWithRuntime);
+        if (PushInterrupter::interrupted()) {
+            return NewError(-1, "push interrupted");
+        }
 
         if (!ret.success()) {
             qInfo().noquote() << QString("push %1 failed").arg(project->package->id);
@@ -948,6 +1014,9 @@ util::Error LinglongBuilder::push(const QString &repoUrl,
 
         if (pushWithDevel) {
             ret = repo.push(package::Ref(refWithDevel));
+            if (PushInterrupter::interrupted()) {
+                return NewError(-1, "push interrupted");
+            }
 
             if (!ret.success()) {
                 qInfo().noquote() << QString("push %1 failed").arg(project->package->id);
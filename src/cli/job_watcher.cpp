@@ -0,0 +1,135 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "job_watcher.h"
+
+#include "package_manager/impl/job_manager.h"
+
+#include <QDBusConnection>
+#include <QLocale>
+#include <QThread>
+
+#include <iostream>
+
+namespace {
+
+const QString kPackageManagerService = "org.deepin.linglong.PackageManager";
+const QString kJobInterface = "org.deepin.linglong.Job";
+
+} // namespace
+
+JobWatcher::JobWatcher(const QString &jobId, QObject *parent)
+    : QObject(parent)
+    , path(JobManager::jobPath(jobId))
+    , serviceWatcher(kPackageManagerService,
+                     QDBusConnection::systemBus(),
+                     QDBusServiceWatcher::WatchForUnregistration)
+{
+    result.code = -1;
+    result.message = "unknown err";
+    connect(&serviceWatcher,
+            &QDBusServiceWatcher::serviceUnregistered,
+            this,
+            &JobWatcher::onServiceUnregistered);
+}
+
+bool JobWatcher::watch()
+{
+    auto bus = QDBusConnection::systemBus();
+    bool ret = bus.connect(kPackageManagerService,
+                           path,
+                           kJobInterface,
+                           "Progress",
+                           this,
+                           SLOT(onProgress(qulonglong,qulonglong,uint,uint,QString)));
+    ret = ret
+            && bus.connect(kPackageManagerService,
+                           path,
+                           kJobInterface,
+                           "Finish",
+                           this,
+                           SLOT(onFinish(int,QString)));
+    if (!ret) {
+        qCritical() << "subscribe" << path << "failed:" << bus.lastError();
+    }
+    return ret;
+}
+
+linglong::service::Reply JobWatcher::wait()
+{
+    // 隐藏光标
+    std::cout << "\033[?25l";
+    std::cout.flush();
+    loop.exec();
+    // 显示光标
+    std::cout << "\033[?25h";
+    if (displayed) {
+        std::cout << std::endl;
+    }
+    return result;
+}
+
+linglong::service::Reply
+JobWatcher::poll(const std::function<linglong::service::Reply()> &status, int runningCode)
+{
+    QThread::sleep(1);
+    auto reply = status();
+    bool displayed = false;
+    // 隐藏光标
+    std::cout << "\033[?25l";
+    while (reply.code == runningCode) {
+        std::cout << "\r\33[K" << reply.message.toStdString();
+        std::cout.flush();
+        QThread::sleep(1);
+        reply = status();
+        displayed = true;
+    }
+    // 显示光标
+    std::cout << "\033[?25h";
+    if (displayed) {
+        std::cout << std::endl;
+    }
+    return reply;
+}
+
+void JobWatcher::onProgress(qulonglong bytesFetched,
+                            qulonglong bytesTotal,
+                            uint objectsFetched,
+                            uint objectsTotal,
+                            const QString &stage)
+{
+    QLocale locale;
+    QString message = stage;
+    if (objectsTotal > 0) {
+        message = QString("%1: %2% (%3/%4) %5")
+                          .arg(stage)
+                          .arg(static_cast<uint>(static_cast<double>(objectsFetched) / objectsTotal
+                                                 * 100))
+                          .arg(objectsFetched)
+                          .arg(objectsTotal)
+                          .arg(locale.formattedDataSize(static_cast<qint64>(bytesFetched)));
+        if (bytesTotal > 0) {
+            message += "/" + locale.formattedDataSize(static_cast<qint64>(bytesTotal));
+        }
+    }
+    std::cout << "\r\33[K" << message.toStdString();
+    std::cout.flush();
+    displayed = true;
+}
+
+void JobWatcher::onFinish(int code, const QString &message)
+{
+    result.code = code;
+    result.message = message;
+    loop.quit();
+}
+
+void JobWatcher::onServiceUnregistered()
+{
+    result.code = -1;
+    result.message = kPackageManagerService + " exited";
+    loop.quit();
+}
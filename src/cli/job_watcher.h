@@ -0,0 +1,69 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_SRC_CLI_JOB_WATCHER_H_
+#define LINGLONG_SRC_CLI_JOB_WATCHER_H_
+
+#include "module/dbus_ipc/reply.h"
+
+#include <QDBusServiceWatcher>
+#include <QEventLoop>
+#include <QObject>
+
+#include <functional>
+
+/**
+ * @brief 订阅 ll-package-manager 任务的 Progress、Finish 信号，在终端展示进度并等待任务结束
+ */
+class JobWatcher : public QObject
+{
+    Q_OBJECT
+public:
+    explicit JobWatcher(const QString &jobId, QObject *parent = nullptr);
+
+    /**
+     * @brief 订阅任务信号，需在发起任务前调用，避免错过信号
+     *
+     * @return bool true:成功 false:失败
+     */
+    bool watch();
+
+    /**
+     * @brief 等待任务结束，期间在终端刷新进度
+     *
+     * @return linglong::service::Reply 任务结果
+     */
+    linglong::service::Reply wait();
+
+    /**
+     * @brief 订阅任务信号失败时的后备方式，每秒查询一次状态并在终端刷新，直到任务不再进行
+     *
+     * @param status 查询任务状态
+     * @param runningCode 任务进行中的状态码
+     *
+     * @return linglong::service::Reply 任务结果
+     */
+    static linglong::service::Reply poll(const std::function<linglong::service::Reply()> &status,
+                                         int runningCode);
+
+private Q_SLOTS:
+    void onProgress(qulonglong bytesFetched,
+                    qulonglong bytesTotal,
+                    uint objectsFetched,
+                    uint objectsTotal,
+                    const QString &stage);
+    void onFinish(int code, const QString &message);
+    void onServiceUnregistered();
+
+private:
+    QString path;
+    QEventLoop loop;
+    QDBusServiceWatcher serviceWatcher;
+    linglong::service::Reply result;
+    bool displayed = false;
+};
+
+#endif
@@ -4,6 +4,7 @@
  * SPDX-License-Identifier: LGPL-3.0-or-later
  */
 
+#include "job_watcher.h"
 #include "module/app_manager.h"
 #include "module/dbus_ipc/register_meta_type.h"
 #include "module/package/package.h"
@@ -333,7 +334,7 @@ int main(int argc, char **argv)
               linglong::service::Reply reply;
               if ("/bin/bash" == parser.value(optExec) || "bash" == parser.value(optExec)) {
                   reply = APP_MANAGER->Start(paramOption);
-                  APP_MANAGER->runPool->waitForDone(-1);
+                  APP_MANAGER->waitForContainers();
                   if (0 != reply.code) {
                       qCritical().noquote()
                               << "message:" << reply.message << ", errcode:" << reply.code;
@@ -533,31 +534,25 @@ int main(int argc, char **argv)
               linglong::service::Reply reply;
               qInfo().noquote() << "install" << args.at(1) << ", please wait a few minutes...";
               if (!parser.isSet(optNoDbus)) {
+                  // 先订阅任务信号再发起安装，避免错过进度，订阅失败时改为轮询下载状态
+                  JobWatcher watcher("install/" + installParamOption.appId.trimmed());
+                  bool watched = watcher.watch();
                   QDBusPendingReply<linglong::service::Reply> dbusReply =
                           sysPackageManager.Install(installParamOption);
                   dbusReply.waitForFinished();
                   reply = dbusReply.value();
-                  QThread::sleep(1);
-                  // 查询一次进度
-                  dbusReply = sysPackageManager.GetDownloadStatus(installParamOption, 0);
-                  dbusReply.waitForFinished();
-                  reply = dbusReply.value();
-                  bool disProgress = false;
-                  // 隐藏光标
-                  std::cout << "\033[?25l";
-                  while (reply.code == STATUS_CODE(kPkgInstalling)) {
-                      std::cout << "\r\33[K" << reply.message.toStdString();
-                      std::cout.flush();
-                      QThread::sleep(1);
-                      dbusReply = sysPackageManager.GetDownloadStatus(installParamOption, 0);
-                      dbusReply.waitForFinished();
-                      reply = dbusReply.value();
-                      disProgress = true;
-                  }
-                  // 显示光标
-                  std::cout << "\033[?25h";
-                  if (disProgress) {
-                      std::cout << std::endl;
+                  if (reply.code == STATUS_CODE(kPkgInstalling) && watched) {
+                      reply = watcher.wait();
+                  } else if (reply.code == STATUS_CODE(kPkgInstalling)) {
+                      reply = JobWatcher::poll(
+                              [&]() {
+                                  QDBusPendingReply<linglong::service::Reply> status =
+                                          sysPackageManager.GetDownloadStatus(installParamOption,
+                                                                              0);
+                                  status.waitForFinished();
+                                  return status.value();
+                              },
+                              STATUS_CODE(kPkgInstalling));
                   }
                   if (reply.code != STATUS_CODE(kPkgInstallSuccess)) {
                       if (reply.message.isEmpty()) {
@@ -618,6 +613,9 @@ int main(int argc, char **argv)
               sysPackageManager.setTimeout(1000 * 60 * 60 * 24);
               qInfo().noquote() << "update" << paramOption.appId
                                 << ", please wait a few minutes...";
+              // 先订阅任务信号再发起更新，避免错过进度，订阅失败时改为轮询下载状态
+              JobWatcher watcher("update/" + paramOption.appId);
+              bool watched = watcher.watch();
               QDBusPendingReply<linglong::service::Reply> dbusReply =
                       sysPackageManager.Update(paramOption);
               dbusReply.waitForFinished();
@@ -625,26 +623,17 @@ int main(int argc, char **argv)
               reply = dbusReply.value();
               if (reply.code == STATUS_CODE(kPkgUpdating)) {
                   signal(SIGINT, doIntOperate);
-                  QThread::sleep(1);
-                  dbusReply = sysPackageManager.GetDownloadStatus(paramOption, 1);
-                  dbusReply.waitForFinished();
-                  reply = dbusReply.value();
-                  bool disProgress = false;
-                  // 隐藏光标
-                  std::cout << "\033[?25l";
-                  while (reply.code == STATUS_CODE(kPkgUpdating)) {
-                      std::cout << "\r\33[K" << reply.message.toStdString();
-                      std::cout.flush();
-                      QThread::sleep(1);
-                      dbusReply = sysPackageManager.GetDownloadStatus(paramOption, 1);
-                      dbusReply.waitForFinished();
-                      reply = dbusReply.value();
-                      disProgress = true;
-                  }
-                  // 显示光标
-                  std::cout << "\033[?25h";
-                  if (disProgress) {
-                      std::cout << std::endl;
+                  if (watched) {
+                      reply = watcher.wait();
+                  } else {
+                      reply = JobWatcher::poll(
+                              [&]() {
+                                  QDBusPendingReply<linglong::service::Reply> status =
+                                          sysPackageManager.GetDownloadStatus(paramOption, 1);
+                                  status.waitForFinished();
+                                  return status.value();
+                              },
+                              STATUS_CODE(kPkgUpdating));
                   }
               }
               if (reply.code != STATUS_CODE(kErrorPkgUpdateSuccess)) {
@@ -15,6 +15,9 @@
 #include <curl/curl.h>
 #include <qprocess.h>
 
+#include <QStandardPaths>
+#include <QVector>
+
 namespace linglong {
 namespace package {
 
@@ -48,9 +51,34 @@ Bundle::Bundle(QObject *parent)
 
 Bundle::~Bundle() { }
 
-linglong::util::Error Bundle::load(const QString & /*path*/)
+linglong::util::Error Bundle::load(const QString &path)
 {
-    return NoError() << -1 << "Not implemented";
+    Q_D(Bundle);
+    return d->load(path);
+}
+
+qint64 Bundle::imageOffset() const
+{
+    Q_D(const Bundle);
+    return d->offsetValue;
+}
+
+qint64 Bundle::imageSize() const
+{
+    Q_D(const Bundle);
+    return d->imageSize;
+}
+
+linglong::util::Error Bundle::mount(const QString &mountPoint) const
+{
+    Q_D(const Bundle);
+    return d->mount(mountPoint);
+}
+
+linglong::util::Error Bundle::umount(const QString &mountPoint) const
+{
+    Q_D(const Bundle);
+    return d->umount(mountPoint);
 }
 
 linglong::util::Error Bundle::save(const QString & /*path*/)
@@ -68,6 +96,44 @@ linglong::util::Error Bundle::make(const QString &dataPath, const QString &outpu
     return NewError();
 }
 
+linglong::util::Error Bundle::makeFromImage(const QString &imagePath,
+                                            const QString &outputFilePath)
+{
+    Q_D(Bundle);
+    if (!util::fileExists(imagePath)) {
+        return NewError() << -1 << imagePath + " don't exists!";
+    }
+    util::createDir(QFileInfo(outputFilePath).path());
+    if (util::fileExists(outputFilePath)) {
+        QFile::remove(outputFilePath);
+    }
+    return d->embedImage(imagePath, outputFilePath);
+}
+
+QString Bundle::path() const
+{
+    Q_D(const Bundle);
+    return d->bundleFilePath;
+}
+
+void Bundle::setPath(const QString &path)
+{
+    Q_D(Bundle);
+    d->bundleFilePath = path;
+}
+
+QString Bundle::ref() const
+{
+    Q_D(const Bundle);
+    return d->ref;
+}
+
+void Bundle::setRef(const QString &ref)
+{
+    Q_D(Bundle);
+    d->ref = ref;
+}
+
 linglong::util::Error Bundle::push(const QString &bundleFilePath,
                                    const QString &repoUrl,
                                    const QString &repoChannel,
@@ -152,24 +218,32 @@ linglong::util::Error BundlePrivate::make(const QString &dataPath, const QString
     }
 
     // 生产bundle文件
+    auto resultEmbed = embedImage(this->erofsFilePath, this->bundleFilePath);
+
+    // 清理squashfs文件
+    if (util::fileExists(this->erofsFilePath)) {
+        QFile::remove(this->erofsFilePath);
+    }
+
+    return resultEmbed;
+}
+
+linglong::util::Error BundlePrivate::embedImage(const QString &imagePath,
+                                                const QString &bundleFilePath)
+{
     auto resultObjcopy = runner("objcopy",
                                 { "--add-section",
-                                  QStringList{ ".bundle=", this->erofsFilePath }.join(""),
+                                  QStringList{ ".bundle=", imagePath }.join(""),
                                   "--set-section-flags",
                                   ".bundle=noload,readonly",
                                   this->linglongLoader,
-                                  this->bundleFilePath });
+                                  bundleFilePath });
     if (!resultObjcopy.success()) {
         return NewError(resultObjcopy) << "call objcopy failed";
     }
 
-    // 清理squashfs文件
-    if (util::fileExists(this->erofsFilePath)) {
-        QFile::remove(this->erofsFilePath);
-    }
-
     // 设置执行权限
-    QFile(this->bundleFilePath)
+    QFile(bundleFilePath)
             .setPermissions(QFileDevice::ExeOwner | QFileDevice::WriteOwner
                             | QFileDevice::ReadOwner);
 
@@ -225,6 +299,133 @@ auto BundlePrivate::getElfSize(const QString elfFilePath) -> decltype(-1)
     return size;
 }
 
+linglong::util::Error BundlePrivate::findBundleSection(const QString &elfFilePath,
+                                                       qint64 &offset,
+                                                       qint64 &size)
+{
+    QFile elfFile(elfFilePath);
+    if (!elfFile.open(QIODevice::ReadOnly)) {
+        return NewError() << STATUS_CODE(kBundleFileNotExists)
+                          << elfFilePath + " open failed: " + elfFile.errorString();
+    }
+
+    Elf64_Ehdr ehdr;
+    if (elfFile.read(reinterpret_cast<char *>(&ehdr), sizeof(ehdr)) != sizeof(ehdr)
+        || memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0 || ehdr.e_ident[EI_CLASS] != ELFCLASS64) {
+        return NewError() << -1 << elfFilePath + " is not an elf64 file";
+    }
+
+    auto shoff = file64ToCpu<Elf64_Ehdr>(ehdr.e_shoff, ehdr);
+    auto shentsize = file16ToCpu<Elf64_Ehdr>(ehdr.e_shentsize, ehdr);
+    auto shnum = file16ToCpu<Elf64_Ehdr>(ehdr.e_shnum, ehdr);
+    auto shstrndx = file16ToCpu<Elf64_Ehdr>(ehdr.e_shstrndx, ehdr);
+    if (shentsize != sizeof(Elf64_Shdr) || shstrndx >= shnum) {
+        return NewError() << -1 << elfFilePath + " has invalid section headers";
+    }
+
+    QVector<Elf64_Shdr> shdrs(shnum);
+    auto shdrsSize = static_cast<qint64>(sizeof(Elf64_Shdr)) * shnum;
+    if (!elfFile.seek(static_cast<qint64>(shoff))
+        || elfFile.read(reinterpret_cast<char *>(shdrs.data()), shdrsSize) != shdrsSize) {
+        return NewError() << -1 << elfFilePath + " read section headers failed";
+    }
+
+    // 节名称字符串表
+    const auto &strtab = shdrs.at(shstrndx);
+    if (!elfFile.seek(static_cast<qint64>(file64ToCpu<Elf64_Ehdr>(strtab.sh_offset, ehdr)))) {
+        return NewError() << -1 << elfFilePath + " read section names failed";
+    }
+    auto names = elfFile.read(static_cast<qint64>(file64ToCpu<Elf64_Ehdr>(strtab.sh_size, ehdr)));
+
+    for (const auto &shdr : shdrs) {
+        auto nameOffset = file32ToCpu<Elf64_Ehdr>(shdr.sh_name, ehdr);
+        if (nameOffset >= static_cast<uint32_t>(names.size())) {
+            continue;
+        }
+        if (qstrcmp(names.constData() + nameOffset, ".bundle") == 0) {
+            offset = static_cast<qint64>(file64ToCpu<Elf64_Ehdr>(shdr.sh_offset, ehdr));
+            size = static_cast<qint64>(file64ToCpu<Elf64_Ehdr>(shdr.sh_size, ehdr));
+            return NoError();
+        }
+    }
+
+    return NewError() << -1 << elfFilePath + " has no .bundle section";
+}
+
+linglong::util::Error BundlePrivate::load(const QString &bundleFilePath)
+{
+    if (!util::fileExists(bundleFilePath)) {
+        return NewError() << STATUS_CODE(kBundleFileNotExists) << bundleFilePath + " don't exists!";
+    }
+
+    this->bundleFilePath = QFileInfo(bundleFilePath).absoluteFilePath();
+
+    auto ret = findBundleSection(this->bundleFilePath, this->offsetValue, this->imageSize);
+    if (!ret.success()) {
+        // 兼容镜像追加在 ELF 文件末尾的旧格式
+        qWarning() << ret.message() << ", fallback to image at the end of elf";
+        this->offsetValue = getElfSize(this->bundleFilePath);
+        if (this->offsetValue < 0) {
+            return NewError(ret) << "load bundle failed";
+        }
+        this->imageSize = QFileInfo(this->bundleFilePath).size() - this->offsetValue;
+    }
+
+    if (this->imageSize <= 0) {
+        return NewError() << -1 << this->bundleFilePath + " contains no image";
+    }
+
+    qDebug() << "bundle image at" << this->offsetValue << "size" << this->imageSize;
+    return NoError();
+}
+
+linglong::util::Error BundlePrivate::mount(const QString &mountPoint) const
+{
+    if (this->offsetValue < 0) {
+        return NewError() << -1 << "bundle not loaded";
+    }
+
+    util::createDir(mountPoint);
+
+    // erofsfuse 按偏移直接读取 bundle 文件中的镜像，不需要导出或解压
+    // --offset 参数由 erofs-utils 1.6 开始提供
+    auto ret = runner("erofsfuse",
+                      { QString("--offset=%1").arg(this->offsetValue),
+                        this->bundleFilePath,
+                        mountPoint },
+                      60 * 1000);
+    if (!ret.success()) {
+        return NewError(ret) << "call erofsfuse failed";
+    }
+    return NoError();
+}
+
+linglong::util::Error BundlePrivate::umount(const QString &mountPoint) const
+{
+    // fuse3 只提供 fusermount3，fuse 2 提供 fusermount
+    QString fusermount = "fusermount3";
+    if (QStandardPaths::findExecutable(fusermount).isEmpty()) {
+        fusermount = "fusermount";
+    }
+    auto ret = runner(fusermount, { "-u", "-z", mountPoint }, 60 * 1000);
+    if (!ret.success()) {
+        return NewError(ret) << "call " + fusermount + " failed";
+    }
+    return NoError();
+}
+
+void BundlePrivate::cleanWorkDir()
+{
+    if (!this->mountPoint.isEmpty()) {
+        umount(this->mountPoint);
+        this->mountPoint.clear();
+    }
+
+    if (util::dirExists(this->tmpWorkDir)) {
+        util::removeDir(this->tmpWorkDir);
+    }
+}
+
 linglong::util::Error BundlePrivate::push(const QString &bundleFilePath,
                                           const QString &repoUrl,
                                           const QString &repoChannel,
@@ -238,9 +439,7 @@ linglong::util::Error BundlePrivate::push(const QString &bundleFilePath,
         int statusCode = linglong::util::getLocalConfig("appDbUrl", configUrl);
 
         if (STATUS_CODE(kSuccess) != statusCode) {
-            if (util::dirExists(this->tmpWorkDir)) {
-                util::removeDir(this->tmpWorkDir);
-            }
+            cleanWorkDir();
             return NewError() << "call getLocalConfig api failed";
         }
     }
@@ -264,38 +463,21 @@ linglong::util::Error BundlePrivate::push(const QString &bundleFilePath,
     }
     util::createDir(this->tmpWorkDir);
 
-    // 转换成绝对路径
-    this->bundleFilePath = QFileInfo(bundleFilePath).absoluteFilePath();
-
-    // 获取offset值
-    this->offsetValue = getElfSize(this->bundleFilePath);
-
-    // 导出squashfs文件
-    this->erofsFilePath = this->tmpWorkDir + "/squashfsFile";
-    QFile bundleFile(this->bundleFilePath);
-    QFile squashfsFile(this->erofsFilePath);
-    bundleFile.open(QIODevice::ReadOnly);
-    bundleFile.seek(this->offsetValue);
-    squashfsFile.open(QIODevice::WriteOnly);
-    squashfsFile.write(bundleFile.readAll());
-
-    bundleFile.close();
-    squashfsFile.close();
-
-    // 解压squashfs文件
-    this->bundleDataPath = this->tmpWorkDir + "/unsquashfs";
-    if (util::dirExists(this->bundleDataPath)) {
-        util::removeDir(this->bundleDataPath);
+    // 定位 .bundle 节中的镜像
+    auto resultLoad = load(bundleFilePath);
+    if (!resultLoad.success()) {
+        cleanWorkDir();
+        return resultLoad;
     }
-    auto resultUnsquashfs =
-            runner("unsquashfs", { "-dest", this->bundleDataPath, "-f", this->erofsFilePath });
 
-    if (!resultUnsquashfs.success()) {
-        if (util::dirExists(this->tmpWorkDir)) {
-            util::removeDir(this->tmpWorkDir);
-        }
-        return NewError(resultUnsquashfs) << "call unsquashfs failed";
+    // 原地挂载镜像，不导出镜像文件也不解压
+    this->bundleDataPath = this->tmpWorkDir + "/image";
+    auto resultMount = mount(this->bundleDataPath);
+    if (!resultMount.success()) {
+        cleanWorkDir();
+        return resultMount;
     }
+    this->mountPoint = this->bundleDataPath;
 
     // 转换info.json为Info对象
     QScopedPointer<package::Info> runtimeInfo(util::loadJson<package::Info>(
@@ -309,9 +491,7 @@ linglong::util::Error BundlePrivate::push(const QString &bundleFilePath,
                    { "--repo=" + this->tmpWorkDir + "/repo", "init", "--mode=archive" },
                    3000);
     if (!resultMakeRepo.success()) {
-        if (util::dirExists(this->tmpWorkDir)) {
-            util::removeDir(this->tmpWorkDir);
-        }
+        cleanWorkDir();
         return NewError(resultMakeRepo) << "call ostree init failed";
     }
 
@@ -346,9 +526,7 @@ linglong::util::Error BundlePrivate::push(const QString &bundleFilePath,
     auto resultCommit = runner("ostree", arguments);
     resultCommit = runner("ostree", commitArgs);
     if (!resultCommit.success()) {
-        if (util::dirExists(this->tmpWorkDir)) {
-            util::removeDir(this->tmpWorkDir);
-        }
+        cleanWorkDir();
         return NewError(resultCommit) << "call ostree commit failed";
     }
 
@@ -358,9 +536,7 @@ linglong::util::Error BundlePrivate::push(const QString &bundleFilePath,
               << "-C" + this->tmpWorkDir << "repo";
     auto resultTar = runner("pwd", arguments);
     if (!resultTar.success()) {
-        if (util::dirExists(this->tmpWorkDir)) {
-            util::removeDir(this->tmpWorkDir);
-        }
+        cleanWorkDir();
         return NewError(resultTar) << "call tar cvf failed";
     }
 
@@ -368,9 +544,7 @@ linglong::util::Error BundlePrivate::push(const QString &bundleFilePath,
     auto retUploadRepo =
             HTTPCLIENT->uploadFile(this->tmpWorkDir + "/repo.tar", configUrl, "ostree", token);
     if (STATUS_CODE(kSuccess) != retUploadRepo) {
-        if (util::dirExists(this->tmpWorkDir)) {
-            util::removeDir(this->tmpWorkDir);
-        }
+        cleanWorkDir();
         std::cout << "upload repo.tar failed, please check and try again!" << std::endl;
         return NewError() << "upload repo.tar failed";
     }
@@ -378,9 +552,7 @@ linglong::util::Error BundlePrivate::push(const QString &bundleFilePath,
     // 上传bundle文件
     auto retUploadBundle = HTTPCLIENT->uploadFile(this->bundleFilePath, configUrl, "bundle", token);
     if (STATUS_CODE(kSuccess) != retUploadBundle) {
-        if (util::dirExists(this->tmpWorkDir)) {
-            util::removeDir(this->tmpWorkDir);
-        }
+        cleanWorkDir();
         std::cout << "Upload bundle failed, please check and try again!" << std::endl;
         return NewError() << "upload bundle failed";
     }
@@ -415,16 +587,12 @@ linglong::util::Error BundlePrivate::push(const QString &bundleFilePath,
     auto runtimeRet = HTTPCLIENT->pushServerBundleData(runtimeDoc.toJson(), configUrl, token);
     auto develRet = HTTPCLIENT->pushServerBundleData(develDoc.toJson(), configUrl, token);
     if (STATUS_CODE(kSuccess) != runtimeRet || STATUS_CODE(kSuccess) != develRet) {
-        if (util::dirExists(this->tmpWorkDir)) {
-            util::removeDir(this->tmpWorkDir);
-        }
+        cleanWorkDir();
         std::cout << "upload bundle info failed, please check and try again!" << std::endl;
         return NewError() << "upload bundle info failed";
     }
 
-    if (util::dirExists(this->tmpWorkDir)) {
-        util::removeDir(this->tmpWorkDir);
-    }
+    cleanWorkDir();
     std::cout << "Upload success" << std::endl;
     return NewError();
 }
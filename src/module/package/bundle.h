@@ -66,12 +66,38 @@ public:
     ~Bundle();
 
     /**
-     * Load Bundle from path, create parent if not exist
+     * Load Bundle from path, locate the embedded image in the .bundle section without copying it
      * @param path
      * @return
      */
     linglong::util::Error load(const QString &path);
 
+    /**
+     * offset of the embedded image in the loaded bundle file
+     * @return -1 if not loaded
+     */
+    qint64 imageOffset() const;
+
+    /**
+     * size of the embedded image in the loaded bundle file
+     * @return -1 if not loaded
+     */
+    qint64 imageSize() const;
+
+    /**
+     * mount the embedded erofs image of the loaded bundle in place with erofsfuse
+     * @param mountPoint : mount point, create if not exist
+     * @return Result
+     */
+    linglong::util::Error mount(const QString &mountPoint) const;
+
+    /**
+     * umount the image mounted by mount
+     * @param mountPoint : mount point
+     * @return Result
+     */
+    linglong::util::Error umount(const QString &mountPoint) const;
+
     /**
      * Save Bundle to path, create parent if not exist
      * @param path
@@ -89,6 +115,28 @@ public:
      */
     linglong::util::Error make(const QString &dataPath, const QString &outputFilePath);
 
+    /**
+     * make Bundle from an existing erofs image
+     * @param imagePath : erofs image path
+     * @param outputFilePath : output file path
+     * @return Result
+     */
+    linglong::util::Error makeFromImage(const QString &imagePath, const QString &outputFilePath);
+
+    /**
+     * bundle file path, set by load or used as output path by repo export
+     * @return
+     */
+    QString path() const;
+    void setPath(const QString &path);
+
+    /**
+     * ostree ref of the bundle content, {channel}/{id}/{version}/{arch}/{module}
+     * @return
+     */
+    QString ref() const;
+    void setRef(const QString &ref);
+
     /**
      * push Bundle
      * @param uabFilePath : uab file path
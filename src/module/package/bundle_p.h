@@ -18,14 +18,27 @@ public:
     QString bundleFilePath;
     QString erofsFilePath;
     QString bundleDataPath;
-    int offsetValue;
+    qint64 offsetValue = -1;
+    qint64 imageSize = -1;
     QString tmpWorkDir;
+    QString mountPoint;
+    QString ref;
     QString buildArch;
     const QString linglongLoader = "/usr/libexec/linglong-loader";
     const QString configJson = "/info.json";
 
     linglong::util::Error make(const QString &dataPath, const QString &outputFilePath);
 
+    /*
+     * 将 erofs 镜像作为 .bundle 节嵌入 loader，生成 bundle 文件
+     *
+     * @param imagePath: erofs 镜像路径
+     * @param bundleFilePath: 生成的 bundle 文件路径
+     *
+     * @return Error: 生成结果
+     */
+    linglong::util::Error embedImage(const QString &imagePath, const QString &bundleFilePath);
+
     template<typename P>
     inline uint16_t file16ToCpu(uint16_t val, const P &ehdr)
     {
@@ -57,6 +70,28 @@ public:
     // get elf offset size
     auto getElfSize(const QString elfFilePath) -> decltype(-1);
 
+    /*
+     * 从 ELF64 节头表中查找 .bundle 节，只读取文件头和节头，不读取镜像数据
+     *
+     * @param elfFilePath: bundle 文件路径
+     * @param offset: .bundle 节在文件中的偏移
+     * @param size: .bundle 节的大小
+     *
+     * @return Error: 查找结果
+     */
+    linglong::util::Error findBundleSection(const QString &elfFilePath,
+                                            qint64 &offset,
+                                            qint64 &size);
+
+    linglong::util::Error load(const QString &bundleFilePath);
+
+    linglong::util::Error mount(const QString &mountPoint) const;
+
+    linglong::util::Error umount(const QString &mountPoint) const;
+
+    // 卸载镜像并清理临时目录
+    void cleanWorkDir();
+
     linglong::util::Error push(const QString &bundleFilePath,
                                const QString &repoUrl,
                                const QString &repoChannel,
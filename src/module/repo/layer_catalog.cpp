@@ -0,0 +1,102 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "layer_catalog.h"
+
+#include "module/util/version/version.h"
+
+#include <QDebug>
+#include <QDir>
+
+#include <algorithm>
+
+#include <sys/stat.h>
+
+namespace linglong {
+namespace repo {
+
+namespace {
+
+// 目录的修改时间，目录不存在时返回 -1
+qint64 dirMtimeNs(const QString &path)
+{
+    struct stat st;
+    if (stat(path.toLocal8Bit().constData(), &st) != 0) {
+        return -1;
+    }
+    return static_cast<qint64>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+} // namespace
+
+const LayerCatalog::Entry &LayerCatalog::entry(const QString &appRoot)
+{
+    const qint64 mtimeNs = dirMtimeNs(appRoot);
+    auto iter = entries.find(appRoot);
+    if (iter != entries.end() && iter->mtimeNs == mtimeNs) {
+        return *iter;
+    }
+
+    Entry entry;
+    entry.mtimeNs = mtimeNs;
+    if (mtimeNs >= 0) {
+        QDir dir(appRoot);
+        entry.versions = dir.entryList(QDir::NoDotAndDotDot | QDir::Dirs, QDir::NoSort);
+        std::sort(entry.versions.begin(), entry.versions.end());
+
+        if (dir.exists("latest")) {
+            entry.latest = dir.absoluteFilePath("latest");
+        } else if (!entry.versions.isEmpty()) {
+            // 与按名称倒序遍历的结果一致：名称最大者为初始值，之后取最大的有效版本
+            entry.latest = entry.versions.last();
+            for (auto it = entry.versions.crbegin(); it != entry.versions.crend(); ++it) {
+                util::AppVersion versionIter(*it);
+                util::AppVersion dstVersion(entry.latest);
+                if (versionIter.isValid() && versionIter.isBigThan(dstVersion)) {
+                    entry.latest = *it;
+                }
+            }
+        }
+    }
+    qDebug() << "reload layer catalog" << appRoot << entry.versions;
+
+    return *entries.insert(appRoot, entry);
+}
+
+QString LayerCatalog::latestVersion(const QString &layersRoot, const QString &appId)
+{
+    QMutexLocker locker(&mutex);
+    return entry(layersRoot + "/" + appId).latest;
+}
+
+QString LayerCatalog::matchedVersion(const QString &layersRoot,
+                                     const QString &appId,
+                                     const QString &versionPrefix)
+{
+    QMutexLocker locker(&mutex);
+    const auto &versions = entry(layersRoot + "/" + appId).versions;
+
+    // 以 versionPrefix 开头的目录在升序列表中连续，从第一个不小于前缀的位置开始
+    auto it = std::lower_bound(versions.cbegin(), versions.cend(), versionPrefix);
+    QString available = util::APP_MIN_VERSION;
+    for (; it != versions.cend() && it->startsWith(versionPrefix); ++it) {
+        util::AppVersion versionIter(*it);
+        util::AppVersion dstVersion(available);
+        if (versionIter.isValid() && versionIter.isBigThan(dstVersion)) {
+            available = *it;
+        }
+    }
+    return available;
+}
+
+void LayerCatalog::invalidate(const QString &layersRoot, const QString &appId)
+{
+    QMutexLocker locker(&mutex);
+    entries.remove(layersRoot + "/" + appId);
+}
+
+} // namespace repo
+} // namespace linglong
@@ -0,0 +1,84 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_SRC_MODULE_REPO_LAYER_CATALOG_H_
+#define LINGLONG_SRC_MODULE_REPO_LAYER_CATALOG_H_
+
+#include "module/util/singleton.h"
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+
+namespace linglong {
+namespace repo {
+
+/*
+ * 本地已安装 layer 的版本目录索引，按 layers/{appId} 目录缓存排序后的版本列表。
+ * 每次查询只检查目录的修改时间，安装、卸载导致目录变化时重新读取，版本前缀通过二分查找定位
+ */
+class LayerCatalog : public linglong::util::Singleton<LayerCatalog>
+{
+    friend class linglong::util::Singleton<LayerCatalog>;
+
+public:
+    /*
+     * 查找最新版本，存在 latest 目录时返回其绝对路径
+     *
+     * @param layersRoot: layers 目录
+     * @param appId: 软件包 appId
+     *
+     * @return QString: 版本号，目录不存在时为空
+     */
+    QString latestVersion(const QString &layersRoot, const QString &appId);
+
+    /*
+     * 查找以指定前缀开头的最大版本
+     *
+     * @param layersRoot: layers 目录
+     * @param appId: 软件包 appId
+     * @param versionPrefix: 版本前缀，如 20.5
+     *
+     * @return QString: 版本号，未找到时为 APP_MIN_VERSION
+     */
+    QString matchedVersion(const QString &layersRoot,
+                           const QString &appId,
+                           const QString &versionPrefix);
+
+    /*
+     * 丢弃缓存，下次查询时重新读取目录
+     *
+     * @param layersRoot: layers 目录
+     * @param appId: 软件包 appId
+     */
+    void invalidate(const QString &layersRoot, const QString &appId);
+
+private:
+    LayerCatalog() = default;
+    ~LayerCatalog() override = default;
+
+    struct Entry
+    {
+        qint64 mtimeNs = -1;
+        // 按字符串升序排列的版本目录
+        QStringList versions;
+        QString latest;
+    };
+
+    // 返回目录对应的最新索引，调用时需持有 mutex
+    const Entry &entry(const QString &appRoot);
+
+    QMutex mutex;
+    // key 为 layers/{appId} 目录
+    QHash<QString, Entry> entries;
+};
+
+} // namespace repo
+} // namespace linglong
+
+#define LAYER_CATALOG linglong::repo::LayerCatalog::instance()
+#endif
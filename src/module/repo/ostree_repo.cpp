@@ -6,8 +6,10 @@
 
 #include "ostree_repo.h"
 
+#include "module/package/bundle.h"
 #include "module/package/info.h"
 #include "module/package/ref.h"
+#include "module/repo/layer_catalog.h"
 #include "module/repo/ostree_repohelper.h"
 #include "module/util/http/http_client.h"
 #include "module/util/http/httpclient.h"
@@ -22,11 +24,19 @@
 #include <ostree-repo.h>
 
 #include <QDir>
+#include <QEventLoop>
 #include <QHttpPart>
+#include <QMutex>
 #include <QProcess>
+#include <QQueue>
+#include <QSet>
+#include <QTemporaryDir>
+#include <QTemporaryFile>
 #include <QThread>
+#include <QTimer>
 #include <QtWebSockets/QWebSocket>
 
+#include <functional>
 #include <utility>
 
 namespace linglong {
@@ -41,6 +51,23 @@ struct OstreeRepoObject
 
 typedef QMap<QString, OstreeRepoObject> RepoObjectMap;
 
+namespace {
+// 单个上传请求中对象的总大小上限(压缩前)
+const qint64 kUploadBatchBytes = 32 * 1024 * 1024;
+// 单个上传请求中的对象数量上限，同时限制打开的文件数
+const int kUploadBatchObjects = 128;
+// 同时进行的上传请求数
+const int kUploadStreams = 4;
+// 单个上传请求失败后的重试次数
+const int kUploadRetries = 3;
+// 首次重试前的等待时间，之后每次重试翻倍
+const int kUploadRetryDelayMs = 1000;
+// 上传过程中检查取消状态的间隔
+const int kCancelCheckIntervalMs = 200;
+// bundle 不包含渠道信息，导入时使用默认渠道
+const auto kBundleChannel = "linglong";
+} // namespace
+
 class OSTreeRepoPrivate
 {
 public:
@@ -112,89 +139,90 @@ private:
         return { reinterpret_cast<const char *>(data), static_cast<int>(length) };
     }
 
-    static GBytes *glibInputStreamToBytes(GInputStream *inputStream)
+    /*
+     * 将 ostree 文件对象按 archive-z2 格式流式压缩到临时文件，文件内容不会整体读入内存
+     *
+     * @param filepath: 对象文件路径
+     * @param parent: 临时文件的 parent，parent 释放时删除临时文件
+     *
+     * @return QFile*: 压缩后的临时文件，已打开并定位到文件开头，失败时为空
+     */
+    static std::tuple<util::Error, QFile *> compressFile(const QString &filepath, QObject *parent)
     {
-        g_autoptr(GOutputStream) outStream = nullptr;
         g_autoptr(GError) gErr = nullptr;
-
-        if (inputStream == nullptr)
-            return g_bytes_new(nullptr, 0);
-
-        outStream = g_memory_output_stream_new(nullptr, 0, g_realloc, g_free);
-        g_output_stream_splice(outStream,
-                               inputStream,
-                               G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
-                               nullptr,
-                               &gErr);
-        g_assert_no_error(gErr);
-
-        return g_memory_output_stream_steal_as_bytes(G_MEMORY_OUTPUT_STREAM(outStream));
-    }
-
-    // FIXME: use tmp path for big file.
-    // FIXME: free the glib pointer.
-    static std::tuple<util::Error, QByteArray> compressFile(const QString &filepath)
-    {
-        g_autoptr(GError) gErr = nullptr;
-        g_autoptr(GBytes) inputBytes = nullptr;
-        g_autoptr(GInputStream) memInput = nullptr;
+        g_autoptr(GInputStream) fileInput = nullptr;
         g_autoptr(GInputStream) zlibStream = nullptr;
-        g_autoptr(GBytes) zlibBytes = nullptr;
         g_autoptr(GFile) file = nullptr;
         g_autoptr(GFileInfo) info = nullptr;
         g_autoptr(GVariant) xattrs = nullptr;
 
+        const char *attributes = G_FILE_ATTRIBUTE_UNIX_MODE "," G_FILE_ATTRIBUTE_STANDARD_TYPE
+                "," G_FILE_ATTRIBUTE_STANDARD_SIZE "," G_FILE_ATTRIBUTE_STANDARD_SYMLINK_TARGET;
         file = g_file_new_for_path(filepath.toStdString().c_str());
-        if (file == nullptr) {
-            return { NewError(errno, "open file failed: " + filepath), QByteArray() };
-        }
-
         info = g_file_query_info(file,
-                                 G_FILE_ATTRIBUTE_UNIX_MODE,
+                                 attributes,
                                  G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
                                  nullptr,
-                                 nullptr);
-        guint32 mode = g_file_info_get_attribute_uint32(info, G_FILE_ATTRIBUTE_UNIX_MODE);
+                                 &gErr);
+        if (info == nullptr) {
+            return { NewError(gErr->code, "query file info failed: " + filepath + " "
+                                      + gErr->message),
+                     nullptr };
+        }
 
-        info = g_file_query_info(file,
-                                 G_FILE_ATTRIBUTE_STANDARD_IS_SYMLINK,
-                                 G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
-                                 nullptr,
-                                 nullptr);
-        if (g_file_info_get_is_symlink(info)) {
-            info = g_file_query_info(file,
-                                     G_FILE_ATTRIBUTE_STANDARD_SYMLINK_TARGET,
-                                     G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
-                                     nullptr,
-                                     nullptr);
-            g_file_info_set_file_type(info, G_FILE_TYPE_SYMBOLIC_LINK);
+        if (g_file_info_get_file_type(info) == G_FILE_TYPE_SYMBOLIC_LINK) {
             g_file_info_set_size(info, 0);
         } else {
-            info = g_file_query_info(file,
-                                     G_FILE_ATTRIBUTE_STANDARD_SIZE,
-                                     G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
-                                     nullptr,
-                                     nullptr);
             qDebug() << "fize size:" << g_file_info_get_size(info);
-
-            // Q_ASSERT(g_file_info_get_size(info) > 0);
-            g_file_info_set_size(info, g_file_info_get_size(info));
-            inputBytes = g_file_load_bytes(file, nullptr, nullptr, nullptr);
+            fileInput = G_INPUT_STREAM(g_file_read(file, nullptr, &gErr));
+            if (fileInput == nullptr) {
+                return { NewError(gErr->code, "open file failed: " + filepath + " "
+                                          + gErr->message),
+                         nullptr };
+            }
         }
         // TODO: set uid/gid with G_FILE_ATTRIBUTE_UNIX_UID/G_FILE_ATTRIBUTE_UNIX_GID
-        g_file_info_set_attribute_uint32(info, G_FILE_ATTRIBUTE_UNIX_MODE, mode);
-
-        if (inputBytes) {
-            memInput = g_memory_input_stream_new_from_bytes(inputBytes);
-        }
 
         xattrs = g_variant_ref_sink(g_variant_new_array(G_VARIANT_TYPE("(ayay)"), nullptr, 0));
 
-        ostree_raw_file_to_archive_z2_stream(memInput, info, xattrs, &zlibStream, nullptr, &gErr);
+        if (!ostree_raw_file_to_archive_z2_stream(fileInput,
+                                                  info,
+                                                  xattrs,
+                                                  &zlibStream,
+                                                  nullptr,
+                                                  &gErr)) {
+            return { NewError(gErr->code, "compress file failed: " + filepath + " "
+                                      + gErr->message),
+                     nullptr };
+        }
 
-        zlibBytes = glibInputStreamToBytes(zlibStream);
+        QScopedPointer<QTemporaryFile> tmpFile(new QTemporaryFile(parent));
+        if (!tmpFile->open()) {
+            return { NewError(tmpFile->error(), "create temporary file failed: "
+                                      + tmpFile->errorString()),
+                     nullptr };
+        }
+
+        char buffer[64 * 1024];
+        while (true) {
+            auto size = g_input_stream_read(zlibStream, buffer, sizeof(buffer), nullptr, &gErr);
+            if (size < 0) {
+                return { NewError(gErr->code, "compress file failed: " + filepath + " "
+                                          + gErr->message),
+                         nullptr };
+            }
+            if (size == 0) {
+                break;
+            }
+            if (tmpFile->write(buffer, size) != size) {
+                return { NewError(tmpFile->error(), "write temporary file failed: "
+                                          + tmpFile->errorString()),
+                         nullptr };
+            }
+        }
+        tmpFile->seek(0);
 
-        return { NoError(), glibBytesToQByteArray(zlibBytes) };
+        return { NoError(), tmpFile.take() };
     }
 
     static OstreeRepo *openRepo(const QString &path)
@@ -275,6 +303,236 @@ private:
         return { objects, NoError() };
     }
 
+    /*
+     * 查找服务端已有且本地仓库中也存在的同一应用的 commit
+     *
+     * @param ref: 待上传的软件包 ref
+     * @param serverRevs: 服务端 ref 与 commit 的对应关系
+     *
+     * @return QStringList: commit 列表
+     */
+    QStringList findServerCommits(const package::Ref &ref, const ParamStringMap &serverRevs)
+    {
+        QStringList commits;
+        for (auto it = serverRevs.constBegin(); it != serverRevs.constEnd(); ++it) {
+            // {channel}/{id}/{version}/{arch}/{module}
+            auto parts = it.key().split("/");
+            if (parts.value(1) != ref.appId || parts.value(3) != ref.arch || it.value().isEmpty()) {
+                continue;
+            }
+
+            g_autoptr(GVariant) commit = nullptr;
+            auto rev = it.value().toStdString();
+            if (ostree_repo_load_variant_if_exists(repoPtr,
+                                                   OSTREE_OBJECT_TYPE_COMMIT,
+                                                   rev.c_str(),
+                                                   &commit,
+                                                   nullptr)
+                && commit != nullptr) {
+                commits.push_back(it.value());
+            }
+        }
+        return commits;
+    }
+
+    /*
+     * 过滤掉指定 commit 可达的对象，用于跳过服务端已有的对象
+     *
+     * @param objects: 待上传对象
+     * @param revs: 服务端已有的 commit
+     *
+     * @return QList<OstreeRepoObject>: 需要上传的对象
+     */
+    QList<OstreeRepoObject> excludeObjectsOfCommits(const QList<OstreeRepoObject> &objects,
+                                                    const QStringList &revs)
+    {
+        if (revs.isEmpty()) {
+            return objects;
+        }
+
+        QSet<QString> haveObjects;
+        for (const auto &rev : revs) {
+            // 本地数据不完整时遍历失败返回空，此时按服务端没有处理
+            for (const auto &objName : traverseCommit(rev, 0)) {
+                haveObjects.insert(objName);
+            }
+        }
+
+        QList<OstreeRepoObject> missingObjects;
+        for (const auto &obj : objects) {
+            if (!haveObjects.contains(obj.objectName)) {
+                missingObjects.push_back(obj);
+            }
+        }
+        qInfo() << "server already has" << objects.size() - missingObjects.size() << "of"
+                << objects.size() << "objects, base commits:" << revs;
+        return missingObjects;
+    }
+
+    // 提交时跳过的路径，路径相对于提交的根目录，如 /devel
+    static OstreeRepoCommitFilterResult commitFilter(OstreeRepo * /*repo*/,
+                                                     const char *path,
+                                                     GFileInfo * /*fileInfo*/,
+                                                     gpointer userData)
+    {
+        auto skipPaths = static_cast<const QStringList *>(userData);
+        if (skipPaths->contains(QString::fromUtf8(path))) {
+            return OSTREE_REPO_COMMIT_FILTER_SKIP;
+        }
+        return OSTREE_REPO_COMMIT_FILTER_ALLOW;
+    }
+
+    /*
+     * 在进程内将目录提交到仓库，文件按内容寻址，仓库中已存在的对象不会重复写入
+     *
+     * @param dirPath: 待提交的目录
+     * @param ref: 提交的目标 ref
+     * @param subject: 提交信息
+     * @param skipPaths: 不需要提交的路径
+     *
+     * @return util::Error: 提交结果
+     */
+    util::Error commitDirectory(const QString &dirPath,
+                                const QString &ref,
+                                const QString &subject,
+                                const QStringList &skipPaths)
+    {
+        g_autoptr(GError) gErr = nullptr;
+        g_autoptr(GFile) dir = g_file_new_for_path(dirPath.toStdString().c_str());
+        g_autoptr(OstreeMutableTree) mtree = ostree_mutable_tree_new();
+        g_autoptr(GFile) root = nullptr;
+        g_autofree char *parent = nullptr;
+        g_autofree char *commit = nullptr;
+        auto refStr = ref.toStdString();
+        auto subjectStr = subject.toStdString();
+
+        g_autoptr(OstreeRepoCommitModifier) modifier = ostree_repo_commit_modifier_new(
+                OSTREE_REPO_COMMIT_MODIFIER_FLAGS_CANONICAL_PERMISSIONS,
+                commitFilter,
+                const_cast<QStringList *>(&skipPaths),
+                nullptr);
+
+        if (!ostree_repo_resolve_rev(repoPtr, refStr.c_str(), true, &parent, &gErr)) {
+            return NewError(gErr->code, "ostree_repo_resolve_rev failed: " + ref + " "
+                                    + gErr->message);
+        }
+
+        if (!ostree_repo_prepare_transaction(repoPtr, nullptr, nullptr, &gErr)) {
+            return NewError(gErr->code, "ostree_repo_prepare_transaction failed: "
+                                    + QString(gErr->message));
+        }
+
+        if (!ostree_repo_write_directory_to_mtree(repoPtr, dir, mtree, modifier, nullptr, &gErr)
+            || !ostree_repo_write_mtree(repoPtr, mtree, &root, nullptr, &gErr)
+            || !ostree_repo_write_commit(repoPtr,
+                                         parent,
+                                         subjectStr.c_str(),
+                                         nullptr,
+                                         nullptr,
+                                         OSTREE_REPO_FILE(root),
+                                         &commit,
+                                         nullptr,
+                                         &gErr)) {
+            ostree_repo_abort_transaction(repoPtr, nullptr, nullptr);
+            return NewError(gErr->code, "commit " + dirPath + " failed: " + gErr->message);
+        }
+
+        ostree_repo_transaction_set_ref(repoPtr, nullptr, refStr.c_str(), commit);
+        if (!ostree_repo_commit_transaction(repoPtr, nullptr, nullptr, &gErr)) {
+            ostree_repo_abort_transaction(repoPtr, nullptr, nullptr);
+            return NewError(gErr->code, "ostree_repo_commit_transaction failed: "
+                                    + QString(gErr->message));
+        }
+
+        qDebug() << "commit" << dirPath << "to" << ref << commit;
+        return NoError();
+    }
+
+    /*
+     * 导入挂载后的 bundle 镜像，镜像根目录为 runtime 模块，devel 目录为 devel 模块
+     *
+     * @param imagePath: 镜像挂载目录
+     *
+     * @return util::Error: 导入结果
+     */
+    util::Error importBundleImage(const QString &imagePath)
+    {
+        // bundle 中仅供 loader 使用的文件，不属于 layer
+        const QStringList bundleOnlyPaths = { "/devel", "/ll-box", "/loader", "/lib" };
+
+        const QList<QPair<QString, QString>> modules = {
+            { imagePath, "runtime" },
+            { imagePath + "/devel", "devel" },
+        };
+
+        for (const auto &module : modules) {
+            auto infoPath = module.first + "/info.json";
+            if (!util::fileExists(infoPath)) {
+                continue;
+            }
+
+            QScopedPointer<package::Info> info(util::loadJson<package::Info>(infoPath));
+            auto moduleName = info->module.isEmpty() ? module.second : info->module;
+            package::Ref ref("",
+                             kBundleChannel,
+                             info->appid,
+                             info->version,
+                             info->arch.value(0, util::hostArch()),
+                             moduleName);
+
+            auto err = commitDirectory(module.first,
+                                       ref.toOSTreeRefLocalString(),
+                                       "import " + info->appid + " " + info->version,
+                                       module.second == "runtime" ? bundleOnlyPaths
+                                                                  : QStringList());
+            if (!err.success()) {
+                return WrapError(err, "import " + module.first + " failed");
+            }
+        }
+
+        return NoError();
+    }
+
+    /*
+     * 将 commit 以 tar 流的形式直接导入 mkfs.erofs 生成镜像，不在磁盘上签出
+     * mkfs.erofs 的 --tar 参数由 erofs-utils 1.7 开始提供
+     *
+     * @param ref: 导出的 ref
+     * @param imagePath: 生成的镜像路径
+     *
+     * @return util::Error: 导出结果
+     */
+    util::Error exportImage(const QString &ref, const QString &imagePath)
+    {
+        QProcess ostree;
+        QProcess mkfs;
+
+        ostree.setProgram("ostree");
+        ostree.setArguments({ "export", "--repo=" + ostreePath, ref });
+        ostree.setStandardOutputProcess(&mkfs);
+
+        mkfs.setProgram("mkfs.erofs");
+        mkfs.setArguments({ "--tar=f", "-zlz4hc,9", imagePath });
+
+        qDebug() << "start" << ostree.arguments().join(" ") << "|" << mkfs.arguments().join(" ");
+        ostree.start();
+        mkfs.start();
+        ostree.waitForFinished(-1);
+        mkfs.waitForFinished(-1);
+
+        if (ostree.exitStatus() != QProcess::NormalExit || ostree.exitCode() != 0) {
+            return NewError(ostree.exitCode(),
+                            "ostree export failed: "
+                                    + QString::fromLocal8Bit(ostree.readAllStandardError()));
+        }
+        if (mkfs.exitStatus() != QProcess::NormalExit || mkfs.exitCode() != 0) {
+            return NewError(mkfs.exitCode(),
+                            "mkfs.erofs failed: "
+                                    + QString::fromLocal8Bit(mkfs.readAllStandardError()));
+        }
+        return NoError();
+    }
+
     std::tuple<QString, util::Error> resolveRev(const QString &ref)
     {
         GError *gErr = nullptr;
@@ -398,7 +656,9 @@ private:
         return { info->data->id, NoError() };
     }
 
-    util::Error doUploadTask(const QString &taskID, const QString &filePath)
+    util::Error doUploadTask(const QString &taskID,
+                             const QString &filePath,
+                             GCancellable *cancellable)
     {
         util::Error err(NoError());
         QByteArray fileData;
@@ -426,7 +686,26 @@ private:
         multiPart->append(filePart);
         qDebug() << "send " << filePath;
 
-        auto reply = httpClient.put(request, multiPart.data());
+        QScopedPointer<QNetworkReply, QScopedPointerDeleteLater> reply(
+                httpClient.putAsync(request, multiPart.data()));
+        // 上传在当前线程的事件循环中进行，定时检查取消状态并中止请求
+        QEventLoop loop;
+        QTimer cancelTimer;
+        cancelTimer.setInterval(kCancelCheckIntervalMs);
+        QObject::connect(&cancelTimer, &QTimer::timeout, [&]() {
+            if (g_cancellable_is_cancelled(cancellable)) {
+                cancelTimer.stop();
+                reply->abort();
+            }
+        });
+        QObject::connect(reply.data(), &QNetworkReply::finished, &loop, &QEventLoop::quit);
+        if (!reply->isFinished()) {
+            cancelTimer.start();
+            loop.exec();
+        }
+        if (g_cancellable_is_cancelled(cancellable)) {
+            return NewError(-1, "upload cancelled");
+        }
         auto data = reply->readAll();
 
         qDebug() << "doUpload" << data;
@@ -436,66 +715,243 @@ private:
         return NoError();
     }
 
-    util::Error doUploadTask(const QString &repoName,
-                             const QString &taskID,
-                             const QList<OstreeRepoObject> &objects)
+    /*
+     * 按大小和数量将待上传对象分批，commit 对象单独作为最后一批
+     *
+     * @param objects: 待上传对象
+     *
+     * @return QList<QList<OstreeRepoObject>>: 分批结果
+     */
+    static QList<QList<OstreeRepoObject>> splitUploadBatches(const QList<OstreeRepoObject> &objects)
     {
-        util::Error err(NoError());
-        QByteArray fileData;
+        QList<QList<OstreeRepoObject>> batches;
+        QList<OstreeRepoObject> commits;
+        QList<OstreeRepoObject> batch;
+        qint64 batchBytes = 0;
 
-        QUrl url(QString("%1/api/v1/blob/%2/upload/%3").arg(remoteEndpoint, repoName, taskID));
-        QNetworkRequest request(url);
-        request.setRawHeader(QByteArray("X-Token"), remoteToken.toLocal8Bit());
+        for (const auto &obj : objects) {
+            if (obj.objectName.endsWith(".commit")) {
+                commits.push_back(obj);
+                continue;
+            }
+
+            auto size = QFileInfo(obj.path).size();
+            if (!batch.isEmpty()
+                && (batchBytes + size > kUploadBatchBytes || batch.size() >= kUploadBatchObjects)) {
+                batches.push_back(batch);
+                batch.clear();
+                batchBytes = 0;
+            }
+            batch.push_back(obj);
+            batchBytes += size;
+        }
 
+        if (!batch.isEmpty()) {
+            batches.push_back(batch);
+        }
+        if (!commits.isEmpty()) {
+            batches.push_back(commits);
+        }
+        return batches;
+    }
+
+    /*
+     * 构造一批对象的上传内容，.file 对象压缩到临时文件，请求发送时从文件流式读取
+     *
+     * @param objects: 待上传对象
+     *
+     * @return QHttpMultiPart*: 上传内容，失败时为空
+     */
+    static std::tuple<util::Error, QHttpMultiPart *>
+    newUploadMultiPart(const QList<OstreeRepoObject> &objects)
+    {
         QScopedPointer<QHttpMultiPart> multiPart(new QHttpMultiPart(QHttpMultiPart::FormDataType));
 
         // FIXME: add link support
-        QList<QHttpPart> partList;
-        partList.reserve(objects.size());
-
         for (const auto &obj : objects) {
-            partList.push_back(QHttpPart());
-            auto filePart = partList.last();
-
-            QFileInfo fi(obj.path);
-            if (fi.isSymLink() && false) {
-                filePart.setHeader(QNetworkRequest::ContentDispositionHeader,
-                                   QVariant(QString("form-data; name=\"%1\"; filename=\"%2\"")
-                                                    .arg("link", obj.objectName)));
-                filePart.setBody(QString("%1:%2").arg(obj.objectName, obj.path).toUtf8());
+            QHttpPart filePart;
+            QString objectName = obj.objectName;
+            QFile *file = nullptr;
+
+            if (QFileInfo(obj.path).fileName().endsWith(".file")) {
+                util::Error err(NoError());
+                objectName += "z";
+                std::tie(err, file) = compressFile(obj.path, multiPart.data());
+                if (!err.success()) {
+                    return { WrapError(err, "compress object failed: " + obj.objectName), nullptr };
+                }
             } else {
-                QString objectName = obj.objectName;
-                if (fi.fileName().endsWith(".file")) {
-                    objectName += "z";
-                    std::tie(err, fileData) = compressFile(obj.path);
-                    filePart.setHeader(QNetworkRequest::ContentDispositionHeader,
-                                       QVariant(QString(R"(form-data; name="%1"; filename="%2")")
-                                                        .arg("file", objectName)));
-                    filePart.setBody(fileData);
-                } else {
-                    auto *file = new QFile(obj.path, multiPart.data());
-                    file->open(QIODevice::ReadOnly);
-                    filePart.setHeader(QNetworkRequest::ContentDispositionHeader,
-                                       QVariant(QString(R"(form-data; name="%1"; filename="%2")")
-                                                        .arg("file", obj.objectName)));
-                    filePart.setBodyDevice(file);
+                file = new QFile(obj.path, multiPart.data());
+                if (!file->open(QIODevice::ReadOnly)) {
+                    return { NewError(file->error(), "open object failed: " + obj.path + " "
+                                              + file->errorString()),
+                             nullptr };
                 }
             }
+
+            filePart.setHeader(QNetworkRequest::ContentDispositionHeader,
+                               QVariant(QString(R"(form-data; name="%1"; filename="%2")")
+                                                .arg("file", objectName)));
+            filePart.setBodyDevice(file);
             multiPart->append(filePart);
-            qDebug() << fi.isSymLink() << "send " << obj.objectName << obj.path;
         }
 
-        auto reply = httpClient.put(request, multiPart.data());
-        auto data = reply->readAll();
+        return { NoError(), multiPart.take() };
+    }
 
-        qDebug() << "doUpload" << data;
+    /*
+     * 并发上传多批对象，同时进行的请求数不超过 kUploadStreams，失败的批次等待一段时间后单独重试，
+     * 等待时间按重试次数指数增长
+     *
+     * @param repoName: 远端仓库名称
+     * @param taskID: 上传任务 id
+     * @param batches: 分批后的对象
+     * @param cancellable: 本次上传的取消对象
+     *
+     * @return util::Error: 上传结果
+     */
+    util::Error uploadBatches(const QString &repoName,
+                              const QString &taskID,
+                              const QList<QList<OstreeRepoObject>> &batches,
+                              GCancellable *cancellable)
+    {
+        QUrl url(QString("%1/api/v1/blob/%2/upload/%3").arg(remoteEndpoint, repoName, taskID));
 
-        QScopedPointer<UploadTaskResponse> info(util::loadJsonBytes<UploadTaskResponse>(data));
-        if (200 != info->code) {
-            return NewError(-1, info->msg);
+        QQueue<int> pending;
+        for (int i = 0; i < batches.size(); ++i) {
+            pending.enqueue(i);
         }
+        QMap<int, int> retries;
+        QSet<QNetworkReply *> runningReplies;
+        // 已结束的请求，不能在其 finished 信号中直接删除，回到事件循环后立即释放
+        QList<QNetworkReply *> finishedReplies;
+        auto releaseFinished = [&]() {
+            qDeleteAll(finishedReplies);
+            finishedReplies.clear();
+        };
+        int running = 0;
+        // 等待重试的批次数
+        int delayed = 0;
+        util::Error result(NoError());
+        QEventLoop loop;
+
+        // 上传在当前线程的事件循环中进行，定时检查取消状态并中止进行中的请求
+        QTimer cancelTimer;
+        cancelTimer.setInterval(kCancelCheckIntervalMs);
+        QObject::connect(&cancelTimer, &QTimer::timeout, [&]() {
+            if (!g_cancellable_is_cancelled(cancellable)) {
+                return;
+            }
+            cancelTimer.stop();
+            if (result.success()) {
+                result = NewError(-1, "upload cancelled");
+            }
+            for (auto reply : runningReplies.values()) {
+                reply->abort();
+            }
+            // 没有进行中的请求时不再等待重试的批次
+            if (running == 0) {
+                loop.quit();
+            }
+        });
 
-        return NoError();
+        std::function<void()> startNext = [&]() {
+            while (result.success() && running < kUploadStreams && !pending.isEmpty()) {
+                auto index = pending.dequeue();
+                const auto &batch = batches.at(index);
+
+                util::Error err(NoError());
+                QHttpMultiPart *multiPart = nullptr;
+                std::tie(err, multiPart) = newUploadMultiPart(batch);
+                if (!err.success()) {
+                    result = err;
+                    break;
+                }
+
+                QNetworkRequest request(url);
+                request.setRawHeader(QByteArray("X-Token"), remoteToken.toLocal8Bit());
+                auto reply = httpClient.putAsync(request, multiPart);
+                // 上传内容及临时文件随请求一起释放
+                multiPart->setParent(reply);
+                runningReplies.insert(reply);
+                ++running;
+                qDebug() << "upload batch" << index + 1 << "/" << batches.size() << "objects"
+                         << batch.size();
+
+                QObject::connect(reply, &QNetworkReply::finished, [&, reply, index]() {
+                    runningReplies.remove(reply);
+                    --running;
+                    auto data = reply->readAll();
+                    qDebug() << "doUpload" << data;
+
+                    QScopedPointer<UploadTaskResponse> info(
+                            util::loadJsonBytes<UploadTaskResponse>(data));
+                    if (reply->error() != QNetworkReply::NoError || 200 != info->code) {
+                        auto msg = info->msg.isEmpty() ? reply->errorString() : info->msg;
+                        if (result.success() && retries[index] < kUploadRetries) {
+                            const int delay = kUploadRetryDelayMs << retries[index]++;
+                            qWarning() << "upload batch" << index + 1 << "failed, retry in"
+                                       << delay << "ms:" << msg;
+                            ++delayed;
+                            QTimer::singleShot(delay, &loop, [&, index]() {
+                                --delayed;
+                                pending.enqueue(index);
+                                startNext();
+                                if (running == 0) {
+                                    loop.quit();
+                                }
+                            });
+                        } else if (result.success()) {
+                            result = NewError(-1, msg);
+                        }
+                    }
+                    // 请求结束后尽快释放上传内容及临时文件，控制磁盘占用
+                    finishedReplies.append(reply);
+                    QTimer::singleShot(0, &loop, releaseFinished);
+
+                    startNext();
+                    if (running == 0 && (delayed == 0 || !result.success())) {
+                        loop.quit();
+                    }
+                });
+            }
+        };
+
+        if (g_cancellable_is_cancelled(cancellable)) {
+            return NewError(-1, "upload cancelled");
+        }
+        startNext();
+        if (running > 0) {
+            cancelTimer.start();
+            loop.exec();
+        }
+        // 事件循环退出前最后结束的请求还未释放
+        releaseFinished();
+        return result;
+    }
+
+    util::Error doUploadTask(const QString &repoName,
+                             const QString &taskID,
+                             const QList<OstreeRepoObject> &objects,
+                             GCancellable *cancellable)
+    {
+        auto batches = splitUploadBatches(objects);
+        if (batches.isEmpty()) {
+            return NoError();
+        }
+
+        // commit 对象在其余对象全部上传成功后再上传，服务端不会看到引用不完整的 commit
+        QList<QList<OstreeRepoObject>> commitBatch;
+        if (batches.last().first().objectName.endsWith(".commit")) {
+            commitBatch.push_back(batches.takeLast());
+        }
+
+        auto err = uploadBatches(repoName, taskID, batches, cancellable);
+        if (!err.success()) {
+            return err;
+        }
+
+        return uploadBatches(repoName, taskID, commitBatch, cancellable);
     }
 
     util::Error cleanUploadTask(const QString &repoName, const QString &taskID)
@@ -588,6 +1044,37 @@ private:
 
     util::HttpRestClient httpClient;
 
+    /*
+     * 单次签出或上传使用的取消对象，操作开始时创建，结束时注销。
+     * OSTreeRepo::cancel 只中止进行中的操作，不影响之后的操作
+     */
+    class Operation
+    {
+    public:
+        explicit Operation(OSTreeRepoPrivate *d)
+            : d(d)
+            , cancellable(g_cancellable_new())
+        {
+            QMutexLocker locker(&d->operationsMutex);
+            d->operations.insert(cancellable);
+        }
+
+        ~Operation()
+        {
+            {
+                QMutexLocker locker(&d->operationsMutex);
+                d->operations.remove(cancellable);
+            }
+            g_object_unref(cancellable);
+        }
+
+        OSTreeRepoPrivate *const d;
+        GCancellable *const cancellable;
+    };
+
+    QMutex operationsMutex;
+    QSet<GCancellable *> operations;
+
     OSTreeRepo *q_ptr;
     Q_DECLARE_PUBLIC(OSTreeRepo);
 };
@@ -617,14 +1104,52 @@ linglong::util::Error OSTreeRepo::renameBranch(const package::Ref &oldRef,
     return ret;
 }
 
-linglong::util::Error OSTreeRepo::import(const package::Bundle & /*bundle*/)
+linglong::util::Error OSTreeRepo::import(const package::Bundle &bundle)
 {
-    return NoError() << -1 << "Not Implemented";
+    Q_D(OSTreeRepo);
+
+    QTemporaryDir tmpDir;
+    if (!tmpDir.isValid()) {
+        return NewError(-1, "create temporary dir failed: " + tmpDir.errorString());
+    }
+
+    // 原地挂载 bundle 中的镜像，直接从挂载点提交，不解压到磁盘
+    auto mountPoint = tmpDir.path() + "/image";
+    auto err = bundle.mount(mountPoint);
+    if (!err.success()) {
+        return WrapError(err, "mount bundle failed: " + bundle.path());
+    }
+
+    err = d->importBundleImage(mountPoint);
+    bundle.umount(mountPoint);
+    return err;
 }
 
-linglong::util::Error OSTreeRepo::exportBundle(package::Bundle & /*bundle*/)
+linglong::util::Error OSTreeRepo::exportBundle(package::Bundle &bundle)
 {
-    return NoError() << -1 << "Not Implemented";
+    Q_D(OSTreeRepo);
+
+    if (bundle.ref().isEmpty() || bundle.path().isEmpty()) {
+        return NewError(-1, "bundle ref and path must be set before export");
+    }
+
+    QTemporaryDir tmpDir;
+    if (!tmpDir.isValid()) {
+        return NewError(-1, "create temporary dir failed: " + tmpDir.errorString());
+    }
+
+    auto imagePath = tmpDir.path() + "/image.erofs";
+    auto err = d->exportImage(bundle.ref(), imagePath);
+    if (!err.success()) {
+        return WrapError(err, "export " + bundle.ref() + " failed");
+    }
+
+    err = bundle.makeFromImage(imagePath, bundle.path());
+    if (!err.success()) {
+        return WrapError(err, "make bundle failed");
+    }
+
+    return bundle.load(bundle.path());
 }
 
 std::tuple<linglong::util::Error, QList<package::Ref>> OSTreeRepo::list(const QString & /*filter*/)
@@ -672,7 +1197,8 @@ linglong::util::Error OSTreeRepo::push(const package::Ref &ref)
         return WrapError(err, "compress ostree data failed");
     }
 
-    auto uploadStatus = d->doUploadTask(taskID, filePath);
+    OSTreeRepoPrivate::Operation operation(d);
+    auto uploadStatus = d->doUploadTask(taskID, filePath, operation.cancellable);
     if (!uploadStatus.success()) {
         // d->cleanUploadTask(d->remoteRepoName, taskID);
         return WrapError(uploadStatus, "call doUploadTask failed");
@@ -688,7 +1214,7 @@ linglong::util::Error OSTreeRepo::push(const package::Ref &ref)
     return WrapError(d->cleanUploadTask(ref, filePath), "call cleanUploadTask failed");
 }
 
-linglong::util::Error OSTreeRepo::push(const package::Ref &ref, bool /*force*/)
+linglong::util::Error OSTreeRepo::push(const package::Ref &ref, bool force)
 {
     Q_D(OSTreeRepo);
 
@@ -714,13 +1240,18 @@ linglong::util::Error OSTreeRepo::push(const package::Ref &ref, bool /*force*/)
     }
     qDebug() << "push commit" << commitID << ref.toOSTreeRefLocalString();
 
+    auto serverRev = repoInfo->revs.value(ref.toOSTreeRefLocalString());
+    if (!force && serverRev == commitID) {
+        qInfo() << ref.toOSTreeRefLocalString() << "is up to date on server";
+        return NoError();
+    }
+
     auto revPair = new RevPair(&uploadTaskReq);
 
     // upload msg, should specific channel in ref
     uploadTaskReq.refs[ref.toOSTreeRefLocalString()] = revPair;
     revPair->client = commitID;
-    // FIXME: get server version to compare
-    revPair->server = "";
+    revPair->server = serverRev;
 
     // find files to commit
     std::tie(objects, err) = d->findObjectsOfCommits({ commitID });
@@ -728,6 +1259,11 @@ linglong::util::Error OSTreeRepo::push(const package::Ref &ref, bool /*force*/)
         return WrapError(err, "call findObjectsOfCommits failed");
     }
 
+    // 服务端已有的同一应用 commit 在本地存在时，只上传新 commit 中服务端没有的对象
+    if (!force) {
+        objects = d->excludeObjectsOfCommits(objects, d->findServerCommits(ref, repoInfo->revs));
+    }
+
     for (auto const &obj : objects) {
         uploadTaskReq.objects.push_back(obj.objectName);
     }
@@ -739,7 +1275,8 @@ linglong::util::Error OSTreeRepo::push(const package::Ref &ref, bool /*force*/)
         return WrapError(err, "call newUploadTask failed");
     }
 
-    auto uploadStatus = d->doUploadTask(d->remoteRepoName, taskID, objects);
+    OSTreeRepoPrivate::Operation operation(d);
+    auto uploadStatus = d->doUploadTask(d->remoteRepoName, taskID, objects, operation.cancellable);
     if (!uploadStatus.success()) {
         d->cleanUploadTask(d->remoteRepoName, taskID);
         return WrapError(uploadStatus, "call newUploadTask failed");
@@ -832,12 +1369,22 @@ linglong::util::Error OSTreeRepo::checkout(const package::Ref &ref,
                                            const QString &subPath,
                                            const QString &target)
 {
-    QStringList args = { "checkout", "--union", "--force-copy" };
-    if (!subPath.isEmpty()) {
-        args.push_back("--subpath=" + subPath);
+    Q_D(OSTreeRepo);
+
+    // 签出的文件可能被修改，不能与仓库中的对象共用硬链接
+    QString err;
+    OSTreeRepoPrivate::Operation operation(d);
+    if (!OSTREE_REPO_HELPER->checkoutRefs(d->ostreePath,
+                                          { ref.toString() },
+                                          subPath,
+                                          target,
+                                          false,
+                                          true,
+                                          operation.cancellable,
+                                          err)) {
+        return NewError(-1, err);
     }
-    args.append({ ref.toString(), target });
-    return WrapError(dd_ptr->ostreeRun(args), "");
+    return NoError();
 }
 
 linglong::util::Error OSTreeRepo::checkoutAll(const package::Ref &ref,
@@ -846,29 +1393,32 @@ linglong::util::Error OSTreeRepo::checkoutAll(const package::Ref &ref,
 {
     Q_D(OSTreeRepo);
 
-    QStringList runtimeArgs = { "checkout",
-                                "--union",
-                                QStringList{ ref.toString(), "runtime" }.join("/"),
-                                target };
-    QStringList develArgs = { "checkout",
-                              "--union",
-                              QStringList{ ref.toString(), "devel" }.join("/"),
-                              target };
+    QStringList refs = { QStringList{ ref.toString(), "runtime" }.join("/") };
 
-    if (!subPath.isEmpty()) {
-        runtimeArgs.push_back("--subpath=" + subPath);
-        develArgs.push_back("--subpath=" + subPath);
+    // Fixme: some old package have no devel, ignore it for now.
+    auto develRef = QStringList{ ref.toString(), "devel" }.join("/");
+    QString develCommit;
+    util::Error err(NoError());
+    std::tie(develCommit, err) = d->resolveRev(develRef);
+    if (err.success()) {
+        refs.push_back(develRef);
+    } else {
+        qWarning() << develRef << "not found, skip";
     }
 
-    auto ret = d->ostreeRun(runtimeArgs);
-
-    if (!ret.success()) {
-        return WrapError(ret, "");
+    // runtime 与 devel 使用同一个仓库对象依次合并签出
+    QString checkoutErr;
+    OSTreeRepoPrivate::Operation operation(d);
+    if (!OSTREE_REPO_HELPER->checkoutRefs(d->ostreePath,
+                                          refs,
+                                          subPath,
+                                          target,
+                                          false,
+                                          false,
+                                          operation.cancellable,
+                                          checkoutErr)) {
+        return NewError(-1, checkoutErr);
     }
-
-    ret = d->ostreeRun(develArgs);
-
-    // Fixme: some old package have no devel, ignore error for now.
     return NoError();
 }
 
@@ -963,37 +1513,12 @@ package::Ref OSTreeRepo::remoteLatestRef(const package::Ref &ref)
 
 package::Ref OSTreeRepo::latestOfRef(const QString &appId, const QString &appVersion)
 {
-    auto latestVersionOf = [this](const QString &appId) {
-        auto localRepoRoot = QString(dd_ptr->repoRootPath) + "/layers" + "/" + appId;
-
-        QDir appRoot(localRepoRoot);
-
-        // found latest
-        if (appRoot.exists("latest")) {
-            return appRoot.absoluteFilePath("latest");
-        }
-
-        // FIXME: found biggest version
-        appRoot.setSorting(QDir::Name | QDir::Reversed);
-        auto verDirs = appRoot.entryList(QDir::NoDotAndDotDot | QDir::Dirs);
-        auto available = verDirs.value(0);
-        for (auto item : verDirs) {
-            linglong::util::AppVersion versionIter(item);
-            linglong::util::AppVersion dstVersion(available);
-            if (versionIter.isValid() && versionIter.isBigThan(dstVersion)) {
-                available = item;
-            }
-        }
-        qDebug() << "available version" << available << appRoot << verDirs;
-        return available;
-    };
-
     // 未指定版本使用最新版本，指定版本下使用指定版本
     QString version;
     if (!appVersion.isEmpty()) {
         version = appVersion;
     } else {
-        version = latestVersionOf(appId);
+        version = LAYER_CATALOG->latestVersion(QString(dd_ptr->repoRootPath) + "/layers", appId);
     }
     auto ref = appId + "/" + version + "/" + util::hostArch();
     return package::Ref(ref);
@@ -1075,6 +1600,16 @@ std::tuple<QString, util::Error> OSTreeRepo::compressOstreeData(const package::R
     return { filePath, NoError() };
 }
 
+void OSTreeRepo::cancel()
+{
+    Q_D(OSTreeRepo);
+
+    QMutexLocker locker(&d->operationsMutex);
+    for (auto cancellable : d->operations) {
+        g_cancellable_cancel(cancellable);
+    }
+}
+
 OSTreeRepo::~OSTreeRepo() = default;
 
 } // namespace repo
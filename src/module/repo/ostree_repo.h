@@ -91,6 +91,9 @@ public:
 
     package::Ref latestOfRef(const QString &appId, const QString &appVersion) override;
 
+    // 中止进行中的签出及上传，可在其它线程调用
+    void cancel();
+
 private:
     QScopedPointer<OSTreeRepoPrivate> dd_ptr;
     Q_DECLARE_PRIVATE_D(qGetPtrHelper(dd_ptr), OSTreeRepo)
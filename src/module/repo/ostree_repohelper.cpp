@@ -11,10 +11,135 @@
 #include "module/util/version/version.h"
 #include "ostree-repo.h"
 
+#include <curl/curl.h>
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 const int MAX_ERRINFO_BUFSIZE = 512;
 
+namespace {
+
+// 最后一次删除后等待的时间，期间的删除合并为一次 prune
+const qint64 kPruneDelayMs = 1000 * 30;
+// 两次 prune 的最小间隔
+const qint64 kPruneMinIntervalMs = 1000 * 60 * 10;
+// 仓库正在下载时推迟 prune 的时间
+const qint64 kPruneRetryMs = 1000 * 60;
+
+// 将调用线程的 IO 优先级设为 idle，只在磁盘空闲时执行 prune
+void setIdleIOPriority()
+{
+    const int ioprioWhoProcess = 1;
+    const int ioprioClassIdle = 3;
+    const int ioprioClassShift = 13;
+    if (syscall(SYS_ioprio_set, ioprioWhoProcess, 0, ioprioClassIdle << ioprioClassShift) != 0) {
+        qWarning() << "set idle io priority failed:" << strerror(errno);
+    }
+}
+
+// summary 条件请求的响应
+struct SummaryResponse
+{
+    long code = 0;
+    QByteArray body;
+    QString etag;
+    QString lastModified;
+};
+
+size_t writeSummaryBody(char *ptr, size_t size, size_t nmemb, void *userData)
+{
+    static_cast<SummaryResponse *>(userData)->body.append(ptr, static_cast<int>(size * nmemb));
+    return size * nmemb;
+}
+
+size_t writeSummaryHeader(char *buffer, size_t size, size_t nitems, void *userData)
+{
+    auto response = static_cast<SummaryResponse *>(userData);
+    auto line = QString::fromLatin1(buffer, static_cast<int>(size * nitems)).trimmed();
+    auto separator = line.indexOf(':');
+    if (separator > 0) {
+        auto name = line.left(separator).trimmed().toLower();
+        auto value = line.mid(separator + 1).trimmed();
+        if (name == "etag") {
+            response->etag = value;
+        } else if (name == "last-modified") {
+            response->lastModified = value;
+        }
+    }
+    return size * nitems;
+}
+
+/*
+ * 带条件地下载远端仓库 summary，summary 未变化时服务端返回 304 且不返回内容
+ *
+ * @param url: 远端仓库地址
+ * @param etag: 上次下载时服务端返回的 ETag
+ * @param lastModified: 上次下载时服务端返回的 Last-Modified
+ * @param response: 响应
+ * @param err: 错误信息
+ *
+ * @return bool: true:请求完成 false:请求失败
+ */
+bool fetchSummaryIfModified(const QString &url,
+                            const QString &etag,
+                            const QString &lastModified,
+                            SummaryResponse &response,
+                            QString &err)
+{
+    CURL *curl = curl_easy_init();
+    if (curl == nullptr) {
+        err = "curl_easy_init failed";
+        return false;
+    }
+
+    struct curl_slist *headers = nullptr;
+    if (!etag.isEmpty()) {
+        headers = curl_slist_append(headers, ("If-None-Match: " + etag).toStdString().c_str());
+    }
+    if (!lastModified.isEmpty()) {
+        headers = curl_slist_append(headers,
+                                    ("If-Modified-Since: " + lastModified).toStdString().c_str());
+    }
+
+    auto summaryUrl = (url.endsWith("/") ? url : url + "/").toStdString() + "summary";
+    curl_easy_setopt(curl, CURLOPT_URL, summaryUrl.c_str());
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 30L);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 600L);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeSummaryBody);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, writeSummaryHeader);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &response);
+
+    auto ret = curl_easy_perform(curl);
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response.code);
+
+    curl_slist_free_all(headers);
+    curl_easy_cleanup(curl);
+
+    if (ret != CURLE_OK) {
+        err = QString("fetch %1 failed: %2")
+                      .arg(QString::fromStdString(summaryUrl))
+                      .arg(QLatin1String(curl_easy_strerror(ret)));
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
 namespace linglong {
 
 /*
@@ -38,6 +163,19 @@ OstreeRepoHelper::OstreeRepoHelper()
 
 OstreeRepoHelper::~OstreeRepoHelper()
 {
+    {
+        QMutexLocker locker(&pruneMutex);
+        pruneStopping = true;
+        if (pruneCancellable != nullptr) {
+            g_cancellable_cancel(pruneCancellable);
+        }
+        pruneCondition.wakeAll();
+    }
+    if (pruneThread.joinable()) {
+        pruneThread.join();
+    }
+    g_clear_object(&pruneCancellable);
+
     if (pLingLongDir != nullptr) {
         qInfo() << "~OstreeRepoHelper() called";
         // free ostree repo
@@ -330,83 +468,136 @@ bool OstreeRepoHelper::getRemoteRefs(const QString &repoPath,
         err = info;
         return false;
     }
-    const std::string remoteNameTmp = remoteName.toStdString();
-    g_autoptr(GBytes) summaryBytes = NULL;
-    g_autoptr(GBytes) summarySigBytes = NULL;
-    GCancellable *cancellable = NULL;
-    GError *error = NULL;
-    bool ret = fetchRemoteSummary(pLingLongDir->repo,
-                                  remoteNameTmp.c_str(),
-                                  &summaryBytes,
-                                  &summarySigBytes,
-                                  cancellable,
-                                  &error);
-    if (!ret) {
-        if (err != NULL) {
-            snprintf(info,
-                     MAX_ERRINFO_BUFSIZE,
-                     "%s, function:%s err:%s",
-                     __FILE__,
-                     __func__,
-                     error->message);
-            err = info;
-        } else {
-            err = "getRemoteRefs remote repo err";
-        }
+    RemoteSummary summary;
+    if (!updateRemoteSummary(repoPath, remoteName, summary, err)) {
         return false;
     }
-    GVariant *summary = g_variant_ref_sink(
-            g_variant_new_from_bytes(OSTREE_SUMMARY_GVARIANT_FORMAT, summaryBytes, FALSE));
+
+    for (auto iter = summary.refs.constBegin(); iter != summary.refs.constEnd(); ++iter) {
+        outRefs.insert(iter.key(), iter.value());
+    }
+    return true;
+}
+
+void OstreeRepoHelper::parseRemoteSummary(GBytes *data, RemoteSummary &summary)
+{
+    g_autoptr(GVariant) summaryVariant = g_variant_ref_sink(
+            g_variant_new_from_bytes(OSTREE_SUMMARY_GVARIANT_FORMAT, data, FALSE));
+
     // std::map转QMap
     std::map<std::string, std::string> outRet;
-    getPkgRefsBySummary(summary, outRet);
+    getPkgRefsBySummary(summaryVariant, outRet);
+    summary.refs.clear();
     for (auto iter = outRet.begin(); iter != outRet.end(); ++iter) {
-        outRefs.insert(QString::fromStdString(iter->first), QString::fromStdString(iter->second));
+        summary.refs.insert(QString::fromStdString(iter->first),
+                            QString::fromStdString(iter->second));
     }
-    return true;
+    summary.index.build(summary.refs);
 }
 
-/*
- * 按照指定字符分割字符串
- *
- * @param str: 目标字符串
- * @param separator: 分割字符串
- * @param result: 分割结果
- */
-void OstreeRepoHelper::splitStr(std::string str,
-                                std::string separator,
-                                std::vector<std::string> &result)
+bool OstreeRepoHelper::updateRemoteSummary(const QString &repoPath,
+                                           const QString &remoteName,
+                                           RemoteSummary &summary,
+                                           QString &err)
 {
-    size_t cutAt;
-    while ((cutAt = str.find_first_of(separator)) != str.npos) {
-        if (cutAt > 0) {
-            result.push_back(str.substr(0, cutAt));
+    const std::string remoteNameTmp = remoteName.toStdString();
+    const auto cachePath = repoPath + "/cache/summaries/" + remoteName;
+    const auto cacheMetaPath = cachePath + ".json";
+
+    // 内存中没有时从磁盘缓存加载
+    RemoteSummary cached;
+    {
+        QMutexLocker locker(&summaryMutex);
+        cached = summaryMap.value(remoteName);
+    }
+    if (cached.refs.isEmpty()) {
+        QFile cacheFile(cachePath);
+        QFile metaFile(cacheMetaPath);
+        if (cacheFile.open(QIODevice::ReadOnly) && metaFile.open(QIODevice::ReadOnly)) {
+            auto meta = QJsonDocument::fromJson(metaFile.readAll()).object();
+            auto data = cacheFile.readAll();
+            g_autoptr(GBytes) bytes = g_bytes_new(data.constData(), data.size());
+            parseRemoteSummary(bytes, cached);
+            cached.etag = meta.value("etag").toString();
+            cached.lastModified = meta.value("lastModified").toString();
         }
-        str = str.substr(cutAt + 1);
     }
-    if (str.length() > 0) {
-        result.push_back(str);
+
+    g_autofree char *url = NULL;
+    g_autoptr(GError) error = NULL;
+    if (!ostree_repo_remote_get_url(pLingLongDir->repo, remoteNameTmp.c_str(), &url, &error)) {
+        err = QString("get url of remote %1 failed: %2").arg(remoteName).arg(error->message);
+        return false;
     }
-}
+    const auto remoteUrl = QString::fromUtf8(url);
+
+    auto storeSummary = [&](const RemoteSummary &fresh) {
+        QMutexLocker locker(&summaryMutex);
+        summaryMap.insert(remoteName, fresh);
+        summary = fresh;
+    };
+
+    if (remoteUrl.startsWith("http://") || remoteUrl.startsWith("https://")) {
+        SummaryResponse response;
+        QString fetchErr;
+        if (!fetchSummaryIfModified(remoteUrl,
+                                    cached.refs.isEmpty() ? QString() : cached.etag,
+                                    cached.refs.isEmpty() ? QString() : cached.lastModified,
+                                    response,
+                                    fetchErr)) {
+            qWarning() << fetchErr;
+        } else if (response.code == 304 && !cached.refs.isEmpty()) {
+            qDebug() << "summary of" << remoteName << "not modified";
+            storeSummary(cached);
+            return true;
+        } else if (response.code == 200) {
+            RemoteSummary fresh;
+            g_autoptr(GBytes) bytes = g_bytes_new(response.body.constData(), response.body.size());
+            parseRemoteSummary(bytes, fresh);
+            fresh.etag = response.etag;
+            fresh.lastModified = response.lastModified;
+
+            // 保存到磁盘，服务端未提供校验信息时无法条件请求，不保存
+            if (!fresh.etag.isEmpty() || !fresh.lastModified.isEmpty()) {
+                util::ensureDir(repoPath + "/cache/summaries");
+                QSaveFile cacheFile(cachePath);
+                QSaveFile metaFile(cacheMetaPath);
+                QJsonObject meta{ { "etag", fresh.etag }, { "lastModified", fresh.lastModified } };
+                if (cacheFile.open(QIODevice::WriteOnly) && metaFile.open(QIODevice::WriteOnly)) {
+                    cacheFile.write(response.body);
+                    metaFile.write(QJsonDocument(meta).toJson());
+                    if (!cacheFile.commit() || !metaFile.commit()) {
+                        qWarning() << "save summary cache failed" << cachePath;
+                    }
+                }
+            }
 
-/*
- * 解析仓库软件包索引ref信息
- *
- * @param fullRef: 目标软件包索引ref信息
- * @param result: 解析结果
- *
- * @return bool: true:成功 false:失败
- */
-bool OstreeRepoHelper::resolveRef(const std::string &fullRef, std::vector<std::string> &result)
-{
-    // vector<string> result;
-    splitStr(fullRef, "/", result);
-    // new ref format org.deepin.calculator/1.2.2/x86_64
-    if (result.size() != 3) {
-        qCritical() << "resolveRef Wrong number of components err";
+            storeSummary(fresh);
+            return true;
+        } else {
+            qWarning() << "fetch summary of" << remoteName << "return" << response.code;
+        }
+    }
+
+    // 回退到 libostree 下载
+    g_autoptr(GBytes) summaryBytes = NULL;
+    g_autoptr(GBytes) summarySigBytes = NULL;
+    GError *fetchError = NULL;
+    if (!fetchRemoteSummary(pLingLongDir->repo,
+                            remoteNameTmp.c_str(),
+                            &summaryBytes,
+                            &summarySigBytes,
+                            NULL,
+                            &fetchError)) {
+        err = QString("getRemoteRefs remote repo err: %1")
+                      .arg(fetchError ? fetchError->message : "unknown");
+        g_clear_error(&fetchError);
         return false;
     }
 
+    RemoteSummary fresh;
+    parseRemoteSummary(summaryBytes, fresh);
+    storeSummary(fresh);
     return true;
 }
 
@@ -450,58 +641,28 @@ bool OstreeRepoHelper::queryMatchRefs(const QString &repoPath,
         return false;
     }
 
-    const std::string pkgNameTmp = pkgName.toStdString();
-    QMap<QString, QString> outRefs;
-    bool ret = getRemoteRefs(repoPath, remoteName, outRefs, err);
-    if (ret) {
-        QString filterString = "(" + pkgName + "/)+";
-        QList<QString> keyRefs = outRefs.keys().filter(QRegExp(filterString, Qt::CaseSensitive));
-        // 版本号不为空，查找指定版本
-        if (!pkgVer.isEmpty()) {
-            for (QString ref : keyRefs) {
-                std::vector<std::string> result;
-                ret = resolveRef(ref.toStdString(), result);
-                // new ref format org.deepin.calculator/1.2.2/x86_64
-                if (ret && result[1] == pkgVer.toStdString() && result[2] == arch.toStdString()) {
-                    matchRef = ref;
-                    return true;
-                }
-            }
-        } else {
-            bool flag = false;
-            QString curVersion = linglong::util::APP_MIN_VERSION;
-            for (QString ref : keyRefs) {
-                std::vector<std::string> result;
-                ret = resolveRef(ref.toStdString(), result);
-                linglong::util::AppVersion curVer(curVersion);
-                // 玲珑适配
-                // new ref format org.deepin.calculator/1.2.2/x86_64
-                if (ret) {
-                    QString dstVersion = QString::fromStdString(result[1]);
-                    linglong::util::AppVersion dstVer(dstVersion);
-                    if (!dstVer.isValid()) {
-                        qInfo() << "queryMatchRefs ref:" << ref << " version is not valid";
-                        continue;
-                    }
-                    if (dstVer.isBigThan(curVer)) {
-                        curVersion = dstVersion;
-                        matchRef = ref;
-                        flag = true;
-                    }
-                }
-            }
-            if (flag) {
-                return true;
-            }
-        }
-        snprintf(info,
-                 MAX_ERRINFO_BUFSIZE,
-                 "%s, function:%s %s not found in remote repo",
-                 __FILE__,
-                 __func__,
-                 pkgNameTmp.c_str());
-        err = info;
+    RemoteSummary summary;
+    if (!updateRemoteSummary(repoPath, remoteName, summary, err)) {
+        return false;
+    }
+
+    // 版本号不为空查找指定版本，否则查找最新版本
+    repo::RemoteRefEntry entry;
+    bool found = pkgVer.isEmpty() ? summary.index.findLatest(pkgName, arch, "", entry)
+                                  : summary.index.findVersion(pkgName, pkgVer, arch, "", entry);
+    if (found) {
+        matchRef = entry.ref;
+        return true;
     }
+
+    const std::string pkgNameTmp = pkgName.toStdString();
+    snprintf(info,
+             MAX_ERRINFO_BUFSIZE,
+             "%s, function:%s %s not found in remote repo",
+             __FILE__,
+             __func__,
+             pkgNameTmp.c_str());
+    err = info;
     return false;
 }
 
@@ -520,175 +681,202 @@ bool OstreeRepoHelper::checkOutAppData(const QString &repoPath,
                                        const QString &remoteName,
                                        const QString &ref,
                                        const QString &dstPath,
+                                       GCancellable *cancellable,
                                        QString &err)
 {
-    // ostree --repo=repo checkout -U --union org.deepin.calculator/x86_64/1.2.2
-    // /persistent/linglong/layers/XXX
-    linglong::util::createDir(dstPath);
-    auto ret = linglong::runner::Runner(
-            "ostree",
-            { "--repo=" + repoPath + "/repo", "checkout", "-U", "--union", ref, dstPath },
-            1000 * 60 * 60 * 24);
-    if (!ret) {
-        err = "checkOutAppData " + ref + " err";
+    // 等价于 ostree --repo=repo checkout -U --union ref dstPath
+    if (!checkoutRefs(repoPath + "/repo", { ref }, "", dstPath, true, false, cancellable, err)) {
         qCritical() << "checkOutAppData err, repoPath:" << repoPath << ", remoteName:" << remoteName
-                    << ", dstPath:" << dstPath << ", ref:" << ref;
+                    << ", dstPath:" << dstPath << ", ref:" << ref << err;
         return false;
     }
     return true;
 }
 
+bool OstreeRepoHelper::checkoutRefs(const QString &repoPath,
+                                    const QStringList &refs,
+                                    const QString &subPath,
+                                    const QString &dstPath,
+                                    bool userMode,
+                                    bool forceCopy,
+                                    GCancellable *cancellable,
+                                    QString &err)
+{
+    g_autoptr(GError) gErr = nullptr;
+    g_autoptr(GFile) repoFile = g_file_new_for_path(repoPath.toStdString().c_str());
+    g_autoptr(OstreeRepo) repo = ostree_repo_new(repoFile);
+    if (!ostree_repo_open(repo, nullptr, &gErr)) {
+        err = "open repo " + repoPath + " failed: " + gErr->message;
+        return false;
+    }
+
+    linglong::util::createDir(dstPath);
+
+    // bare 以外的模式不保存真实属主，只能以当前用户身份签出
+    auto mode = userMode || ostree_repo_get_mode(repo) != OSTREE_REPO_MODE_BARE
+            ? OSTREE_REPO_CHECKOUT_MODE_USER
+            : OSTREE_REPO_CHECKOUT_MODE_NONE;
+    auto subPathStr = subPath.isEmpty() ? std::string("/") : subPath.toStdString();
+    auto dstPathStr = dstPath.toStdString();
+
+    for (const auto &ref : refs) {
+        g_autofree char *commit = nullptr;
+        auto refStr = ref.toStdString();
+        if (!ostree_repo_resolve_rev(repo, refStr.c_str(), false, &commit, &gErr)) {
+            err = "resolve " + ref + " failed: " + gErr->message;
+            return false;
+        }
+
+        // 未设置 force_copy 时 libostree 优先使用硬链接，无法硬链接时复制文件，复制时优先使用
+        // FICLONE
+        OstreeRepoCheckoutAtOptions options = {};
+        options.mode = mode;
+        options.overwrite_mode = OSTREE_REPO_CHECKOUT_OVERWRITE_UNION_FILES;
+        options.force_copy = forceCopy;
+        options.subpath = subPathStr.c_str();
+
+        if (!ostree_repo_checkout_at(repo,
+                                     &options,
+                                     AT_FDCWD,
+                                     dstPathStr.c_str(),
+                                     commit,
+                                     cancellable,
+                                     &gErr)) {
+            err = "checkout " + ref + " to " + dstPath + " failed: " + gErr->message;
+            return false;
+        }
+        qDebug() << "checkout" << ref << commit << "to" << dstPath;
+    }
+
+    return true;
+}
+
 /*
- * 通过父进程id查找子进程id
+ * 格式化为可展示的下载进度
  *
- * @param qint64: 父进程id
- *
- * @return qint64: 子进程id
+ * @return QString: 进度描述
  */
-qint64 OstreeRepoHelper::getChildPid(qint64 pid)
+QString PullProgress::toString() const
 {
-    QProcess process;
-    const QStringList argList = { "-P", QString::number(pid) };
-    process.start("pgrep", argList);
-    if (!process.waitForStarted()) {
-        qCritical() << "start pgrep failed!";
-        return 0;
-    }
-    if (!process.waitForFinished(1000 * 60)) {
-        qCritical() << "run pgrep finish failed!";
-        return 0;
-    }
-
-    auto retStatus = process.exitStatus();
-    auto retCode = process.exitCode();
-    QString childPid = "";
-    if (retStatus != 0 || retCode != 0) {
-        qCritical() << "run pgrep failed, retCode:" << retCode << ", args:" << argList
-                    << ", info msg:" << QString::fromLocal8Bit(process.readAllStandardOutput())
-                    << ", err msg:" << QString::fromLocal8Bit(process.readAllStandardError());
-        return 0;
-    } else {
-        childPid = QString::fromLocal8Bit(process.readAllStandardOutput());
-        qDebug() << "getChildPid ostree pid:" << childPid;
+    if (!status.isEmpty()) {
+        return status;
     }
 
-    return childPid.toLongLong();
+    g_autofree char *formattedBytes = g_format_size(bytesTransferred);
+    if (requested == 0) {
+        return QString("Receiving metadata objects: %1 %2")
+                .arg(scannedMetadata)
+                .arg(QLatin1String(formattedBytes));
+    }
+
+    guint64 elapsedSecs = 0;
+    if (startTime > 0) {
+        elapsedSecs = (g_get_monotonic_time() - startTime) / G_USEC_PER_SEC;
+    }
+    guint64 bytesSec = elapsedSecs > 0 ? bytesTransferred / elapsedSecs : 0;
+    g_autofree char *formattedBytesSec = g_format_size(bytesSec);
+
+    return QString("Receiving objects: %1% (%2/%3) %4/s %5")
+            .arg(static_cast<guint>(static_cast<double>(fetched) / requested * 100))
+            .arg(fetched)
+            .arg(requested)
+            .arg(QLatin1String(formattedBytesSec))
+            .arg(QLatin1String(formattedBytes));
 }
 
 /*
- * 启动一个ostree 命令相关的任务
+ * OstreeAsyncProgress 进度变化回调
  *
- * @param cmd: 需要运行的命令
- * @param ref: ostree软件包对应的ref
- * @param argList: 参数列表
- * @param timeout: 任务超时时间
- *
- * @return bool: true:成功 false:失败
+ * @param progress: ostree 下载进度对象
+ * @param userData: PullJob 对象
  */
-bool OstreeRepoHelper::startOstreeJob(const QString &cmd,
-                                      const QString &ref,
-                                      const QStringList &argList,
-                                      const int timeout)
+void OstreeRepoHelper::onPullProgressChanged(OstreeAsyncProgress *progress, gpointer userData)
 {
-    QProcess process;
-    process.start(cmd, argList);
-    if (!process.waitForStarted()) {
-        qCritical() << "start " + cmd + " failed!";
-        return false;
-    }
-
-    qint64 processId = process.processId();
-    // 通过script pid 查找对应的ostree pid
-    if ("script" == cmd) {
-        qint64 shPid = getChildPid(processId);
-        qint64 ostreePid = getChildPid(shPid);
-        jobMap.insert(ref, ostreePid); // FIXME(black_desk): ??? where is the lock???
+    auto job = static_cast<PullJob *>(userData);
+
+    PullProgress current;
+    g_autofree char *status = ostree_async_progress_get_status(progress);
+    current.status = QString::fromUtf8(status);
+    current.outstandingFetches = ostree_async_progress_get_uint(progress, "outstanding-fetches");
+    current.outstandingWrites = ostree_async_progress_get_uint(progress, "outstanding-writes");
+    current.fetched = ostree_async_progress_get_uint(progress, "fetched");
+    current.requested = ostree_async_progress_get_uint(progress, "requested");
+    current.scannedMetadata = ostree_async_progress_get_uint(progress, "scanned-metadata");
+    current.bytesTransferred = ostree_async_progress_get_uint64(progress, "bytes-transferred");
+    current.bytesTotal = ostree_async_progress_get_uint64(progress, "total-delta-part-size");
+    current.startTime = ostree_async_progress_get_uint64(progress, "start-time");
+
+    for (const auto &ref : job->refs) {
+        job->helper->updatePullProgress(ref, current);
     }
-    if (!process.waitForFinished(timeout)) {
-        qCritical() << "run " + cmd + " finish failed!";
-        return false;
+    if (job->onProgress) {
+        job->onProgress(current);
     }
-    if ("script" == cmd) {
-        jobMap.remove(ref);
+}
+
+/*
+ * 更新下载任务进度
+ *
+ * @param ref: 软件包对应的仓库索引ref
+ * @param progress: 下载进度
+ */
+void OstreeRepoHelper::updatePullProgress(const QString &ref, const PullProgress &progress)
+{
+    QMutexLocker locker(&pullMutex);
+    if (pullProgressMap.contains(ref)) {
+        pullProgressMap[ref] = progress;
     }
+}
 
-    auto retStatus = process.exitStatus();
-    auto retCode = process.exitCode();
-    if (retStatus != 0 || retCode != 0) {
-        qCritical() << "run " + cmd + " failed, retCode:" << retCode << ", args:" << argList
-                    << ", info msg:" << QString::fromLocal8Bit(process.readAllStandardOutput())
-                    << ", err msg:" << QString::fromLocal8Bit(process.readAllStandardError());
+/*
+ * 查询正在进行的下载任务进度
+ *
+ * @param ref: 软件包对应的仓库索引ref
+ * @param progress: 下载进度
+ *
+ * @return bool: true:任务存在 false:任务不存在
+ */
+bool OstreeRepoHelper::getPullProgress(const QString &ref, PullProgress &progress)
+{
+    QMutexLocker locker(&pullMutex);
+    if (!pullProgressMap.contains(ref)) {
         return false;
     }
+    progress = pullProgressMap.value(ref);
     return true;
 }
 
 /*
- * 在玲珑应用安装目录创建一个临时repo子仓库
+ * 取消正在进行的下载任务，ref 不完全匹配时按子串查找
  *
- * @param parentRepo: 父repo仓库路径
+ * @param ref: 软件包对应的仓库索引ref
  *
- * @return QString: 临时repo路径
+ * @return bool: true:成功 false:任务不存在
  */
-QString OstreeRepoHelper::createTmpRepo(const QString &parentRepo)
+bool OstreeRepoHelper::cancelPull(const QString &ref)
 {
-    QString baseDir = linglong::util::getLinglongRootPath() + "/.cache";
-    linglong::util::createDir(baseDir);
-    QTemporaryDir dir(baseDir + "/linglong-cache-XXXXXX");
-    QString tmpPath;
-    if (dir.isValid()) {
-        tmpPath = dir.path();
+    QMutexLocker locker(&pullMutex);
+    QString matchRef;
+    if (pullCancellableMap.contains(ref)) {
+        matchRef = ref;
     } else {
-        qCritical() << "create tmpPath failed, please check " << baseDir << ","
-                    << dir.errorString();
-        return QString();
-    }
-    dir.setAutoRemove(false);
-    auto ret = linglong::runner::Runner(
-            "ostree",
-            { "--repo=" + tmpPath + "/repoTmp", "init", "--mode=bare-user-only" },
-            1000 * 60 * 5);
-    if (!ret) {
-        return QString();
-    }
-
-    // 设置最小空间要求
-    ret = linglong::runner::Runner("ostree",
-                                   { "config",
-                                     "set",
-                                     "--group",
-                                     "core",
-                                     "min-free-space-size",
-                                     "600MB",
-                                     "--repo",
-                                     tmpPath + "/repoTmp" },
-                                   1000 * 60 * 5);
-    if (!ret) {
-        return QString();
-    }
-
-    // 添加父仓库路径
-    ret = linglong::runner::Runner("ostree",
-                                   { "config",
-                                     "set",
-                                     "--group",
-                                     "core",
-                                     "parent",
-                                     parentRepo,
-                                     "--repo",
-                                     tmpPath + "/repoTmp" },
-                                   1000 * 60 * 5);
-    if (!ret) {
-        return QString();
+        for (const auto &item : pullCancellableMap.keys()) {
+            if (item.indexOf(ref) > -1) {
+                matchRef = item;
+                break;
+            }
+        }
     }
-
-    qInfo() << "create tmp repo path:" << tmpPath
-            << ", ret:" << QDir().exists(tmpPath + "/repoTmp");
-    return tmpPath + "/repoTmp";
+    if (matchRef.isEmpty()) {
+        return false;
+    }
+    qInfo() << "cancel pull:" << matchRef;
+    g_cancellable_cancel(pullCancellableMap.value(matchRef));
+    return true;
 }
 
 /*
- * 通过ostree命令将软件包数据从远端仓库pull到本地
+ * 通过 libostree 将软件包数据从远端仓库直接 pull 到本地仓库
  *
  * @param destPath: 仓库路径
  * @param remoteName: 远端仓库名称
@@ -702,69 +890,149 @@ bool OstreeRepoHelper::repoPullbyCmd(const QString &destPath,
                                      const QString &ref,
                                      QString &err)
 {
-    // 创建临时仓库
-    QString tmpPath = createTmpRepo(destPath + "/repo");
-    if (tmpPath.isEmpty()) {
-        err = "create tmp repo err";
-        qCritical() << err;
-        return false;
+    return repoPullRefs(destPath, remoteName, { ref }, {}, nullptr, nullptr, err);
+}
+
+/*
+ * 在同一次 pull 中将多个软件包数据从远端仓库下载到本地仓库
+ *
+ * @param destPath: 仓库路径
+ * @param remoteName: 远端仓库名称
+ * @param refs: 软件包对应的仓库索引ref列表
+ * @param baseRefs: 增量下载的起点(key:待下载的ref, value:本地已有的旧版本ref)
+ * @param onProgress: 下载进度回调，可为空
+ * @param err: 错误信息
+ *
+ * @return bool: true:成功 false:失败
+ */
+bool OstreeRepoHelper::repoPullRefs(const QString &destPath,
+                                    const QString &remoteName,
+                                    const QStringList &refs,
+                                    const QMap<QString, QString> &baseRefs,
+                                    const PullProgressHandler &onProgress,
+                                    GCancellable *cancellable,
+                                    QString &err)
+{
+    if (refs.isEmpty()) {
+        return true;
     }
 
-    // 将数据pull到临时仓库
-    // ostree --repo=/var/tmp/linglong-cache-I80JB1/repoTmp pull --mirror
-    // repo:app/org.deepin.calculator/x86_64/1.2.2
-    const QString fullref = remoteName + ":" + ref;
-    // auto ret = Runner("ostree", {"--repo=" + QString(QLatin1String(tmpPath)), "pull", "--mirror",
-    // fullref}, 1000 * 60
-    // * 60 * 24);
-    // auto ret = startOstreeJob(ref, {"--repo=" + tmpPath, "pull", "--mirror", fullref},
-    //                           1000 * 60 * 60 * 24);
-    // script -q -f ostree.log -c "ostree --repo=/deepin/linglong/repo/repo pull --mirror
-    // repo:com.qq.weixin.work.deepin/4.0.0.6007/x86_64"
-    QString logPath = QString("/tmp/.linglong");
-    linglong::util::createDir(logPath);
-
-    // add for ll-test
-    QFile file(logPath);
-    QFile::Permissions permissions = file.permissions();
-    permissions |= QFile::WriteOther;
-    file.setPermissions(permissions);
-
-    QString logName = ref.split("/").join("-");
-    QString ostreeCmd = "ostree --repo=" + tmpPath + " pull --mirror " + fullref;
-    auto ret = startOstreeJob("script",
-                              ref,
-                              { "-q", "-f", logPath + "/" + logName, "-c", ostreeCmd },
-                              1000 * 60 * 60 * 24);
-    if (!ret) {
-        err = "repoPullbyCmd pull error";
+    // OstreeRepo 同一时刻只允许一个事务，每个下载任务单独打开仓库，数据仍写入同一个目录
+    const QString repoPath = destPath + "/repo";
+    g_autoptr(GFile) repoDir = g_file_new_for_path(repoPath.toStdString().c_str());
+    g_autoptr(OstreeRepo) repo = ostree_repo_new(repoDir);
+    g_autoptr(GError) error = NULL;
+    if (!ostree_repo_open(repo, NULL, &error)) {
+        err = "repoPullRefs open repo " + repoPath + " error:" + QString(error->message);
         qCritical() << err;
         return false;
     }
-    qInfo() << "repoPullbyCmd pull success";
-    // ostree --repo=test-repo(目标)  pull-local /home/linglong/work/linglong/pool/repo(源)
-    // 将数据从临时仓库同步到目标仓库
-    // ret = Runner("ostree", {"--repo=" + destPath + "/repo", "pull-local",
-    // QString(QLatin1String(tmpPath)), ref}, 1000
-    // * 60 * 60);
-    ret = startOstreeJob("ostree",
-                         ref,
-                         { "--repo=" + destPath + "/repo", "pull-local", tmpPath, ref },
-                         1000 * 60 * 60);
-
-    // 删除下载进度的重定向文件
-    QString filePath = "/tmp/.linglong/" + logName;
-    QFile(filePath).remove();
-
-    // 删除临时仓库
-    QString tmpRepoDir = tmpPath.left(tmpPath.length() - QString("/repoTmp").length());
-    qInfo() << "delete tmp repo path:" << tmpRepoDir;
-    linglong::util::removeDir(tmpRepoDir);
+
+    // 下载期间后台 prune 不能执行
+    QReadLocker objectLocker(&repoObjectLock);
+
+    // 同一 ref 可能被多个任务同时下载(如共享的runtime)，进度只登记在首个任务上
+    g_autoptr(GCancellable) pullCancellable =
+            cancellable != nullptr ? G_CANCELLABLE(g_object_ref(cancellable)) : g_cancellable_new();
+    PullJob job{ this, {}, onProgress };
+    {
+        QMutexLocker locker(&pullMutex);
+        for (const auto &ref : refs) {
+            if (pullProgressMap.contains(ref)) {
+                continue;
+            }
+            pullProgressMap.insert(ref, PullProgress());
+            pullCancellableMap.insert(ref, pullCancellable);
+            job.refs.append(ref);
+        }
+    }
+
+    // libostree 以本地同名 ref 的 commit 作为 static delta 的起点，新版本 ref 先指向旧版本 commit，
+    // 服务端没有对应 delta 时退化为对象级下载，旧版本已有的对象同样不会重复下载
+    QMap<QString, QString> seededRefs;
+    for (auto iter = baseRefs.constBegin(); iter != baseRefs.constEnd(); ++iter) {
+        g_autofree char *commit = NULL;
+        g_autofree char *baseCommit = NULL;
+        auto ref = iter.key().toStdString();
+        auto baseRef = iter.value().toStdString();
+        if (!ostree_repo_resolve_rev(repo, ref.c_str(), TRUE, &commit, NULL) || commit != NULL
+            || !ostree_repo_resolve_rev(repo, baseRef.c_str(), TRUE, &baseCommit, NULL)
+            || baseCommit == NULL) {
+            continue;
+        }
+
+        g_autoptr(GError) seedError = NULL;
+        if (!ostree_repo_set_ref_immediate(repo, NULL, ref.c_str(), baseCommit, NULL, &seedError)) {
+            qWarning() << "repoPullRefs seed" << iter.key() << "error:" << seedError->message;
+            continue;
+        }
+        seededRefs.insert(iter.key(), QString::fromUtf8(baseCommit));
+        qInfo() << "repoPullRefs pull" << iter.key() << "from" << iter.value() << baseCommit;
+    }
+
+    // ostree 在调用线程默认的 main context 中派发进度回调，为当前线程单独创建一个
+    g_autoptr(GMainContext) mainContext = g_main_context_new();
+    g_main_context_push_thread_default(mainContext);
+
+    g_autoptr(OstreeAsyncProgress) progress =
+            ostree_async_progress_new_and_connect(onPullProgressChanged, &job);
+
+    // mirror 模式将 ref 写入 refs/heads，后续 checkout 及删除均使用不带远端前缀的 ref
+    std::vector<std::string> refList;
+    for (const auto &ref : refs) {
+        refList.push_back(ref.toStdString());
+    }
+    std::vector<const char *> refArray;
+    for (const auto &ref : refList) {
+        refArray.push_back(ref.c_str());
+    }
+    refArray.push_back(nullptr);
+
+    g_autoptr(GVariantBuilder) builder = g_variant_builder_new(G_VARIANT_TYPE("a{sv}"));
+    g_variant_builder_add(builder,
+                          "{s@v}",
+                          "refs",
+                          g_variant_new_variant(g_variant_new_strv(refArray.data(), -1)));
+    g_variant_builder_add(builder,
+                          "{s@v}",
+                          "flags",
+                          g_variant_new_variant(g_variant_new_int32(OSTREE_REPO_PULL_FLAGS_MIRROR)));
+    g_autoptr(GVariant) options = g_variant_ref_sink(g_variant_builder_end(builder));
+
+    qInfo() << "repoPullRefs pull" << refs << "from" << remoteName << "to" << repoPath;
+    bool ret = ostree_repo_pull_with_options(repo,
+                                             remoteName.toStdString().c_str(),
+                                             options,
+                                             progress,
+                                             pullCancellable,
+                                             &error);
+    ostree_async_progress_finish(progress);
+    g_main_context_pop_thread_default(mainContext);
+
+    {
+        QMutexLocker locker(&pullMutex);
+        for (const auto &ref : job.refs) {
+            pullProgressMap.remove(ref);
+            pullCancellableMap.remove(ref);
+        }
+    }
+
     if (!ret) {
-        err = "repoPullbyCmd pull-local error";
+        // 下载失败时还原预置的 ref，避免签出时误用旧版本数据
+        for (auto iter = seededRefs.constBegin(); iter != seededRefs.constEnd(); ++iter) {
+            g_autofree char *commit = NULL;
+            auto ref = iter.key().toStdString();
+            if (ostree_repo_resolve_rev(repo, ref.c_str(), TRUE, &commit, NULL)
+                && iter.value() == QLatin1String(commit)) {
+                ostree_repo_set_ref_immediate(repo, NULL, ref.c_str(), NULL, NULL, NULL);
+            }
+        }
+        err = "repoPullRefs pull error:" + QString(error->message);
         qCritical() << err;
+        return false;
     }
-    return ret;
+    qInfo() << "repoPullRefs pull success";
+    return true;
 }
 
 /*
@@ -804,29 +1072,8 @@ bool OstreeRepoHelper::repoDeleteDatabyRef(const QString &repoPath,
     }
     qInfo() << "repoDeleteDatabyRef delete " << refTmp.c_str() << " success";
 
-    gint objectsTotal;
-    gint objectsPruned;
-    guint64 objsizeTotal;
-    g_autofree char *formattedFreedSize = NULL;
-    if (!ostree_repo_prune(pLingLongDir->repo,
-                           OSTREE_REPO_PRUNE_FLAGS_REFS_ONLY,
-                           0,
-                           &objectsTotal,
-                           &objectsPruned,
-                           &objsizeTotal,
-                           cancellable,
-                           &error)) {
-        qCritical() << "repoDeleteDatabyRef pruning repo failed:" << error->message;
-        return false;
-    }
-
-    formattedFreedSize = g_format_size_full(objsizeTotal, (GFormatSizeFlags)0);
-    qInfo() << "repoDeleteDatabyRef Total objects:" << objectsTotal;
-    if (objectsPruned == 0) {
-        qInfo() << "repoDeleteDatabyRef No unreachable objects";
-    } else {
-        qInfo() << "Deleted " << objectsPruned << " objects," << formattedFreedSize << " freed";
-    }
+    // prune 需要遍历仓库中所有可达对象，耗时与仓库大小相关，放到后台合并执行
+    schedulePrune();
 
     // const QString fullref = remoteName + ":" + ref;
     // auto ret = Runner("ostree", {"--repo=" + repoPath + "/repo", "refs", "--delete", ref}, 1000 *
@@ -844,4 +1091,98 @@ bool OstreeRepoHelper::repoDeleteDatabyRef(const QString &repoPath,
     // qInfo() << "repoDeleteDatabyRef delete " << ref << " success";
     return true;
 }
+
+void OstreeRepoHelper::schedulePrune()
+{
+    QMutexLocker locker(&pruneMutex);
+    ++pendingPrunes;
+    lastDeleted.start();
+    if (!pruneThread.joinable()) {
+        pruneCancellable = g_cancellable_new();
+        pruneThread = std::thread(&OstreeRepoHelper::pruneLoop, this);
+    }
+    pruneCondition.wakeAll();
+}
+
+bool OstreeRepoHelper::repoPrune(QString &err)
+{
+    QWriteLocker objectLocker(&repoObjectLock);
+    {
+        QMutexLocker locker(&pruneMutex);
+        pendingPrunes = 0;
+    }
+    return doPrune(err);
+}
+
+void OstreeRepoHelper::pruneLoop()
+{
+    setIdleIOPriority();
+
+    QMutexLocker locker(&pruneMutex);
+    while (!pruneStopping) {
+        if (pendingPrunes == 0) {
+            pruneCondition.wait(&pruneMutex);
+            continue;
+        }
+
+        qint64 waitMs = kPruneDelayMs - lastDeleted.elapsed();
+        if (lastPruned.isValid()) {
+            waitMs = qMax(waitMs, kPruneMinIntervalMs - lastPruned.elapsed());
+        }
+        if (waitMs > 0) {
+            pruneCondition.wait(&pruneMutex, static_cast<unsigned long>(waitMs));
+            continue;
+        }
+
+        // 有下载任务时推迟，避免删除尚未被 ref 引用的新对象
+        if (!repoObjectLock.tryLockForWrite()) {
+            pruneCondition.wait(&pruneMutex, static_cast<unsigned long>(kPruneRetryMs));
+            continue;
+        }
+        const int batched = pendingPrunes;
+        pendingPrunes = 0;
+        locker.unlock();
+
+        qInfo() << "prune repo for" << batched << "deleted refs";
+        QString err;
+        bool ret = doPrune(err);
+        repoObjectLock.unlock();
+
+        locker.relock();
+        lastPruned.start();
+        if (!ret) {
+            qWarning() << err;
+            // 失败的请求在下一个间隔后重试
+            pendingPrunes += batched;
+        }
+    }
+}
+
+bool OstreeRepoHelper::doPrune(QString &err)
+{
+    gint objectsTotal = 0;
+    gint objectsPruned = 0;
+    guint64 objsizeTotal = 0;
+    g_autoptr(GError) error = NULL;
+    if (!ostree_repo_prune(pLingLongDir->repo,
+                           OSTREE_REPO_PRUNE_FLAGS_REFS_ONLY,
+                           0,
+                           &objectsTotal,
+                           &objectsPruned,
+                           &objsizeTotal,
+                           pruneCancellable,
+                           &error)) {
+        err = "pruning repo failed:" + QString(QLatin1String(error->message));
+        return false;
+    }
+
+    g_autofree char *formattedFreedSize = g_format_size_full(objsizeTotal, G_FORMAT_SIZE_DEFAULT);
+    qInfo() << "prune repo Total objects:" << objectsTotal;
+    if (objectsPruned == 0) {
+        qInfo() << "prune repo No unreachable objects";
+    } else {
+        qInfo() << "Deleted " << objectsPruned << " objects," << formattedFreedSize << " freed";
+    }
+    return true;
+}
 } // namespace linglong
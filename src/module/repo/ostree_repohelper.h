@@ -7,6 +7,7 @@
 #ifndef LINGLONG_SRC_MODULE_REPO_OSTREE_REPOHELPER_H_
 #define LINGLONG_SRC_MODULE_REPO_OSTREE_REPOHELPER_H_
 
+#include "module/repo/remote_ref_index.h"
 #include "module/util/singleton.h"
 #include "repohelper.h"
 
@@ -15,14 +16,21 @@
 #include <ostree-repo.h>
 
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QMap>
+#include <QMutex>
+#include <QReadWriteLock>
 #include <QString>
+#include <QStringList>
 #include <QTemporaryDir>
 #include <QVector>
+#include <QWaitCondition>
 
+#include <functional>
 #include <iostream>
 #include <map>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace linglong {
@@ -34,6 +42,30 @@ struct LingLongDir
     OstreeRepo *repo;
 };
 
+// 软件包下载进度信息，由 OstreeAsyncProgress 回调更新
+struct PullProgress
+{
+    QString status;               // ostree 上报的状态描述，非空时优先展示
+    guint outstandingFetches = 0; // 正在下载的对象数
+    guint outstandingWrites = 0;  // 等待写入的对象数
+    guint fetched = 0;            // 已下载的对象数
+    guint requested = 0;          // 需要下载的对象总数
+    guint scannedMetadata = 0;    // 已扫描的元数据对象数
+    guint64 bytesTransferred = 0; // 已下载字节数
+    guint64 bytesTotal = 0;       // 需要下载的字节数，仅使用 static delta 时可知
+    guint64 startTime = 0;        // 下载开始时间(单调时钟，单位微秒)
+
+    /*
+     * 格式化为可展示的下载进度
+     *
+     * @return QString: 进度描述，如 "Receiving objects: 45% (90/200) 1.2 MB/s 3.4 MB"
+     */
+    QString toString() const;
+};
+
+// 下载进度回调，在下载线程中调用
+typedef std::function<void(const PullProgress &progress)> PullProgressHandler;
+
 class OstreeRepoHelper : public RepoHelper, public linglong::util::Singleton<OstreeRepoHelper>
 {
 public:
@@ -124,6 +156,7 @@ public:
      * @param remoteName: 远端仓库名称
      * @param ref: 软件包对应的仓库索引
      * @param dstPath: 签出数据保存目录
+     * @param cancellable: 取消签出的 GCancellable 对象，可为空
      * @param err: 错误信息
      *
      * @return bool: true:成功 false:失败
@@ -132,10 +165,35 @@ public:
                          const QString &remoteName,
                          const QString &ref,
                          const QString &dstPath,
+                         GCancellable *cancellable,
                          QString &err);
 
     /*
-     * 通过ostree命令将软件包数据从远端仓库pull到本地
+     * 在进程内将多个 ref 依次合并签出到同一目录，同名文件以后签出的为准
+     * 仓库模式允许时使用硬链接，否则复制文件，文件系统支持时复制使用 reflink
+     *
+     * @param repoPath: ostree 仓库路径
+     * @param refs: 软件包对应的仓库索引ref列表
+     * @param subPath: 签出的子路径，为空时签出全部数据
+     * @param dstPath: 签出数据保存目录
+     * @param userMode: 是否忽略文件属主，以当前用户身份签出
+     * @param forceCopy: 是否禁止硬链接，签出的文件会被修改时使用
+     * @param cancellable: 取消签出的 GCancellable 对象，可为空
+     * @param err: 错误信息
+     *
+     * @return bool: true:成功 false:失败
+     */
+    bool checkoutRefs(const QString &repoPath,
+                      const QStringList &refs,
+                      const QString &subPath,
+                      const QString &dstPath,
+                      bool userMode,
+                      bool forceCopy,
+                      GCancellable *cancellable,
+                      QString &err);
+
+    /*
+     * 通过 libostree 将软件包数据从远端仓库直接 pull 到本地仓库，下载进度可通过 getPullProgress 查询
      *
      * @param destPath: 仓库路径
      * @param remoteName: 远端仓库名称
@@ -150,25 +208,46 @@ public:
                        QString &err) override;
 
     /*
-     * 获取下载任务对应的进程Id
+     * 在同一次 pull 中将多个软件包数据从远端仓库下载到本地仓库，共享的对象只下载一次
+     * 指定了旧版本的 ref 以旧版本 commit 为起点增量下载，服务端提供 static delta 时使用 delta，
+     * 否则只下载本地缺少的对象
      *
-     * @param ref: ostree软件包对应的ref
+     * @param destPath: 仓库路径
+     * @param remoteName: 远端仓库名称
+     * @param refs: 软件包对应的仓库索引ref列表
+     * @param baseRefs: 增量下载的起点(key:待下载的ref, value:本地已有的旧版本ref)
+     * @param onProgress: 下载进度回调，可为空
+     * @param cancellable: 取消下载的 GCancellable 对象，为空时可通过 cancelPull 取消
+     * @param err: 错误信息
      *
-     * @return int: ostree命令任务对应的进程id
+     * @return bool: true:成功 false:失败
      */
-    int getOstreeJobId(const QString &ref)
-    {
-        if (jobMap.contains(ref)) {
-            return jobMap[ref];
-        } else {
-            for (auto item : jobMap.keys()) {
-                if (item.indexOf(ref) > -1) {
-                    return jobMap[item];
-                }
-            }
-        }
-        return -1;
-    }
+    bool repoPullRefs(const QString &destPath,
+                      const QString &remoteName,
+                      const QStringList &refs,
+                      const QMap<QString, QString> &baseRefs,
+                      const PullProgressHandler &onProgress,
+                      GCancellable *cancellable,
+                      QString &err);
+
+    /*
+     * 查询正在进行的下载任务进度
+     *
+     * @param ref: 软件包对应的仓库索引ref
+     * @param progress: 下载进度
+     *
+     * @return bool: true:任务存在 false:任务不存在
+     */
+    bool getPullProgress(const QString &ref, PullProgress &progress);
+
+    /*
+     * 取消正在进行的下载任务，ref 不完全匹配时按子串查找
+     *
+     * @param ref: 软件包对应的仓库索引ref
+     *
+     * @return bool: true:成功 false:任务不存在
+     */
+    bool cancelPull(const QString &ref);
 
     /*
      * 获取正在下载的任务列表
@@ -177,14 +256,12 @@ public:
      */
     QStringList getOstreeJobList()
     {
-        if (jobMap.isEmpty()) {
-            return {};
-        }
-        return jobMap.keys();
+        QMutexLocker locker(&pullMutex);
+        return pullProgressMap.keys();
     }
 
     /*
-     * 删除本地repo仓库中软件包对应的ref分支信息及数据
+     * 删除本地repo仓库中软件包对应的ref分支信息，不再被引用的数据由后台清理
      *
      * @param repoPath: 仓库路径
      * @param remoteName: 远端仓库名称
@@ -198,9 +275,46 @@ public:
                              const QString &ref,
                              QString &err);
 
+    /*
+     * 登记一次清理请求，短时间内的多次请求在后台合并为一次 prune
+     */
+    void schedulePrune();
+
+    /*
+     * 在调用线程中立即清理本地仓库中不再被引用的数据，用于进程即将退出的场景
+     *
+     * @param err: 错误信息
+     *
+     * @return bool: true:成功 false:失败
+     */
+    bool repoPrune(QString &err);
+
 private:
-    // multi-thread
-    QMap<QString, int> jobMap;
+    // 下载任务回调上下文
+    struct PullJob
+    {
+        OstreeRepoHelper *helper;
+        QStringList refs;
+        PullProgressHandler onProgress;
+    };
+
+    // 远端仓库 summary 缓存
+    struct RemoteSummary
+    {
+        QString etag;                // 服务端返回的 ETag
+        QString lastModified;        // 服务端返回的 Last-Modified
+        QMap<QString, QString> refs; // ref 与 commit 的对应关系
+        repo::RemoteRefIndex index;  // 按 appId 分组、按版本排序的 ref 索引
+    };
+
+    // 保护 summary 缓存，key 为远端仓库名称
+    QMutex summaryMutex;
+    QMap<QString, RemoteSummary> summaryMap;
+
+    // 保护下载任务进度及取消对象
+    QMutex pullMutex;
+    QMap<QString, PullProgress> pullProgressMap;
+    QMap<QString, GCancellable *> pullCancellableMap;
 
     // lint 禁止拷贝
     OstreeRepoHelper(const OstreeRepoHelper &);
@@ -227,39 +341,44 @@ private:
                             GError **error);
 
     /*
-     * 从ostree仓库描述文件Summary信息中获取仓库所有软件包索引refs
+     * 更新远端仓库 summary 缓存，服务端支持时使用 ETag/If-Modified-Since 条件请求，summary
+     * 未变化时不重复下载和解析
      *
-     * @param summary: 远端仓库Summary信息
-     * @param outRefs: 远端仓库软件包索引信息
+     * @param repoPath: 远端仓库对应的本地仓库路径
+     * @param remoteName: 远端仓库名称
+     * @param summary: 更新后的 summary 缓存
+     * @param err: 错误信息
+     *
+     * @return bool: true:成功 false:失败
      */
-    void getPkgRefsBySummary(GVariant *summary, std::map<std::string, std::string> &outRefs);
+    bool updateRemoteSummary(const QString &repoPath,
+                             const QString &remoteName,
+                             RemoteSummary &summary,
+                             QString &err);
 
     /*
-     * 从summary中的refMap中获取仓库所有软件包索引refs
+     * 解析 summary 数据并建立 ref 索引
      *
-     * @param ref_map: summary信息中解析出的ref map信息
-     * @param outRefs: 仓库软件包索引信息
+     * @param data: summary 数据
+     * @param summary: 解析结果
      */
-    void getPkgRefsFromRefsMap(GVariant *ref_map, std::map<std::string, std::string> &outRefs);
+    void parseRemoteSummary(GBytes *data, RemoteSummary &summary);
 
     /*
-     * 按照指定字符分割字符串
+     * 从ostree仓库描述文件Summary信息中获取仓库所有软件包索引refs
      *
-     * @param str: 目标字符串
-     * @param separator: 分割字符串
-     * @param result: 分割结果
+     * @param summary: 远端仓库Summary信息
+     * @param outRefs: 远端仓库软件包索引信息
      */
-    void splitStr(std::string str, std::string separator, std::vector<std::string> &result);
+    void getPkgRefsBySummary(GVariant *summary, std::map<std::string, std::string> &outRefs);
 
     /*
-     * 解析仓库软件包索引ref信息
-     *
-     * @param fullRef: 目标软件包索引ref信息
-     * @param result: 解析结果
+     * 从summary中的refMap中获取仓库所有软件包索引refs
      *
-     * @return bool: true:成功 false:失败
+     * @param ref_map: summary信息中解析出的ref map信息
+     * @param outRefs: 仓库软件包索引信息
      */
-    bool resolveRef(const std::string &fullRef, std::vector<std::string> &result);
+    void getPkgRefsFromRefsMap(GVariant *ref_map, std::map<std::string, std::string> &outRefs);
 
     /*
      * 保存本地仓库信息
@@ -271,37 +390,47 @@ private:
     void setDirInfo(const QString &basedir, OstreeRepo *repo);
 
     /*
-     * 启动一个ostree 命令任务
-     *
-     * @param cmd: 需要运行的命令
-     * @param ref: ostree软件包对应的ref
-     * @param argList: 参数列表
-     * @param timeout: 任务超时时间
+     * OstreeAsyncProgress 进度变化回调
      *
-     * @return bool: true:成功 false:失败
+     * @param progress: ostree 下载进度对象
+     * @param userData: PullJob 对象
      */
-    bool startOstreeJob(const QString &cmd,
-                        const QString &ref,
-                        const QStringList &argList,
-                        const int timeout);
+    static void onPullProgressChanged(OstreeAsyncProgress *progress, gpointer userData);
 
     /*
-     * 在/tmp目录下创建一个临时repo子仓库
+     * 更新下载任务进度
      *
-     * @param parentRepo: 父repo仓库路径
-     *
-     * @return QString: 临时repo路径
+     * @param ref: 软件包对应的仓库索引ref
+     * @param progress: 下载进度
      */
-    QString createTmpRepo(const QString &parentRepo);
+    void updatePullProgress(const QString &ref, const PullProgress &progress);
 
     /*
-     * 通过父进程id查找子进程id
+     * 后台清理线程，等待删除请求稳定且距上次清理超过最小间隔后执行 prune
+     */
+    void pruneLoop();
+
+    /*
+     * 执行 prune，调用者需持有 repoObjectLock 写锁
      *
-     * @param qint64: 父进程id
+     * @param err: 错误信息
      *
-     * @return qint64: 子进程id
+     * @return bool: true:成功 false:失败
      */
-    qint64 getChildPid(qint64 pid);
+    bool doPrune(QString &err);
+
+    // 下载写入的对象在 ref 更新前不被引用，下载持有读锁，prune 持有写锁
+    QReadWriteLock repoObjectLock;
+
+    // 保护后台清理状态
+    QMutex pruneMutex;
+    QWaitCondition pruneCondition;
+    int pendingPrunes = 0;
+    bool pruneStopping = false;
+    QElapsedTimer lastDeleted;
+    QElapsedTimer lastPruned;
+    std::thread pruneThread;
+    GCancellable *pruneCancellable = nullptr;
 
 private:
     // ostree 仓库对象信息
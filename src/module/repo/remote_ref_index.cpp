@@ -0,0 +1,129 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "remote_ref_index.h"
+
+#include "module/util/version/version.h"
+
+#include <QStringList>
+
+#include <algorithm>
+
+namespace linglong {
+namespace repo {
+
+namespace {
+
+// 按版本号比较，版本号相同时按版本字符串比较，保证排序结果稳定
+bool versionLessThan(const QString &left, const QString &right)
+{
+    util::AppVersion leftVersion(left);
+    util::AppVersion rightVersion(right);
+    if (rightVersion.isBigThan(leftVersion)) {
+        return true;
+    }
+    if (leftVersion.isBigThan(rightVersion)) {
+        return false;
+    }
+    return left < right;
+}
+
+bool entryLessThan(const RemoteRefEntry &left, const RemoteRefEntry &right)
+{
+    return versionLessThan(left.version, right.version);
+}
+
+bool matchEntry(const RemoteRefEntry &entry, const QString &arch, const QString &module)
+{
+    return (arch.isEmpty() || entry.arch == arch) && (module.isEmpty() || entry.module == module);
+}
+
+} // namespace
+
+void RemoteRefIndex::build(const QMap<QString, QString> &refs)
+{
+    index.clear();
+
+    for (auto it = refs.constBegin(); it != refs.constEnd(); ++it) {
+        auto parts = it.key().split("/", QString::SkipEmptyParts);
+        RemoteRefEntry entry;
+        QString appId;
+        if (parts.size() == 3) {
+            // {appId}/{version}/{arch}
+            appId = parts.at(0);
+            entry.version = parts.at(1);
+            entry.arch = parts.at(2);
+        } else if (parts.size() == 5) {
+            // {channel}/{appId}/{version}/{arch}/{module}
+            entry.channel = parts.at(0);
+            appId = parts.at(1);
+            entry.version = parts.at(2);
+            entry.arch = parts.at(3);
+            entry.module = parts.at(4);
+        } else {
+            continue;
+        }
+        entry.ref = it.key();
+        entry.checksum = it.value();
+        index[appId].push_back(entry);
+    }
+
+    for (auto it = index.begin(); it != index.end(); ++it) {
+        std::stable_sort(it.value().begin(), it.value().end(), entryLessThan);
+    }
+}
+
+bool RemoteRefIndex::findVersion(const QString &appId,
+                                 const QString &version,
+                                 const QString &arch,
+                                 const QString &module,
+                                 RemoteRefEntry &entry) const
+{
+    auto it = index.constFind(appId);
+    if (it == index.constEnd()) {
+        return false;
+    }
+
+    const auto &entries = it.value();
+    RemoteRefEntry key;
+    key.version = version;
+    auto range = std::equal_range(entries.constBegin(), entries.constEnd(), key, entryLessThan);
+    for (auto iter = range.first; iter != range.second; ++iter) {
+        if (matchEntry(*iter, arch, module)) {
+            entry = *iter;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool RemoteRefIndex::findLatest(const QString &appId,
+                                const QString &arch,
+                                const QString &module,
+                                RemoteRefEntry &entry) const
+{
+    auto it = index.constFind(appId);
+    if (it == index.constEnd()) {
+        return false;
+    }
+
+    const auto &entries = it.value();
+    for (auto iter = entries.crbegin(); iter != entries.crend(); ++iter) {
+        if (matchEntry(*iter, arch, module)) {
+            entry = *iter;
+            return true;
+        }
+    }
+    return false;
+}
+
+QVector<RemoteRefEntry> RemoteRefIndex::entries(const QString &appId) const
+{
+    return index.value(appId);
+}
+
+} // namespace repo
+} // namespace linglong
@@ -0,0 +1,93 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_SRC_MODULE_REPO_REMOTE_REF_INDEX_H_
+#define LINGLONG_SRC_MODULE_REPO_REMOTE_REF_INDEX_H_
+
+#include <QHash>
+#include <QMap>
+#include <QString>
+#include <QVector>
+
+namespace linglong {
+namespace repo {
+
+// 远端仓库中一个软件包 ref 的解析结果
+struct RemoteRefEntry
+{
+    QString ref;      // 完整 ref
+    QString channel;  // 渠道，旧格式 ref 为空
+    QString version;  // 版本号
+    QString arch;     // 架构
+    QString module;   // 模块，旧格式 ref 为空
+    QString checksum; // commit 值
+};
+
+/*
+ * 远端仓库 ref 索引，按 appId 分组并按版本号升序排列，用于快速查找指定版本或最新版本
+ * 支持 {appId}/{version}/{arch} 与 {channel}/{appId}/{version}/{arch}/{module} 两种格式
+ */
+class RemoteRefIndex
+{
+public:
+    /*
+     * 由 summary 中的 ref 列表重建索引
+     *
+     * @param refs: ref 与 commit 的对应关系
+     */
+    void build(const QMap<QString, QString> &refs);
+
+    /*
+     * 查找指定版本，架构和模块为空时不过滤
+     *
+     * @param appId: 软件包 appId
+     * @param version: 版本号
+     * @param arch: 架构
+     * @param module: 模块
+     * @param entry: 查找结果
+     *
+     * @return bool: true:找到 false:未找到
+     */
+    bool findVersion(const QString &appId,
+                     const QString &version,
+                     const QString &arch,
+                     const QString &module,
+                     RemoteRefEntry &entry) const;
+
+    /*
+     * 查找最新版本，架构和模块为空时不过滤
+     *
+     * @param appId: 软件包 appId
+     * @param arch: 架构
+     * @param module: 模块
+     * @param entry: 查找结果
+     *
+     * @return bool: true:找到 false:未找到
+     */
+    bool findLatest(const QString &appId,
+                    const QString &arch,
+                    const QString &module,
+                    RemoteRefEntry &entry) const;
+
+    /*
+     * 获取软件包的全部 ref，按版本号升序排列
+     *
+     * @param appId: 软件包 appId
+     *
+     * @return QVector<RemoteRefEntry>: ref 列表
+     */
+    QVector<RemoteRefEntry> entries(const QString &appId) const;
+
+    bool isEmpty() const { return index.isEmpty(); }
+
+private:
+    QHash<QString, QVector<RemoteRefEntry>> index;
+};
+
+} // namespace repo
+} // namespace linglong
+
+#endif
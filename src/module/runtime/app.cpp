@@ -8,13 +8,16 @@
 
 #include "module/dbus_ipc/package_manager_param.h"
 #include "module/package/info.h"
+#include "module/repo/layer_catalog.h"
 #include "module/repo/repo.h"
 #include "module/runtime/app_config.h"
+#include "module/runtime/oci_writer.h"
 #include "module/util/desktop_entry.h"
 #include "module/util/env.h"
 #include "module/util/file.h"
 #include "module/util/serialize/json.h"
 #include "module/util/serialize/yaml.h"
+#include "module/util/trace.h"
 #include "module/util/version/version.h"
 #include "module/util/xdg.h"
 
@@ -23,12 +26,18 @@
 
 #include <QDir>
 #include <QFile>
+#include <QMutex>
 #include <QProcess>
 #include <QStandardPaths>
 
+#include <cerrno>
+#include <csignal>
+#include <cstring>
 #include <mutex>
 
+#include <poll.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
@@ -58,6 +67,156 @@ enum RunArch {
     X86_64,
 };
 
+namespace {
+
+/*
+ * 获取文件修改时间戳，用于判断缓存是否失效
+ *
+ * @param path: 文件或目录路径
+ *
+ * @return qint64: 修改时间(纳秒)，文件不存在时返回 -1
+ */
+qint64 pathStamp(const QString &path)
+{
+    struct stat st = {};
+    if (stat(path.toLocal8Bit().constData(), &st) != 0) {
+        return -1;
+    }
+    return static_cast<qint64>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+/*
+ * 读取内置 json 配置，qrc 内容不会变化，每个进程只解析一次
+ *
+ * @param path: qrc 资源路径
+ *
+ * @return QVariant: 解析结果，读取失败时为空
+ */
+QVariant loadBuiltinJson(const QString &path)
+{
+    static QMutex mutex;
+    static QMap<QString, QVariant> cache;
+
+    QMutexLocker locker(&mutex);
+    auto it = cache.constFind(path);
+    if (it != cache.constEnd()) {
+        return it.value();
+    }
+
+    QFile jsonFile(path);
+    if (!jsonFile.open(QIODevice::ReadOnly)) {
+        qCritical() << path << jsonFile.error() << jsonFile.errorString();
+        return QVariant();
+    }
+    auto json = QJsonDocument::fromJson(jsonFile.readAll()).toVariant();
+    jsonFile.close();
+    cache.insert(path, json);
+    return json;
+}
+
+// 由模板生成并解析后的应用配置，记录生成时依赖的目录和文件时间戳
+struct AppConfigCacheEntry
+{
+    QVariantMap config;
+    QString configPath;
+    QMap<QString, qint64> stamps;
+    // 最近一次使用的序号，缓存已满时淘汰最久未使用的配置
+    quint64 lastUsed = 0;
+
+    void addStamp(const QString &path) { stamps.insert(path, pathStamp(path)); }
+
+    bool isValid() const
+    {
+        for (auto it = stamps.constBegin(); it != stamps.constEnd(); ++it) {
+            if (pathStamp(it.key()) != it.value()) {
+                return false;
+            }
+        }
+        return !config.isEmpty() && linglong::util::fileExists(configPath);
+    }
+};
+
+// 缓存的应用配置数量上限
+const int kAppConfigCacheMax = 32;
+
+QMutex appConfigCacheMutex;
+quint64 appConfigCacheCounter = 0;
+// key: appId/version/channel/module
+QMap<QString, AppConfigCacheEntry> appConfigCache;
+
+/*
+ * 加入新的应用配置，先移除配置文件已不存在的项，仍超过上限时移除最久未使用的项，需持有
+ * appConfigCacheMutex
+ *
+ * @param key: 缓存 key
+ * @param entry: 应用配置
+ */
+void insertAppConfigCache(const QString &key, AppConfigCacheEntry entry)
+{
+    for (auto it = appConfigCache.begin(); it != appConfigCache.end();) {
+        it = linglong::util::fileExists(it->configPath) ? it + 1 : appConfigCache.erase(it);
+    }
+    appConfigCache.remove(key);
+    while (appConfigCache.size() >= kAppConfigCacheMax) {
+        auto oldest = appConfigCache.begin();
+        for (auto it = appConfigCache.begin(); it != appConfigCache.end(); ++it) {
+            if (it->lastUsed < oldest->lastUsed) {
+                oldest = it;
+            }
+        }
+        appConfigCache.erase(oldest);
+    }
+    entry.lastUsed = ++appConfigCacheCounter;
+    appConfigCache.insert(key, entry);
+}
+
+// ll-box 读取配置的等待时间
+const int kSocketWriteTimeoutMs = 10 * 1000;
+
+/*
+ * 向 ll-box 的非阻塞 socket 写入一条消息，每条消息以 '\0' 结尾。
+ * 缓冲区满时等待 socket 可写后继续写入，被信号中断时重试
+ *
+ * @param fd: socket
+ * @param data: 消息内容
+ *
+ * @return bool: true:成功 false:超时、对端关闭或出错
+ */
+bool writeMessage(int fd, const QByteArray &data)
+{
+    const QByteArray message = data + '\0';
+    int offset = 0;
+    while (offset < message.size()) {
+        auto sizeOfWrite =
+                send(fd, message.constData() + offset, message.size() - offset, MSG_NOSIGNAL);
+        if (sizeOfWrite >= 0) {
+            offset += sizeOfWrite;
+            continue;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            qCritical() << "write to ll-box failed:" << strerror(errno);
+            return false;
+        }
+
+        struct pollfd pfd = { fd, POLLOUT, 0 };
+        int ret = poll(&pfd, 1, kSocketWriteTimeoutMs);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0 || (pfd.revents & (POLLERR | POLLHUP))) {
+            qCritical() << "wait ll-box socket writable failed:"
+                        << (ret == 0 ? "timeout" : strerror(errno));
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
 class AppPrivate
 {
 public:
@@ -66,16 +225,21 @@ public:
     {
     }
 
+    ~AppPrivate()
+    {
+        if (sockets[1] >= 0) {
+            close(sockets[1]);
+        }
+    }
+
     bool init()
     {
-        QFile jsonFile(":/config.json");
-        if (!jsonFile.open(QIODevice::ReadOnly)) {
+        auto json = loadBuiltinJson(":/config.json");
+        if (!json.isValid()) {
             qFatal("buildin oci configuration file missing, check qrc");
             return false;
         }
-        auto json = QJsonDocument::fromJson(jsonFile.readAll());
-        jsonFile.close();
-        r = fromVariant<Runtime>(json.toVariant());
+        r = fromVariant<Runtime>(json);
         r->setParent(q_ptr);
 
         container = new Container(q_ptr);
@@ -86,6 +250,7 @@ public:
 
     int prepare()
     {
+        LINGLONG_TRACE_SCOPE("prepare");
         Q_Q(App);
 
         // FIXME: get info from module/package
@@ -205,6 +370,7 @@ public:
 
     int stageSystem() const
     {
+        LINGLONG_TRACE_SCOPE("stageSystem");
         QList<QPair<QString, QString>> mountMap;
         mountMap = {
             { "/dev/dri", "/dev/dri" },
@@ -225,6 +391,7 @@ public:
 
     int stageRootfs(QString runtimeRootPath, const QString &appId, QString appRootPath) const
     {
+        LINGLONG_TRACE_SCOPE("stageRootfs");
         // 使用linglong runtime标志
         bool useThinRuntime = true;
         // overlay 挂载标志
@@ -493,6 +660,7 @@ public:
 
     int stageHost() const
     {
+        LINGLONG_TRACE_SCOPE("stageHost");
         QList<QPair<QString, QString>> roMountMap = {
             { "/etc/resolv.conf", "/run/host/network/etc/resolv.conf" },
             { "/run/resolvconf", "/run/resolvconf" },
@@ -576,6 +744,7 @@ public:
     // Fix to do 当前仅处理session bus
     int stageDBusProxy(const QString &socketPath, bool useDBusProxy = false)
     {
+        LINGLONG_TRACE_SCOPE("stageDBusProxy");
         QList<QPair<QString, QString>> mountMap;
         auto userRuntimeDir = QString("/run/user/%1/").arg(getuid());
         if (useDBusProxy) {
@@ -605,6 +774,7 @@ public:
 
     int stageUser(const QString &appId) const
     {
+        LINGLONG_TRACE_SCOPE("stageUser");
         QList<QPair<QString, QString>> mountMap;
 
         // bind user data
@@ -828,6 +998,7 @@ public:
 
     int stageMount()
     {
+        LINGLONG_TRACE_SCOPE("stageMount");
         Q_Q(const App);
 
         bool hasMountTmp = false;
@@ -996,14 +1167,11 @@ public:
 
         // mount /dev for app
         {
-            QFile jsonFile(":/app_config.json");
-            if (!jsonFile.open(QIODevice::ReadOnly)) {
-                qCritical() << jsonFile.error() << jsonFile.errorString();
+            auto json = loadBuiltinJson(":/app_config.json");
+            if (!json.isValid()) {
                 return false;
             }
-            auto json = QJsonDocument::fromJson(jsonFile.readAll());
-            jsonFile.close();
-            appConfig = fromVariant<linglong::runtime::AppConfig>(json.toVariant());
+            appConfig = fromVariant<linglong::runtime::AppConfig>(json);
             appConfig->setParent(q_ptr);
             for (const auto &appOfId : appConfig->appMountDevList) {
                 if (appOfId == appId) {
@@ -1023,35 +1191,60 @@ public:
 
     static QString getMathedRuntime(const QString &runtimeId, const QString &runtimeVersion)
     {
-        auto localRepoRoot = util::getLinglongRootPath() + "/layers/" + runtimeId;
-        QDir appRoot(localRepoRoot);
-        appRoot.setSorting(QDir::Name | QDir::Reversed);
-        auto versionDirs = appRoot.entryList(QDir::NoDotAndDotDot | QDir::Dirs);
-        auto available = linglong::util::APP_MIN_VERSION;
-        for (const auto &item : versionDirs) {
-            linglong::util::AppVersion versionIter(item);
-            linglong::util::AppVersion dstVersion(available);
-            if (versionIter.isValid() && versionIter.isBigThan(dstVersion)
-                && item.startsWith(runtimeVersion)) {
-                available = item;
-            }
-        }
-        qDebug() << "getMathedRuntime info" << available << appRoot << versionDirs;
+        auto available = LAYER_CATALOG->matchedVersion(util::getLinglongRootPath() + "/layers",
+                                                       runtimeId,
+                                                       runtimeVersion);
+        qDebug() << "getMathedRuntime info" << runtimeId << runtimeVersion << available;
         return available;
     }
 
+    /*
+     * 由模板生成应用配置并保存到 ~/.linglong/<appId>/app.yaml，依赖的 layer 目录、info.json
+     * 及用户目录配置未变化时直接使用上次生成的结果
+     *
+     * @param repo: 本地仓库
+     * @param appId: 应用 appId
+     * @param appVersion: 应用版本，为空时使用最新版本
+     * @param channel: 渠道
+     * @param module: 模块
+     *
+     * @return QVariantMap: 解析后的应用配置，失败时为空
+     */
     // FIXME: none static
-    static QString loadConfig(linglong::repo::Repo *repo,
-                              const QString &appId,
-                              const QString &appVersion,
-                              const QString &channel,
-                              const QString &module)
+    static QVariantMap loadConfig(linglong::repo::Repo *repo,
+                                  const QString &appId,
+                                  const QString &appVersion,
+                                  const QString &channel,
+                                  const QString &module)
     {
+        LINGLONG_TRACE_SCOPE("loadConfig");
         util::ensureUserDir({ ".linglong", appId });
 
         auto configPath =
                 linglong::util::getUserFile(QString("%1/%2/app.yaml").arg(".linglong", appId));
 
+        auto cacheKey = QStringList{ appId, appVersion, channel, module }.join("/");
+        {
+            QMutexLocker locker(&appConfigCacheMutex);
+            auto it = appConfigCache.find(cacheKey);
+            if (it != appConfigCache.end()) {
+                if (it->isValid()) {
+                    qDebug() << "loadConfig use cached config" << cacheKey;
+                    it->lastUsed = ++appConfigCacheCounter;
+                    return it->config;
+                }
+                appConfigCache.erase(it);
+            }
+        }
+
+        // 先记录时间戳再读取，生成过程中发生的变化会使缓存在下次启动时失效
+        AppConfigCacheEntry cacheEntry;
+        cacheEntry.configPath = configPath;
+        auto layersPath = util::getLinglongRootPath() + "/layers/";
+        cacheEntry.addStamp(layersPath + appId);
+        cacheEntry.addStamp(QStandardPaths::writableLocation(QStandardPaths::ConfigLocation)
+                            + "/user-dirs.dirs");
+
         // create yaml form info
         // auto appRoot = LocalRepo::get()->rootOfLatest();
         auto latestAppRef = repo->latestOfRef(appId, appVersion);
@@ -1062,8 +1255,9 @@ public:
         // 判断是否存在
         if (!linglong::util::fileExists(appInfo)) {
             qCritical() << appInfo << " not exist";
-            return QString();
+            return QVariantMap();
         }
+        cacheEntry.addStamp(appInfo);
 
         // create a yaml config from json
         QScopedPointer<package::Info> info(util::loadJson<package::Info>(appInfo));
@@ -1079,6 +1273,7 @@ public:
         }
 
         package::Ref runtimeRef(info->runtime);
+        cacheEntry.addStamp(layersPath + runtimeRef.appId);
         QString appRef = QString("%1/").arg(channel)
                 + latestAppRef.toLocalRefString().append(QString("/%1").arg(module));
         qDebug() << "loadConfig runtime" << info->runtime;
@@ -1157,14 +1352,27 @@ public:
         }
         templateFile.close();
 
+        if (!permissionMountsData.isEmpty())
+            templateData.append(permissionMountsData.toLocal8Bit());
+
         QFile configFile(configPath);
         configFile.open(QIODevice::WriteOnly | QIODevice::Truncate);
         configFile.write(templateData);
-        if (!permissionMountsData.isEmpty())
-            configFile.write(permissionMountsData.toLocal8Bit());
         configFile.close();
 
-        return configPath;
+        qDebug() << templateData;
+        try {
+            auto doc = YAML::Load(QString::fromLocal8Bit(templateData).toStdString());
+            cacheEntry.config = doc.as<QVariant>().toMap();
+        } catch (const std::exception &e) {
+            qCritical() << "parse app config failed:" << e.what();
+            return QVariantMap();
+        }
+
+        QMutexLocker locker(&appConfigCacheMutex);
+        insertAppConfigCache(cacheKey, cacheEntry);
+
+        return cacheEntry.config;
     }
 
     bool useFlatpakRuntime = false;
@@ -1178,7 +1386,9 @@ public:
     linglong::runtime::AppConfig *appConfig = nullptr;
 
     repo::Repo *repo;
-    int sockets[2]; // save file describers of sockets used to communicate with ll-box
+    // save file describers of sockets used to communicate with ll-box
+    int sockets[2] = { -1, -1 };
+    QMutex socketMutex;
 
     const QString sysLinglongInstalltions = util::getLinglongRootPath() + "/entries/share";
 
@@ -1193,23 +1403,15 @@ App::App(QObject *parent)
 
 App *App::load(linglong::repo::Repo *repo, const package::Ref &ref, const QString &desktopExec)
 {
-    QString configPath =
-            AppPrivate::loadConfig(repo, ref.appId, ref.version, ref.channel, ref.module);
-    if (!linglong::util::fileExists(configPath)) {
+    LINGLONG_TRACE_SCOPE("App::load");
+    auto config = AppPrivate::loadConfig(repo, ref.appId, ref.version, ref.channel, ref.module);
+    if (config.isEmpty()) {
         return nullptr;
     }
 
-    QFile appConfig(configPath);
-    appConfig.open(QIODevice::ReadOnly);
-
-    qDebug() << "load conf yaml from" << configPath;
-
     App *app = nullptr;
     try {
-        auto data = QString::fromLocal8Bit(appConfig.readAll());
-        qDebug() << data;
-        YAML::Node doc = YAML::Load(data.toStdString());
-        app = formYaml<App>(doc);
+        app = formYamlVariant<App>(config);
 
         qDebug() << app << app->runtime << app->package << app->version;
         // TODO: maybe set as an arg of init is better
@@ -1226,6 +1428,24 @@ int App::start()
 {
     Q_D(App);
 
+    pid_t boxPid = launch();
+    if (boxPid < 0) {
+        return EXIT_FAILURE;
+    }
+    // FIXME(interactive bash): if need keep interactive shell
+    waitpid(boxPid, nullptr, 0);
+    close(d->sockets[1]);
+    d->sockets[1] = -1;
+    // FIXME to do 删除代理socket临时文件
+
+    return EXIT_SUCCESS;
+}
+
+pid_t App::launch()
+{
+    Q_D(App);
+    LINGLONG_TRACE_SCOPE("App::launch");
+
     d->r->root->path = d->container->workingDirectory + "/root";
     util::ensureDir(d->r->root->path);
 
@@ -1237,17 +1457,27 @@ int App::start()
     pidFile.close();
 
     qDebug() << "start container at" << d->r->root->path;
-    auto json = QJsonDocument::fromVariant(toVariant<Runtime>(d->r)).toJson();
-    auto data = json.toStdString();
+    QByteArray data;
+    {
+        LINGLONG_TRACE_SCOPE("encodeRuntime");
+        data = encodeRuntime(d->r);
+    }
 
     if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, d->sockets) != 0) {
-        return EXIT_FAILURE;
+        return -1;
     }
 
     pid_t parent = getpid();
 
-    pid_t boxPid = fork();
+    pid_t boxPid = -1;
+    {
+        LINGLONG_TRACE_SCOPE("fork ll-box");
+        boxPid = fork();
+    }
     if (boxPid < 0) {
+        close(d->sockets[0]);
+        close(d->sockets[1]);
+        d->sockets[1] = -1;
         return -1;
     }
 
@@ -1262,19 +1492,26 @@ int App::start()
         char const *const args[] = { "ll-box", socket.c_str(), NULL };
         int ret = execvp(args[0], (char **)args);
         exit(ret);
-    } else {
-        close(d->sockets[0]);
-        // FIXME: handle error
-        (void)write(d->sockets[1], data.c_str(), data.size());
-        (void)write(d->sockets[1], "\0", 1); // each data write into sockets should ended with '\0'
-        d->container->pid = boxPid;
-        // FIXME(interactive bash): if need keep interactive shell
+    }
+
+    close(d->sockets[0]);
+    bool sent = false;
+    {
+        LINGLONG_TRACE_SCOPE("send config");
+        QMutexLocker locker(&d->socketMutex);
+        sent = writeMessage(d->sockets[1], data);
+    }
+    if (!sent) {
+        // ll-box 未收到完整配置，不能继续运行
+        kill(boxPid, SIGKILL);
         waitpid(boxPid, nullptr, 0);
         close(d->sockets[1]);
-        // FIXME to do 删除代理socket临时文件
+        d->sockets[1] = -1;
+        return -1;
     }
+    d->container->pid = boxPid;
 
-    return EXIT_SUCCESS;
+    return boxPid;
 }
 
 void App::exec(QString cmd, QString env, QString cwd)
@@ -1324,17 +1561,13 @@ void App::exec(QString cmd, QString env, QString cwd)
         return;
     }
     p.setargs(appCmd);
-    auto data = dump(&p).toStdString();
-
-    // FIXME: retry on temporary fail
-    // FIXME: add lock
-    int sizeOfData = data.size();
-    while (sizeOfData) {
-        auto sizeOfWrite = write(d->sockets[1], data.c_str(), sizeOfData);
-        sizeOfData = sizeOfData - sizeOfWrite;
-        data = data.erase(0, sizeOfWrite);
+    auto data = encodeProcess(&p);
+
+    // 同一个应用可能同时收到多个运行请求，写入不能交错
+    QMutexLocker locker(&d->socketMutex);
+    if (!writeMessage(d->sockets[1], data)) {
+        qCritical() << "exec" << appCmd << "in" << d->container->id << "failed";
     }
-    write(d->sockets[1], "\0", 1);
 }
 
 Container *App::container() const
@@ -90,7 +90,15 @@ public:
 
     Container *container() const;
 
+    // 启动容器并等待容器退出
     int start();
+
+    /*
+     * 启动容器后立即返回，调用方负责回收容器进程
+     *
+     * @return pid_t: ll-box 进程号，失败时返回 -1
+     */
+    pid_t launch();
     void exec(QString cmd, QString env, QString cwd);
 
     void saveUserEnvList(const QStringList &userEnvList);
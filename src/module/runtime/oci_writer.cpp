@@ -0,0 +1,373 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "oci_writer.h"
+
+#include <QVector>
+
+namespace linglong {
+namespace runtime {
+
+namespace {
+
+// 每个挂载点编码后的大致长度，用于预分配缓冲区
+const int kBytesPerMount = 160;
+
+/*
+ * 流式 json 写入，只追加到同一个缓冲区
+ */
+class JsonWriter
+{
+public:
+    explicit JsonWriter(int reserve)
+    {
+        out.reserve(reserve);
+    }
+
+    void beginObject()
+    {
+        separate();
+        out.append('{');
+        first.append(true);
+    }
+
+    void endObject()
+    {
+        first.removeLast();
+        out.append('}');
+    }
+
+    void beginArray()
+    {
+        separate();
+        out.append('[');
+        first.append(true);
+    }
+
+    void endArray()
+    {
+        first.removeLast();
+        out.append(']');
+    }
+
+    void key(const char *name)
+    {
+        separate();
+        out.append('"').append(name).append("\":");
+        afterKey = true;
+    }
+
+    void value(const QString &str)
+    {
+        separate();
+        escape(str.toUtf8());
+    }
+
+    void value(bool b)
+    {
+        separate();
+        out.append(b ? "true" : "false");
+    }
+
+    void value(quint64 n)
+    {
+        separate();
+        out.append(QByteArray::number(n));
+    }
+
+    void null()
+    {
+        separate();
+        out.append("null");
+    }
+
+    void value(const QStringList &list)
+    {
+        beginArray();
+        for (const auto &str : list) {
+            value(str);
+        }
+        endArray();
+    }
+
+    QByteArray out;
+
+private:
+    // 同一层级的值之间追加逗号，键之后的值不追加
+    void separate()
+    {
+        if (afterKey) {
+            afterKey = false;
+            return;
+        }
+        if (first.isEmpty()) {
+            return;
+        }
+        if (!first.last()) {
+            out.append(',');
+        }
+        first.last() = false;
+    }
+
+    void escape(const QByteArray &utf8)
+    {
+        static const char hex[] = "0123456789abcdef";
+        out.append('"');
+        for (const char c : utf8) {
+            switch (c) {
+            case '"':
+                out.append("\\\"");
+                break;
+            case '\\':
+                out.append("\\\\");
+                break;
+            case '\b':
+                out.append("\\b");
+                break;
+            case '\f':
+                out.append("\\f");
+                break;
+            case '\n':
+                out.append("\\n");
+                break;
+            case '\r':
+                out.append("\\r");
+                break;
+            case '\t':
+                out.append("\\t");
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    out.append("\\u00").append(hex[c >> 4]).append(hex[c & 0xf]);
+                } else {
+                    out.append(c);
+                }
+                break;
+            }
+        }
+        out.append('"');
+    }
+
+    QVector<bool> first;
+    bool afterKey = false;
+};
+
+void writeMount(JsonWriter &w, const Mount *m)
+{
+    if (m == nullptr) {
+        w.null();
+        return;
+    }
+    w.beginObject();
+    w.key("destination");
+    w.value(m->destination);
+    w.key("options");
+    w.value(m->options);
+    w.key("source");
+    w.value(m->source);
+    w.key("type");
+    w.value(m->type);
+    w.endObject();
+}
+
+void writeMounts(JsonWriter &w, const MountList &mounts)
+{
+    w.beginArray();
+    for (const auto &m : mounts) {
+        writeMount(w, m.data());
+    }
+    w.endArray();
+}
+
+void writeProcess(JsonWriter &w, const Process *p)
+{
+    w.beginObject();
+    w.key("args");
+    w.value(p->args);
+    w.key("cwd");
+    w.value(p->cwd);
+    w.key("env");
+    w.value(p->env);
+    w.endObject();
+}
+
+void writeIdMaps(JsonWriter &w, const IdMapList &idMaps)
+{
+    w.beginArray();
+    for (const auto &idMap : idMaps) {
+        if (idMap.isNull()) {
+            w.null();
+            continue;
+        }
+        w.beginObject();
+        w.key("containerID");
+        w.value(idMap->containerId);
+        w.key("hostID");
+        w.value(idMap->hostId);
+        w.key("size");
+        w.value(idMap->size);
+        w.endObject();
+    }
+    w.endArray();
+}
+
+void writeLinux(JsonWriter &w, const Linux *l)
+{
+    w.beginObject();
+    w.key("gidMappings");
+    writeIdMaps(w, l->gidMappings);
+    w.key("namespaces");
+    w.beginArray();
+    for (const auto &ns : l->namespaces) {
+        if (ns.isNull()) {
+            w.null();
+            continue;
+        }
+        w.beginObject();
+        w.key("type");
+        w.value(ns->type);
+        w.endObject();
+    }
+    w.endArray();
+    w.key("uidMappings");
+    writeIdMaps(w, l->uidMappings);
+    w.endObject();
+}
+
+void writeHooks(JsonWriter &w, const HookList &hooks)
+{
+    w.beginArray();
+    for (const auto &hook : hooks) {
+        if (hook.isNull()) {
+            w.null();
+            continue;
+        }
+        w.beginObject();
+        w.key("args");
+        w.value(hook->args);
+        w.key("env");
+        w.value(hook->env);
+        w.key("path");
+        w.value(hook->path);
+        w.endObject();
+    }
+    w.endArray();
+}
+
+void writeAnnotations(JsonWriter &w, const Annotations *a)
+{
+    w.beginObject();
+    w.key("containerRootPath");
+    w.value(a->containerRootPath);
+    if (a->dbusProxyInfo != nullptr) {
+        const auto proxy = a->dbusProxyInfo;
+        w.key("dbusProxyInfo");
+        w.beginObject();
+        w.key("appID");
+        w.value(proxy->appId);
+        w.key("busType");
+        w.value(proxy->busType);
+        w.key("enable");
+        w.value(proxy->enable);
+        w.key("interface");
+        w.value(proxy->interface);
+        w.key("name");
+        w.value(proxy->name);
+        w.key("path");
+        w.value(proxy->path);
+        w.key("proxyPath");
+        w.value(proxy->proxyPath);
+        w.endObject();
+    }
+    if (a->native != nullptr) {
+        w.key("native");
+        w.beginObject();
+        w.key("mounts");
+        writeMounts(w, a->native->mounts);
+        w.endObject();
+    }
+    if (a->overlayfs != nullptr) {
+        const auto overlayfs = a->overlayfs;
+        w.key("overlayfs");
+        w.beginObject();
+        w.key("lowerParent");
+        w.value(overlayfs->lowerParent);
+        w.key("mounts");
+        writeMounts(w, overlayfs->mounts);
+        w.key("upper");
+        w.value(overlayfs->upper);
+        w.key("workdir");
+        w.value(overlayfs->workdir);
+        w.endObject();
+    }
+    w.endObject();
+}
+
+} // namespace
+
+QByteArray encodeRuntime(const Runtime *r)
+{
+    int mountCount = r->mounts.size();
+    if (r->annotations != nullptr && r->annotations->native != nullptr) {
+        mountCount += r->annotations->native->mounts.size();
+    }
+    if (r->annotations != nullptr && r->annotations->overlayfs != nullptr) {
+        mountCount += r->annotations->overlayfs->mounts.size();
+    }
+    JsonWriter w(4096 + mountCount * kBytesPerMount);
+
+    w.beginObject();
+    if (r->annotations != nullptr) {
+        w.key("annotations");
+        writeAnnotations(w, r->annotations);
+    }
+    if (r->hooks != nullptr) {
+        w.key("hooks");
+        w.beginObject();
+        w.key("poststart");
+        writeHooks(w, r->hooks->poststart);
+        w.key("poststop");
+        writeHooks(w, r->hooks->poststop);
+        w.key("prestart");
+        writeHooks(w, r->hooks->prestart);
+        w.endObject();
+    }
+    w.key("hostname");
+    w.value(r->hostname);
+    if (r->linux != nullptr) {
+        w.key("linux");
+        writeLinux(w, r->linux);
+    }
+    w.key("mounts");
+    writeMounts(w, r->mounts);
+    w.key("ociVersion");
+    w.value(r->ociVersion);
+    if (r->process != nullptr) {
+        w.key("process");
+        writeProcess(w, r->process);
+    }
+    if (r->root != nullptr) {
+        w.key("root");
+        w.beginObject();
+        w.key("path");
+        w.value(r->root->path);
+        w.key("readonly");
+        w.value(r->root->readonly);
+        w.endObject();
+    }
+    w.endObject();
+    return w.out;
+}
+
+QByteArray encodeProcess(const Process *p)
+{
+    JsonWriter w(1024);
+    writeProcess(w, p);
+    return w.out;
+}
+
+} // namespace runtime
+} // namespace linglong
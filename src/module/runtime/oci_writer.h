@@ -0,0 +1,38 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_SRC_MODULE_RUNTIME_OCI_WRITER_H_
+#define LINGLONG_SRC_MODULE_RUNTIME_OCI_WRITER_H_
+
+#include "oci.h"
+
+#include <QByteArray>
+
+namespace linglong {
+namespace runtime {
+
+/*
+ * 将 OCI 配置直接编码为 ll-box 读取的 json，逐个读取成员写入缓冲区，
+ * 不经过 QVariant、QJsonDocument 及元对象属性查找，输出与 toVariant 的结果等价
+ *
+ * @param r: OCI 配置
+ *
+ * @return QByteArray: 紧凑格式的 json 数据
+ */
+QByteArray encodeRuntime(const Runtime *r);
+
+/*
+ * 编码在已运行容器中执行的进程参数
+ *
+ * @param p: 进程参数
+ *
+ * @return QByteArray: 紧凑格式的 json 数据
+ */
+QByteArray encodeProcess(const Process *p);
+
+} // namespace runtime
+} // namespace linglong
+#endif
@@ -13,6 +13,9 @@
 
 #include <QMutexLocker>
 #include <QThread>
+#include <QThreadStorage>
+
+#include <algorithm>
 
 // 安装数据库路径
 const QString installedAppInfoPath = linglong::util::getLinglongRootPath();
@@ -22,6 +25,296 @@ const QString infoDbVersion = "1.0.0";
 namespace linglong {
 namespace util {
 
+namespace {
+
+// 已安装软件包记录
+struct InstalledAppRecord
+{
+    QString appId;
+    QString name;
+    QString version;
+    QString arch;
+    QString kind;
+    QString runtime;
+    QString uabUrl;
+    QString repoName;
+    QString description;
+    QString user;
+    int size = 0;
+    QString channel;
+    QString module;
+};
+
+/*
+ * 判断记录是否满足查询条件，条件为空时不参与过滤
+ *
+ * @return bool: true:满足 false:不满足
+ */
+bool matchRecord(const InstalledAppRecord &record,
+                 const QString &appVer,
+                 const QString &appArch,
+                 const QString &channel,
+                 const QString &module,
+                 const QString &userName)
+{
+    if (!userName.isEmpty() && record.user != userName) {
+        return false;
+    }
+    if (!appVer.isEmpty() && record.version != appVer) {
+        return false;
+    }
+    // 与 sql 中 arch like '%arch%' 的语义保持一致
+    if (!appArch.isEmpty() && !record.arch.contains(appArch, Qt::CaseInsensitive)) {
+        return false;
+    }
+    if (!channel.isEmpty() && record.channel != channel) {
+        return false;
+    }
+    if (!module.isEmpty() && record.module != module) {
+        return false;
+    }
+    return true;
+}
+
+/*
+ * 安装数据库的内存索引
+ *
+ * 按 appId 保存已安装记录，同一 appId 的记录按版本号升序排列，查询无需访问数据库。
+ * 本进程的增删同步更新索引，其它连接或进程提交修改后通过 PRAGMA data_version 的变化重新加载。
+ * data_version 只能与同一连接之前的值比较，因此按线程记录各自连接上次确认索引有效时的值。
+ */
+class InstalledAppIndex
+{
+public:
+    static InstalledAppIndex *instance()
+    {
+        static InstalledAppIndex index;
+        return &index;
+    }
+
+    /*
+     * 查询 appId 对应的已安装记录
+     *
+     * @return QList<InstalledAppRecord>: 按版本号升序排列的记录
+     */
+    QList<InstalledAppRecord> records(const QString &appId)
+    {
+        QMutexLocker locker(&mutex);
+        ensureLoaded();
+        return appIndex.value(appId);
+    }
+
+    /*
+     * 查询所有已安装记录
+     *
+     * @param result: 按 appId、版本号升序排列的记录
+     *
+     * @return bool: true:成功 false:加载数据库失败
+     */
+    bool allRecords(QList<InstalledAppRecord> &result)
+    {
+        QMutexLocker locker(&mutex);
+        ensureLoaded();
+        for (const auto &appRecords : appIndex) {
+            result.append(appRecords);
+        }
+        return loaded;
+    }
+
+    /*
+     * 增加安装记录
+     *
+     * @return int: 0:成功 其它:失败
+     */
+    int insert(const InstalledAppRecord &record)
+    {
+        QMutexLocker locker(&mutex);
+        ensureLoaded();
+
+        QString insertSql = "INSERT INTO "
+                            "installedAppInfo(appId,name,version,arch,kind,runtime,uabUrl,repoName,"
+                            "description,user,size,channel,module) "
+                            "VALUES(:appId,:name,:version,:arch,:kind,:runtime,:uabUrl,:repoName,:"
+                            "description,:user,:size,:channel,:module)";
+        QVariantMap valueMap;
+        valueMap.insert(":appId", record.appId);
+        valueMap.insert(":name", record.name);
+        valueMap.insert(":version", record.version);
+        valueMap.insert(":arch", record.arch);
+        valueMap.insert(":kind", record.kind);
+        valueMap.insert(":runtime", record.runtime);
+        valueMap.insert(":uabUrl", record.uabUrl);
+        valueMap.insert(":repoName", record.repoName);
+        valueMap.insert(":description", record.description);
+        valueMap.insert(":user", record.user);
+        valueMap.insert(":size", record.size);
+        valueMap.insert(":channel", record.channel);
+        valueMap.insert(":module", record.module);
+
+        Connection connection;
+        QSqlQuery sqlQuery = connection.execute(insertSql, valueMap);
+        if (QSqlError::NoError != sqlQuery.lastError().type()) {
+            qCritical() << "execute insertSql error:" << sqlQuery.lastError().text();
+            return STATUS_CODE(kFail);
+        }
+
+        auto &appRecords = appIndex[record.appId];
+        appRecords.append(record);
+        sortByVersion(appRecords);
+        return STATUS_CODE(kSuccess);
+    }
+
+    /*
+     * 删除满足条件的安装记录
+     *
+     * @return int: 0:成功 其它:失败
+     */
+    int remove(const QString &appId,
+               const QString &appVer,
+               const QString &appArch,
+               const QString &channel,
+               const QString &module,
+               const QString &userName)
+    {
+        QMutexLocker locker(&mutex);
+        ensureLoaded();
+
+        QString deleteSql =
+                "DELETE FROM installedAppInfo WHERE appId = :appId AND version = :version";
+        QVariantMap valueMap;
+        valueMap.insert(":appId", appId);
+        valueMap.insert(":version", appVer);
+        if (!appArch.isEmpty()) {
+            deleteSql.append(" AND arch like :arch");
+            valueMap.insert(":arch", "%" + appArch + "%");
+        }
+        if (!channel.isEmpty()) {
+            deleteSql.append(" AND channel = :channel");
+            valueMap.insert(":channel", channel);
+        }
+        if (!module.isEmpty()) {
+            deleteSql.append(" AND module = :module");
+            valueMap.insert(":module", module);
+        }
+        if (!userName.isEmpty()) {
+            deleteSql.append(" AND user = :user");
+            valueMap.insert(":user", userName);
+        }
+        qDebug().noquote() << "sql:" << deleteSql << valueMap;
+
+        Connection connection;
+        QSqlQuery sqlQuery = connection.execute(deleteSql, valueMap);
+        if (QSqlError::NoError != sqlQuery.lastError().type()) {
+            qCritical() << "execute deleteSql error:" << sqlQuery.lastError().text();
+            return STATUS_CODE(kFail);
+        }
+
+        if (appIndex.contains(appId)) {
+            auto &appRecords = appIndex[appId];
+            for (auto it = appRecords.begin(); it != appRecords.end();) {
+                if (it->version == appVer
+                    && matchRecord(*it, appVer, appArch, channel, module, userName)) {
+                    it = appRecords.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            if (appRecords.isEmpty()) {
+                appIndex.remove(appId);
+            }
+        }
+        return STATUS_CODE(kSuccess);
+    }
+
+private:
+    InstalledAppIndex() = default;
+
+    static void sortByVersion(QList<InstalledAppRecord> &appRecords)
+    {
+        std::stable_sort(appRecords.begin(),
+                         appRecords.end(),
+                         [](const InstalledAppRecord &a, const InstalledAppRecord &b) {
+                             return AppVersion(b.version).isBigThan(AppVersion(a.version));
+                         });
+    }
+
+    /*
+     * 数据库未加载或被其它连接修改时，重新加载索引。本连接的写入不改变 data_version，
+     * 写入前后的修改均由其它连接产生，写入后无需更新记录的值
+     */
+    void ensureLoaded()
+    {
+        Connection connection;
+        const qint64 current = connection.dataVersion();
+        if (loaded && current >= 0 && dataVersions.hasLocalData()
+            && dataVersions.localData() == current) {
+            return;
+        }
+
+        QString selectSql = "SELECT appId,name,version,arch,kind,runtime,uabUrl,repoName,"
+                            "description,user,size,channel,module FROM installedAppInfo";
+        QSqlQuery sqlQuery = connection.execute(selectSql);
+        if (QSqlError::NoError != sqlQuery.lastError().type()) {
+            qCritical() << "execute selectSql error:" << sqlQuery.lastError().text();
+            appIndex.clear();
+            loaded = false;
+            return;
+        }
+
+        appIndex.clear();
+        while (sqlQuery.next()) {
+            InstalledAppRecord record;
+            record.appId = sqlQuery.value(0).toString().trimmed();
+            record.name = sqlQuery.value(1).toString().trimmed();
+            record.version = sqlQuery.value(2).toString().trimmed();
+            record.arch = sqlQuery.value(3).toString().trimmed();
+            record.kind = sqlQuery.value(4).toString().trimmed();
+            record.runtime = sqlQuery.value(5).toString().trimmed();
+            record.uabUrl = sqlQuery.value(6).toString().trimmed();
+            record.repoName = sqlQuery.value(7).toString().trimmed();
+            record.description = sqlQuery.value(8).toString().trimmed();
+            record.user = sqlQuery.value(9).toString().trimmed();
+            record.size = sqlQuery.value(10).toInt();
+            record.channel = sqlQuery.value(11).toString().trimmed();
+            record.module = sqlQuery.value(12).toString().trimmed();
+            appIndex[record.appId].append(record);
+        }
+        for (auto &appRecords : appIndex) {
+            sortByVersion(appRecords);
+        }
+        dataVersions.setLocalData(current);
+        loaded = true;
+        qDebug() << "load installedAppInfo index, app count:" << appIndex.size();
+    }
+
+    QMutex mutex;
+    bool loaded = false;
+    // 各线程数据库连接上次加载或确认索引时的 data_version
+    QThreadStorage<qint64> dataVersions;
+    // QMap 保证 appId 有序
+    QMap<QString, QList<InstalledAppRecord>> appIndex;
+};
+
+/*
+ * 将安装记录转换为软件包信息
+ */
+QPointer<linglong::package::AppMetaInfo> toAppMetaInfo(const InstalledAppRecord &record)
+{
+    auto info = QPointer<linglong::package::AppMetaInfo>(new linglong::package::AppMetaInfo);
+    info->appId = record.appId;
+    info->name = record.name;
+    info->version = record.version;
+    info->arch = record.arch;
+    info->description = record.description;
+    info->user = record.user;
+    info->channel = record.channel;
+    info->module = record.module;
+    return info;
+}
+
+} // namespace
+
+
 /*
  * 检查安装信息数据库表及版本信息表
  *
@@ -46,12 +339,25 @@ int checkInstalledAppDb()
          channel VARCHAR(32),\
          module VARCHAR(32),unique(appId,version,arch,channel,module))";
     Connection connection;
+    // 建表、建索引在同一事务中完成，出错返回时连接析构回滚
+    if (!connection.transaction()) {
+        return STATUS_CODE(kFail);
+    }
     QSqlQuery sqlQuery = connection.execute(createInfoTable);
     if (QSqlError::NoError != sqlQuery.lastError().type()) {
         qCritical() << "execute createInfoTable error:" << sqlQuery.lastError().text();
         return STATUS_CODE(kFail);
     }
 
+    // 按 appId 查询时走索引，避免全表扫描
+    QString createInfoIndex = "CREATE INDEX IF NOT EXISTS installedAppInfoIndex "
+                              "ON installedAppInfo(appId,arch,channel,module)";
+    sqlQuery = connection.execute(createInfoIndex);
+    if (QSqlError::NoError != sqlQuery.lastError().type()) {
+        qCritical() << "execute createInfoIndex error:" << sqlQuery.lastError().text();
+        return STATUS_CODE(kFail);
+    }
+
     QString createVersionTable = "CREATE TABLE IF NOT EXISTS appInfoDbVersion(\
          version VARCHAR(32) PRIMARY KEY,description NVARCHAR)";
     sqlQuery = connection.execute(createVersionTable);
@@ -60,7 +366,7 @@ int checkInstalledAppDb()
         return STATUS_CODE(kFail);
     }
 
-    return STATUS_CODE(kSuccess);
+    return connection.commit() ? STATUS_CODE(kSuccess) : STATUS_CODE(kFail);
 }
 
 /*
@@ -73,6 +379,10 @@ int updateInstalledAppInfoDb()
     // 版本升序排列
     QString selectSql = "SELECT * FROM appInfoDbVersion order by version ASC ";
     Connection connection;
+    // 查询与写入版本记录之间不允许其它线程写入
+    if (!connection.transaction()) {
+        return STATUS_CODE(kFail);
+    }
     QSqlQuery sqlQuery = connection.execute(selectSql);
     if (QSqlError::NoError != sqlQuery.lastError().type()) {
         qCritical() << "execute selectSql error:" << sqlQuery.lastError().text();
@@ -108,7 +418,7 @@ int updateInstalledAppInfoDb()
         }
     }
 
-    return STATUS_CODE(kSuccess);
+    return connection.commit() ? STATUS_CODE(kSuccess) : STATUS_CODE(kFail);
 }
 
 /*
@@ -122,30 +432,24 @@ int updateInstalledAppInfoDb()
  */
 int insertAppRecord(linglong::package::AppMetaInfo *package, const QString &userName)
 {
-    Connection connection;
-    QString insertSql = "INSERT INTO "
-                        "installedAppInfo(appId,name,version,arch,kind,runtime,uabUrl,repoName,"
-                        "description,user,size,channel,module) "
-                        "VALUES(:appId,:name,:version,:arch,:kind,:runtime,:uabUrl,:repoName,:"
-                        "description,:user,:size,:channel,:module)";
-    QVariantMap valueMap;
-    valueMap.insert(":appId", package->appId);
-    valueMap.insert(":name", package->name);
-    valueMap.insert(":version", package->version);
-    valueMap.insert(":arch", package->arch);
-    valueMap.insert(":kind", package->kind);
-    valueMap.insert(":runtime", package->runtime);
-    valueMap.insert(":uabUrl", package->uabUrl);
-    valueMap.insert(":repoName", package->repoName);
-    valueMap.insert(":description", package->description);
-    valueMap.insert(":user", userName);
-    valueMap.insert(":size", package->size);
-    valueMap.insert(":channel", package->channel);
-    valueMap.insert(":module", package->module);
-    QSqlQuery sqlQuery = connection.execute(insertSql, valueMap);
-    if (QSqlError::NoError != sqlQuery.lastError().type()) {
-        qCritical() << "execute insertSql error:" << sqlQuery.lastError().text();
-        return STATUS_CODE(kFail);
+    InstalledAppRecord record;
+    record.appId = package->appId;
+    record.name = package->name;
+    record.version = package->version;
+    record.arch = package->arch;
+    record.kind = package->kind;
+    record.runtime = package->runtime;
+    record.uabUrl = package->uabUrl;
+    record.repoName = package->repoName;
+    record.description = package->description;
+    record.user = userName;
+    record.size = package->size;
+    record.channel = package->channel;
+    record.module = package->module;
+
+    int ret = InstalledAppIndex::instance()->insert(record);
+    if (STATUS_CODE(kSuccess) != ret) {
+        return ret;
     }
     qDebug() << "insertAppRecord app:" << package->appId << ", version:" << package->version
              << " success";
@@ -171,38 +475,12 @@ int deleteAppRecord(const QString &appId,
                     const QString &module,
                     const QString &userName)
 {
-    // 若未指定版本，则查找最高版本
-    QString dstVer = appVer;
-    QString deleteSql =
-            QString("DELETE FROM installedAppInfo WHERE appId = '%1' AND version = '%2'")
-                    .arg(appId)
-                    .arg(dstVer);
-    QString condition = "";
-    if (!appArch.isEmpty()) {
-        condition.append(QString(" AND arch like '%%1%'").arg(appArch));
-    }
-
-    if (!channel.isEmpty()) {
-        condition.append(QString(" AND channel = '%1'").arg(channel));
+    int ret = InstalledAppIndex::instance()
+                      ->remove(appId, appVer, appArch, channel, module, userName);
+    if (STATUS_CODE(kSuccess) != ret) {
+        return ret;
     }
-    if (!module.isEmpty()) {
-        condition.append(QString(" AND module = '%1'").arg(module));
-    }
-
-    if (!userName.isEmpty()) {
-        condition.append(QString(" AND user = '%1'").arg(userName));
-    }
-    deleteSql.append(condition);
-
-    qDebug().noquote() << "sql:" << deleteSql;
-
-    Connection connection;
-    QSqlQuery sqlQuery = connection.execute(deleteSql);
-    if (QSqlError::NoError != sqlQuery.lastError().type()) {
-        qCritical() << "execute deleteSql error:" << sqlQuery.lastError().text();
-        return STATUS_CODE(kFail);
-    }
-    qDebug() << "delete app:" << appId << ", version:" << dstVer << ", arch:" << appArch
+    qDebug() << "delete app:" << appId << ", version:" << appVer << ", arch:" << appArch
              << " success";
     return STATUS_CODE(kSuccess);
 }
@@ -244,47 +522,19 @@ bool getAppInstalledStatus(const QString &appId,
                            const QString &module,
                            const QString &userName)
 {
-    QString selectSql = QString("SELECT * FROM installedAppInfo WHERE appId = '%1'").arg(appId);
-    QString condition = "";
     // FIXME: 预装应用类型应该为system，目前未实现
     // 暂时不用区分用户，当前应用安装目录未区分用户
     // 若区分用户，当前升级镜像后切普通用户预装应用可以重复安装
     // runtime不区分用户
-    if (!isRuntime(appId) && !userName.isEmpty()) {
-        condition.append(QString(" AND user = '%1'").arg(userName));
-    }
-    if (!appVer.isEmpty()) {
-        condition.append(QString(" AND version = '%1'").arg(appVer));
-    }
-    if (!appArch.isEmpty()) {
-        condition.append(QString(" AND arch like '%%1%'").arg(appArch));
-    }
-    if (!channel.isEmpty()) {
-        condition.append(QString(" AND channel = '%1'").arg(channel));
-    }
-    if (!module.isEmpty()) {
-        condition.append(QString(" AND module = '%1'").arg(module));
-    }
-    selectSql.append(condition);
-
-    qDebug().noquote() << "sql:" << selectSql;
-    Connection connection;
-    QSqlQuery sqlQuery = connection.execute(selectSql);
-    if (QSqlError::NoError != sqlQuery.lastError().type()) {
-        qCritical() << "execute sql error:" << sqlQuery.lastError().text();
-        return false;
-    }
-    // 指定用户和版本找不到
-    // sqlite3不支持size属性
-    sqlQuery.last();
-    int recordCount = sqlQuery.at() + 1;
-    if (recordCount < 1) {
-        qDebug() << "getAppInstalledStatus app:" + appId + ",version:" + appVer
-                        + ",channel:" + channel + ",module:" + module + ",userName:" + userName
-                        + " not installed";
-        return false;
+    const QString user = isRuntime(appId) ? QString() : userName;
+    for (const auto &record : InstalledAppIndex::instance()->records(appId)) {
+        if (matchRecord(record, appVer, appArch, channel, module, user)) {
+            return true;
+        }
     }
-    return true;
+    qDebug() << "getAppInstalledStatus app:" + appId + ",version:" + appVer + ",channel:" + channel
+                    + ",module:" + module + ",userName:" + userName + " not installed";
+    return false;
 }
 
 /*
@@ -304,49 +554,18 @@ bool getAllVerAppInfo(const QString &appId,
                       const QString &userName,
                       linglong::package::AppMetaInfoList &pkgList)
 {
-    if (!getAppInstalledStatus(appId, appVer, appArch, "", "", userName)) {
+    bool found = false;
+    for (const auto &record : InstalledAppIndex::instance()->records(appId)) {
+        if (matchRecord(record, appVer, appArch, "", "", userName)) {
+            pkgList.push_back(toAppMetaInfo(record));
+            found = true;
+        }
+    }
+    if (!found) {
         qCritical() << "getAllVerAppInfo app:" + appId + ",version:" + appVer
                         + ",userName:" + userName + " not installed";
-        return false;
-    }
-
-    QString selectSql = QString("SELECT * FROM installedAppInfo WHERE appId = '%1'").arg(appId);
-    QString condition = "";
-    if (!userName.isEmpty()) {
-        condition.append(QString(" AND user = '%1'").arg(userName));
-    }
-    if (!appVer.isEmpty()) {
-        condition.append(QString(" AND version = '%1'").arg(appVer));
-    }
-    if (!appArch.isEmpty()) {
-        condition.append(QString(" AND arch like '%%1%'").arg(appArch));
-    }
-
-    selectSql.append(condition);
-    selectSql.append(" order by version ASC");
-    qDebug() << selectSql;
-
-    Connection connection;
-    QSqlQuery sqlQuery = connection.execute(selectSql);
-    if (QSqlError::NoError != sqlQuery.lastError().type()) {
-        qCritical() << "execute selectSql error:" << sqlQuery.lastError().text();
-        return false;
     }
-    sqlQuery.first();
-    do {
-        auto info = QPointer<linglong::package::AppMetaInfo>(new linglong::package::AppMetaInfo);
-        info->appId = sqlQuery.value(1).toString().trimmed();
-        info->name = sqlQuery.value(2).toString().trimmed();
-        info->arch = sqlQuery.value(4).toString().trimmed();
-        info->description = sqlQuery.value(9).toString().trimmed();
-        info->user = sqlQuery.value(10).toString().trimmed();
-        info->version = sqlQuery.value(3).toString().trimmed();
-        info->channel = sqlQuery.value(13).toString().trimmed();
-        info->module = sqlQuery.value(14).toString().trimmed();
-        pkgList.push_back(info);
-
-    } while (sqlQuery.next());
-    return true;
+    return found;
 }
 
 /*
@@ -370,71 +589,16 @@ bool getInstalledAppInfo(const QString &appId,
                          const QString &userName,
                          linglong::package::AppMetaInfoList &pkgList)
 {
-    if (!getAppInstalledStatus(appId, appVer, appArch, channel, module, userName)) {
-        qCritical() << "getInstalledAppInfo app:" + appId + ",version:" + appVer
-                        + ",channel:" + channel + ",module:" + module + ",userName:" + userName
-                        + " not installed";
-        return false;
-    }
-
-    QString selectSql = QString("SELECT * FROM installedAppInfo WHERE appId = '%1'").arg(appId);
-    QString condition = "";
-    if (!userName.isEmpty()) {
-        condition.append(QString(" AND user = '%1'").arg(userName));
-    }
-    if (!appVer.isEmpty()) {
-        condition.append(QString(" AND version = '%1'").arg(appVer));
-    }
-    if (!appArch.isEmpty()) {
-        condition.append(QString(" AND arch like '%%1%'").arg(appArch));
-    }
-    if (!channel.isEmpty()) {
-        condition.append(QString(" AND channel = '%1'").arg(channel));
-    }
-    if (!module.isEmpty()) {
-        condition.append(QString(" AND module = '%1'").arg(module));
-    }
-
-    selectSql.append(condition);
-    selectSql.append(" order by version ASC");
-    qDebug() << selectSql;
-
-    Connection connection;
-    QSqlQuery sqlQuery = connection.execute(selectSql);
-    if (QSqlError::NoError != sqlQuery.lastError().type()) {
-        qCritical() << "execute selectSql error:" << sqlQuery.lastError().text();
-        return false;
-    }
-
-    // int fieldNo = sqlQuery.record().indexOf("appId");
-    // 多个版本返回最高版本信息
-    sqlQuery.last();
-    int recordCount = sqlQuery.at() + 1;
-    if (recordCount > 0) {
-        auto info = QPointer<linglong::package::AppMetaInfo>(new linglong::package::AppMetaInfo);
-        info->appId = sqlQuery.value(1).toString().trimmed();
-        info->name = sqlQuery.value(2).toString().trimmed();
-        info->arch = sqlQuery.value(4).toString().trimmed();
-        info->description = sqlQuery.value(9).toString().trimmed();
-        info->user = sqlQuery.value(10).toString().trimmed();
-        info->channel = sqlQuery.value(13).toString().trimmed();
-        info->module = sqlQuery.value(14).toString().trimmed();
-        QString dstVer = sqlQuery.value(3).toString().trimmed();
-        // sqlite逐字符比较导致获取的最高版本号不准，e.g: 5.9.1比5.10.1版本高
-        sqlQuery.first();
-        do {
-            QString verIter = sqlQuery.value(3).toString().trimmed();
-            linglong::util::AppVersion versionIter(verIter);
-            linglong::util::AppVersion dstVersion(dstVer);
-            if (versionIter.isValid() && versionIter.isBigThan(dstVersion)) {
-                dstVer = verIter;
-                info->description = sqlQuery.value(9).toString().trimmed();
-            }
-        } while (sqlQuery.next());
-        info->version = dstVer;
-        pkgList.push_back(info);
-        return true;
+    // 记录已按版本号升序排列，最后一个满足条件的即为最高版本
+    const auto records = InstalledAppIndex::instance()->records(appId);
+    for (auto it = records.crbegin(); it != records.crend(); ++it) {
+        if (matchRecord(*it, appVer, appArch, channel, module, userName)) {
+            pkgList.push_back(toAppMetaInfo(*it));
+            return true;
+        }
     }
+    qCritical() << "getInstalledAppInfo app:" + appId + ",version:" + appVer + ",channel:" + channel
+                    + ",module:" + module + ",userName:" + userName + " not installed";
     return false;
 }
 
@@ -449,38 +613,29 @@ bool getInstalledAppInfo(const QString &appId,
  */
 bool queryAllInstalledApp(const QString &userName, QString &result, QString &err)
 {
-    // 默认不查找版本
-    QString selectSql = "";
-    if (userName.isEmpty()) {
-        selectSql = QString("SELECT * FROM installedAppInfo order by appId,version");
-    } else {
-        selectSql =
-                QString("SELECT * FROM installedAppInfo WHERE user = '%1' order by appId,version")
-                        .arg(userName);
-    }
-
-    Connection connection;
-    QSqlQuery sqlQuery = connection.execute(selectSql);
-    if (QSqlError::NoError != sqlQuery.lastError().type()) {
-        qCritical() << "execute selectSql error:" << sqlQuery.lastError().text();
+    QList<InstalledAppRecord> records;
+    if (!InstalledAppIndex::instance()->allRecords(records)) {
         err = "SQL error check log for detail";
         return false;
     }
     QJsonArray appList;
-    while (sqlQuery.next()) {
+    for (const auto &record : records) {
+        if (!userName.isEmpty() && record.user != userName) {
+            continue;
+        }
         QJsonObject appItem;
-        appItem["appId"] = sqlQuery.value(1).toString().trimmed();
-        appItem["name"] = sqlQuery.value(2).toString().trimmed();
-        appItem["version"] = sqlQuery.value(3).toString().trimmed();
-        appItem["arch"] = sqlQuery.value(4).toString().trimmed();
-        appItem["kind"] = sqlQuery.value(5).toString().trimmed();
-        appItem["runtime"] = sqlQuery.value(6).toString().trimmed();
-        appItem["uabUrl"] = sqlQuery.value(7).toString().trimmed();
-        appItem["repoName"] = sqlQuery.value(8).toString().trimmed();
-        appItem["description"] = sqlQuery.value(9).toString().trimmed();
-
-        appItem["channel"] = sqlQuery.value(13).toString().trimmed();
-        appItem["module"] = sqlQuery.value(14).toString().trimmed();
+        appItem["appId"] = record.appId;
+        appItem["name"] = record.name;
+        appItem["version"] = record.version;
+        appItem["arch"] = record.arch;
+        appItem["kind"] = record.kind;
+        appItem["runtime"] = record.runtime;
+        appItem["uabUrl"] = record.uabUrl;
+        appItem["repoName"] = record.repoName;
+        appItem["description"] = record.description;
+
+        appItem["channel"] = record.channel;
+        appItem["module"] = record.module;
         appList.append(appItem);
     }
     QJsonDocument document = QJsonDocument(appList);
@@ -6,169 +6,233 @@
 
 #include "appinfo_cache.h"
 
+#include "module/util/connection.h"
 #include "module/util/file.h"
-#include "module/util/status_code.h"
 
-// app 缓存有效期 秒为单位
-const int kCacheValidTime = 10 * 60;
+#include <QDateTime>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QThreadStorage>
 
 namespace linglong {
 namespace util {
 
-/*
- * 创建数据库连接
- *
- * @param dbConn: QSqlDatabase 数据库
- *
- * @return int: 0:成功 其它:失败
- */
-int openCacheDbConn(QSqlDatabase &dbConn)
-{
+namespace {
+
+// 超过该时间的记录启动时不再读入
+const qint64 kCacheMaxKeepSecs = 7 * 24 * 60 * 60;
+
+const char *const kCreateTableSql = "CREATE TABLE IF NOT EXISTS remoteAppInfo("
+                                    "repo TEXT NOT NULL,"
+                                    "queryId TEXT NOT NULL,"
+                                    "queryVersion TEXT NOT NULL,"
+                                    "queryArch TEXT NOT NULL,"
+                                    "appId TEXT NOT NULL,"
+                                    "version TEXT NOT NULL,"
+                                    "arch TEXT NOT NULL,"
+                                    "channel TEXT NOT NULL,"
+                                    "module TEXT NOT NULL,"
+                                    "data TEXT NOT NULL,"
+                                    "fetchedAt INTEGER NOT NULL)";
+
+const char *const kCreateQueryIndexSql =
+        "CREATE INDEX IF NOT EXISTS remoteAppInfoQuery "
+        "ON remoteAppInfo(repo, queryId, queryVersion, queryArch)";
+
+const char *const kCreateFetchedAtIndexSql =
+        "CREATE INDEX IF NOT EXISTS remoteAppInfoFetchedAt ON remoteAppInfo(fetchedAt)";
+
+QThreadStorage<ThreadConnection *> threadConnections;
+
+} // namespace
+
+AppInfoCache::AppInfoCache()
     // 多用户支持 deepin-linglong 无home目录
-    const QString appInfoCachePath = linglong::util::getLinglongRootPath();
-    qDebug() << "app cache path:" << appInfoCachePath;
-    QString err = "";
-    // 添加数据库驱动，并指定连接名称cache_package_connection
-    if (QSqlDatabase::contains("cache_package_connection")) {
-        dbConn = QSqlDatabase::database("cache_package_connection");
-    } else {
-        dbConn = QSqlDatabase::addDatabase("QSQLITE", "cache_package_connection");
-        dbConn.setDatabaseName(appInfoCachePath + "/.appInfoCache.db");
-    }
-    if (!dbConn.isOpen() && !dbConn.open()) {
-        err = "open " + appInfoCachePath + " .appInfoCache.db failed";
-        qCritical() << err;
-        return STATUS_CODE(kFail);
-    }
-    return STATUS_CODE(kSuccess);
+    : databasePath(linglong::util::getLinglongRootPath() + "/.appInfoCache.db")
+{
+    load();
 }
 
-/*
- * 检查appinfo cache信息数据库表
- *
- * @return int: 0:成功 其它:失败
- */
-int checkAppCache()
+QString AppInfoCache::entryKey(const QString &repo,
+                               const QString &appId,
+                               const QString &version,
+                               const QString &arch)
 {
-    QString err = "";
-    QSqlDatabase dbConn;
-    if (STATUS_CODE(kSuccess) != openCacheDbConn(dbConn)) {
-        return STATUS_CODE(kFail);
-    }
-
-    QString createCacheTable = "CREATE TABLE IF NOT EXISTS appInfo(\
-         ID INTEGER PRIMARY KEY AUTOINCREMENT,\
-         key VARCHAR(32) NOT NULL,\
-         data VARCHAR,\
-         timestamp VARCHAR)";
-
-    QSqlQuery sqlQuery(createCacheTable, dbConn);
-    if (!sqlQuery.exec()) {
-        err = "fail to create cache appinfo table, err:" + sqlQuery.lastError().text();
-        qCritical() << err;
-        dbConn.close();
-        return STATUS_CODE(kFail);
-    }
-    dbConn.close();
-    return STATUS_CODE(kSuccess);
+    return QStringList{ repo, appId, version, arch }.join("/");
 }
 
-/*
- * 根据关键字从缓存中查询应用缓存数据
- *
- * @param key: 缓存信息关键字
- * @param appData: 查询得到的应用缓存json数据
- *
- * @return int: 0:成功 其它:失败
- */
-int queryLocalCache(const QString &key, QString &appData)
+QSqlDatabase AppInfoCache::database()
+{
+    // QSqlDatabase 只能在创建连接的线程中使用，线程池中的线程各自保持一个连接
+    if (threadConnections.hasLocalData()) {
+        return QSqlDatabase::database(threadConnections.localData()->name);
+    }
+
+    auto threadConnection = new ThreadConnection("cache_package_connection");
+    threadConnections.setLocalData(threadConnection);
+    auto dbConn = QSqlDatabase::addDatabase("QSQLITE", threadConnection->name);
+    dbConn.setDatabaseName(databasePath);
+    if (!dbConn.open()) {
+        qCritical() << "open" << databasePath << "failed:" << dbConn.lastError().text();
+    }
+    return dbConn;
+}
+
+void AppInfoCache::load()
 {
-    QString err = "";
-    QString selectSql = QString("SELECT * FROM appInfo WHERE key = '%1'").arg(key);
-    QSqlDatabase dbConn;
-    if (STATUS_CODE(kSuccess) != openCacheDbConn(dbConn)) {
-        return STATUS_CODE(kFail);
+    auto dbConn = database();
+    if (!dbConn.isOpen()) {
+        return;
     }
 
     QSqlQuery sqlQuery(dbConn);
-    sqlQuery.prepare(selectSql);
-    if (!sqlQuery.exec()) {
-        err = "queryLocalCache fail to exec sql:" + selectSql
-                + ", error:" + sqlQuery.lastError().text();
-        qCritical() << err;
-        dbConn.close();
-        return STATUS_CODE(kFail);
-    }
-
-    sqlQuery.last();
-    int recordCount = sqlQuery.at() + 1;
-    QString insertSql = "";
-    if (recordCount < 1) {
-        err = "queryLocalCache fail key:" + key + " not found";
-        qDebug() << err;
-        dbConn.close();
-        return STATUS_CODE(kFail);
-    }
-    // 检查缓存结果是否有效
-    QString recordTime = sqlQuery.value(3).toString().trimmed();
-    QDateTime recordDateTime = QDateTime::fromString(recordTime, "yyyy-MM-dd hh:mm:ss");
-    QDateTime current = QDateTime::currentDateTime();
-    // 10 分钟有效
-    QDateTime validDate = recordDateTime.addSecs(kCacheValidTime);
-    if (current < validDate) {
-        appData = sqlQuery.value(2).toString().trimmed();
-        dbConn.close();
-        return STATUS_CODE(kSuccess);
-    } else {
-        QString deleteSql = QString("DELETE FROM appInfo WHERE key = '%1'").arg(key);
-        sqlQuery.prepare(deleteSql);
-        if (!sqlQuery.exec()) {
-            err = "queryLocalCache fail to exec sql:" + deleteSql
-                    + ", error:" + sqlQuery.lastError().text();
-            qCritical() << err;
-            dbConn.close();
-            return STATUS_CODE(kFail);
+    // 旧版本按 appId 保存整段 json 的表及未被查询使用的索引不再使用
+    for (const auto &sql : { QString("DROP TABLE IF EXISTS appInfo"),
+                             QString("DROP INDEX IF EXISTS remoteAppInfoApp"),
+                             QString(kCreateTableSql),
+                             QString(kCreateQueryIndexSql),
+                             QString(kCreateFetchedAtIndexSql) }) {
+        if (!sqlQuery.exec(sql)) {
+            qCritical() << "fail to exec sql:" << sql << ", error:" << sqlQuery.lastError().text();
+            return;
         }
     }
-    dbConn.close();
-    qDebug() << key << " not valid in cache";
-    return STATUS_CODE(kFail);
+
+    const qint64 expired = QDateTime::currentSecsSinceEpoch() - kCacheMaxKeepSecs;
+    sqlQuery.prepare("DELETE FROM remoteAppInfo WHERE fetchedAt < ?");
+    sqlQuery.addBindValue(expired);
+    sqlQuery.exec();
+
+    if (!sqlQuery.exec("SELECT repo, queryId, queryVersion, queryArch, appId, version, arch, "
+                       "channel, module, data, fetchedAt FROM remoteAppInfo")) {
+        qCritical() << "load app info cache failed:" << sqlQuery.lastError().text();
+        return;
+    }
+
+    QWriteLocker locker(&entriesLock);
+    while (sqlQuery.next()) {
+        auto &entry = entries[entryKey(sqlQuery.value(0).toString(),
+                                       sqlQuery.value(1).toString(),
+                                       sqlQuery.value(2).toString(),
+                                       sqlQuery.value(3).toString())];
+        entry.fetchedAt = sqlQuery.value(10).toLongLong();
+        entry.records.append(AppInfoRecord{ sqlQuery.value(4).toString(),
+                                            sqlQuery.value(5).toString(),
+                                            sqlQuery.value(6).toString(),
+                                            sqlQuery.value(7).toString(),
+                                            sqlQuery.value(8).toString(),
+                                            sqlQuery.value(9).toByteArray() });
+    }
+    qDebug() << "load" << entries.size() << "cached app queries";
 }
 
-/*
- * 根据关键字更新应用缓存数据
- *
- * @param key: 缓存信息关键字
- * @param appData: 应用缓存json数据
- *
- * @return int: 0:成功 其它:失败
- */
-int updateCache(const QString &key, const QString &appData)
+bool AppInfoCache::lookup(const QString &repo,
+                          const QString &appId,
+                          const QString &version,
+                          const QString &arch,
+                          qint64 maxAge,
+                          QVector<AppInfoRecord> &records,
+                          qint64 *age)
+{
+    QReadLocker locker(&entriesLock);
+    auto iter = entries.constFind(entryKey(repo, appId, version, arch));
+    if (iter == entries.constEnd()) {
+        return false;
+    }
+
+    const qint64 entryAge = QDateTime::currentSecsSinceEpoch() - iter->fetchedAt;
+    if (age != nullptr) {
+        *age = entryAge;
+    }
+    if (entryAge > maxAge) {
+        return false;
+    }
+    records = iter->records;
+    return true;
+}
+
+bool AppInfoCache::update(const QString &repo,
+                          const QString &appId,
+                          const QString &version,
+                          const QString &arch,
+                          const QString &appData)
 {
-    QString err = "";
-    QSqlDatabase dbConn;
-    if (STATUS_CODE(kSuccess) != openCacheDbConn(dbConn)) {
-        return STATUS_CODE(kFail);
+    QJsonParseError parseJsonErr;
+    auto document = QJsonDocument::fromJson(appData.toUtf8(), &parseJsonErr);
+    if (QJsonParseError::NoError != parseJsonErr.error || document.object()["code"].toInt() != 200
+        || !(document.object()["data"].isArray() || document.object()["data"].isNull())) {
+        return false;
+    }
+
+    Entry entry;
+    entry.fetchedAt = QDateTime::currentSecsSinceEpoch();
+    for (const auto &item : document.object()["data"].toArray()) {
+        const auto obj = item.toObject();
+        entry.records.append(AppInfoRecord{ obj["appId"].toString(),
+                                            obj["version"].toString(),
+                                            obj["arch"].toString(),
+                                            obj["channel"].toString(),
+                                            obj["module"].toString(),
+                                            QJsonDocument(obj).toJson(QJsonDocument::Compact) });
     }
-    // 调用方保证插入cache表前已经调用queryLocalCache查询了cache
-    QString currentTime = QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss");
-    QString insertSql = QString("INSERT INTO appInfo(key,data,timestamp) VALUES(?,?,?)");
 
+    {
+        QWriteLocker locker(&entriesLock);
+        entries.insert(entryKey(repo, appId, version, arch), entry);
+    }
+
+    auto dbConn = database();
+    if (!dbConn.isOpen() || !dbConn.transaction()) {
+        return true;
+    }
     QSqlQuery sqlQuery(dbConn);
-    sqlQuery.prepare(insertSql);
-    sqlQuery.bindValue(0, key);
-    sqlQuery.bindValue(1, appData);
-    sqlQuery.bindValue(2, currentTime);
-    if (!sqlQuery.exec()) {
-        err = "updateCache fail to exec sql:" + insertSql
-                + ", error:" + sqlQuery.lastError().text();
-        qCritical() << err;
-        dbConn.close();
-        return STATUS_CODE(kFail);
-    }
-    dbConn.close();
-    qDebug() << key << " update cache success";
-    return STATUS_CODE(kSuccess);
+    sqlQuery.prepare("DELETE FROM remoteAppInfo WHERE repo = ? AND queryId = ? "
+                     "AND queryVersion = ? AND queryArch = ?");
+    sqlQuery.addBindValue(repo);
+    sqlQuery.addBindValue(appId);
+    sqlQuery.addBindValue(version);
+    sqlQuery.addBindValue(arch);
+    bool ret = sqlQuery.exec();
+
+    sqlQuery.prepare("INSERT INTO remoteAppInfo(repo, queryId, queryVersion, queryArch, appId, "
+                     "version, arch, channel, module, data, fetchedAt) "
+                     "VALUES(?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
+    for (const auto &record : entry.records) {
+        if (!ret) {
+            break;
+        }
+        for (const auto &value : { repo, appId, version, arch, record.appId, record.version,
+                                   record.arch, record.channel, record.module }) {
+            sqlQuery.addBindValue(value);
+        }
+        sqlQuery.addBindValue(QString::fromUtf8(record.data));
+        sqlQuery.addBindValue(entry.fetchedAt);
+        ret = sqlQuery.exec();
+    }
+
+    if (!ret) {
+        qCritical() << "update app info cache failed:" << sqlQuery.lastError().text();
+        dbConn.rollback();
+    } else {
+        dbConn.commit();
+    }
+    return true;
 }
+
+QString AppInfoCache::toServerData(const QVector<AppInfoRecord> &records)
+{
+    QJsonArray data;
+    for (const auto &record : records) {
+        data.append(QJsonDocument::fromJson(record.data).object());
+    }
+    QJsonObject obj;
+    obj["code"] = 200;
+    obj["data"] = data;
+    return QString::fromUtf8(QJsonDocument(obj).toJson(QJsonDocument::Compact));
+}
+
 } // namespace util
 } // namespace linglong
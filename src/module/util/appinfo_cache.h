@@ -7,49 +7,120 @@
 #ifndef LINGLONG_SRC_PACKAGE_MANAGER_IMPL_APPINFO_CACHE_H_
 #define LINGLONG_SRC_PACKAGE_MANAGER_IMPL_APPINFO_CACHE_H_
 
-#include <QDateTime>
+#include "module/util/singleton.h"
+
+#include <QByteArray>
+#include <QHash>
+#include <QReadWriteLock>
 #include <QSqlDatabase>
-#include <QSqlError>
-#include <QSqlQuery>
+#include <QString>
+#include <QVector>
 
 namespace linglong {
 namespace util {
 
 /*
- * 创建数据库连接
- *
- * @param dbConn: QSqlDatabase 数据库
- *
- * @return int: 0:成功 其它:失败
+ * 服务端返回的单个软件包记录，data 为该软件包的 json 数据
  */
-int openCacheDbConn(QSqlDatabase &dbConn);
+struct AppInfoRecord
+{
+    QString appId;
+    QString version;
+    QString arch;
+    QString channel;
+    QString module;
+    QByteArray data;
+};
 
 /*
- * 检查appinfo cache信息数据库表
- *
- * @return int: 0:成功 其它:失败
+ * 远端软件包信息缓存，按查询条件(仓库、appId、版本、架构)缓存解析后的软件包记录。
+ * 记录常驻内存，同时写入 sqlite 供服务重启后使用，每个线程复用各自的数据库连接
  */
-int checkAppCache();
+class AppInfoCache : public linglong::util::Singleton<AppInfoCache>
+{
+    friend class linglong::util::Singleton<AppInfoCache>;
 
-/*
- * 根据关键字从缓存中查询应用缓存数据
- *
- * @param key: 缓存信息关键字
- * @param appData: 查询得到的应用缓存json数据
- *
- * @return int: 0:成功 其它:失败
- */
-int queryLocalCache(const QString &key, QString &appData);
+public:
+    /*
+     * 查询缓存
+     *
+     * @param repo: 仓库名称
+     * @param appId: 查询的appId
+     * @param version: 查询的版本，为空时查询全部版本
+     * @param arch: 查询的架构
+     * @param maxAge: 可接受的缓存时间，单位秒
+     * @param records: 查询结果
+     * @param age: 缓存已存在的时间，单位秒，可为空
+     *
+     * @return bool: true:命中 false:未缓存或缓存时间超过 maxAge
+     */
+    bool lookup(const QString &repo,
+                const QString &appId,
+                const QString &version,
+                const QString &arch,
+                qint64 maxAge,
+                QVector<AppInfoRecord> &records,
+                qint64 *age = nullptr);
+
+    /*
+     * 解析服务端返回的数据并更新缓存
+     *
+     * @param repo: 仓库名称
+     * @param appId: 查询的appId
+     * @param version: 查询的版本
+     * @param arch: 查询的架构
+     * @param appData: 服务端返回的json数据
+     *
+     * @return bool: true:成功 false:数据格式错误
+     */
+    bool update(const QString &repo,
+                const QString &appId,
+                const QString &version,
+                const QString &arch,
+                const QString &appData);
+
+    /*
+     * 将缓存记录转换为服务端返回的数据格式
+     *
+     * @param records: 缓存记录
+     *
+     * @return QString: json数据
+     */
+    static QString toServerData(const QVector<AppInfoRecord> &records);
+
+private:
+    AppInfoCache();
+    ~AppInfoCache() override = default;
+
+    struct Entry
+    {
+        qint64 fetchedAt = 0;
+        QVector<AppInfoRecord> records;
+    };
+
+    static QString entryKey(const QString &repo,
+                            const QString &appId,
+                            const QString &version,
+                            const QString &arch);
+
+    /*
+     * 获取当前线程的数据库连接，首次调用时创建，之后保持打开，线程退出时关闭
+     *
+     * @return QSqlDatabase: 数据库连接
+     */
+    QSqlDatabase database();
+
+    // 建表并将已有记录读入内存
+    void load();
+
+    QString databasePath;
+
+    QReadWriteLock entriesLock;
+    QHash<QString, Entry> entries;
+};
 
-/*
- * 根据关键字更新应用缓存数据
- *
- * @param key: 缓存信息关键字
- * @param appData: 应用缓存json数据
- *
- * @return int: 0:成功 其它:失败
- */
-int updateCache(const QString &key, const QString &appData);
 } // namespace util
 } // namespace linglong
+
+#define APPINFO_CACHE linglong::util::AppInfoCache::instance()
 #endif
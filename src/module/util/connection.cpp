@@ -8,15 +8,49 @@
 
 #include "module/util/file.h"
 
+#include <QAtomicInt>
+#include <QThreadStorage>
+
 #define DATABASE_TYPE "QSQLITE"
 #define TEST_STATE_SQL "SELECT 1"
 
 Q_LOGGING_CATEGORY(database, "linglong.database", QtWarningMsg)
 
-QMutex linglong::util::Connection::mutex;
+QReadWriteLock linglong::util::Connection::lock(QReadWriteLock::Recursive);
 
 namespace linglong {
 namespace util {
+
+namespace {
+
+// 写入等待其它进程释放数据库锁的时间
+const int kBusyTimeoutMs = 5000;
+
+int nextId()
+{
+    static QAtomicInt id;
+    return id.fetchAndAddRelaxed(1);
+}
+
+QThreadStorage<ThreadConnection *> threadConnections;
+
+} // namespace
+
+ThreadConnection::ThreadConnection(const QString &prefix)
+    : name(QStringLiteral("%1_%2").arg(prefix).arg(nextId()))
+{
+}
+
+ThreadConnection::~ThreadConnection()
+{
+    {
+        auto connection = QSqlDatabase::database(name, false);
+        connection.close();
+    }
+    QSqlDatabase::removeDatabase(name);
+    qCDebug(database) << "close connection" << name;
+}
+
 Connection::Connection(QObject *parent)
     : QObject(parent)
     , databaseName(getLinglongRootPath() + "/" + QString(DATABASE_NAME))
@@ -28,62 +62,76 @@ Connection::Connection(QObject *parent)
 
 Connection::~Connection()
 {
-    closeConnection(connection);
-    qCDebug(database) << "close databaseName" << databaseName;
+    if (inTransaction) {
+        qWarning() << "transaction not finished, rollback";
+        rollback();
+    }
 }
 
 QSqlDatabase Connection::getConnection()
 {
-    QSqlDatabase connection;
-    QString connectionName =
-            QStringLiteral("connection_%1").arg(qintptr(QThread::currentThreadId()), 0, 16);
     // 连接已经创建过了，复用它，而不是重新创建
-    if (QSqlDatabase::contains(connectionName)) {
-        connection = QSqlDatabase::database(connectionName);
-        return connection;
+    if (threadConnections.hasLocalData()) {
+        return QSqlDatabase::database(threadConnections.localData()->name);
     }
 
+    auto threadConnection = new ThreadConnection("connection");
+    threadConnections.setLocalData(threadConnection);
     // 创建一个新的连接
-    connection = QSqlDatabase::addDatabase(databaseType, connectionName);
+    QSqlDatabase connection = QSqlDatabase::addDatabase(databaseType, threadConnection->name);
     // 设置sqlite数据库路径
     connection.setDatabaseName(databaseName);
+    connection.setConnectOptions(QString("QSQLITE_BUSY_TIMEOUT=%1").arg(kBusyTimeoutMs));
     if (!connection.open()) {
         qCritical() << "open database failed:" << connection.lastError().text();
-    } else {
-        QSqlQuery query(testStateSql, connection);
-        if (QSqlError::NoError != query.lastError().type()) {
-            qCritical() << "open database error:" << query.lastError().text();
-        }
+        return connection;
     }
 
+    // 数据库由 deepin-linglong 用户所有，用户进程也会读取，不能切换为 WAL 模式：
+    // 用户进程无法在该目录下创建 -wal/-shm 文件，写入进程关闭连接后读取会失败
+    QSqlQuery query(testStateSql, connection);
+    if (QSqlError::NoError != query.lastError().type()) {
+        qCritical() << "open database error:" << query.lastError().text();
+    }
+    // 之前的版本曾将数据库切换为 WAL 模式，有写权限的进程将其恢复为回滚日志
+    if (query.exec("PRAGMA journal_mode") && query.next()
+        && query.value(0).toString().compare("wal", Qt::CaseInsensitive) == 0
+        && !query.exec("PRAGMA journal_mode=DELETE")) {
+        qCDebug(database) << "restore journal mode failed:" << query.lastError().text();
+    }
     return connection;
 }
 
-void Connection::closeConnection(QSqlDatabase &connection)
+bool Connection::isReadOnly(const QString &sql)
 {
-    QMutexLocker locker(&mutex); // 加锁，加锁不成功则阻塞
-    QString connectionName = connection.connectionName();
-    connection.close();
-    connection = QSqlDatabase();
-    QSqlDatabase::removeDatabase(connectionName);
-    qCDebug(database) << "connectionNames:" << QSqlDatabase::connectionNames();
+    return sql.trimmed().startsWith("SELECT", Qt::CaseInsensitive);
 }
 
 QSqlQuery Connection::execute(const QString &sql)
 {
-    QMutexLocker locker(&mutex); // 加锁，加锁不成功则阻塞
+    if (isReadOnly(sql)) {
+        lock.lockForRead();
+    } else {
+        lock.lockForWrite();
+    }
 
     connection = getConnection();
     QSqlQuery query(sql, connection);
     if (QSqlError::NoError != query.lastError().type()) {
         qCritical() << "execute sql error:" << query.lastError().text();
     }
+    lock.unlock();
     return query;
 }
 
 QSqlQuery Connection::execute(const QString &sql, const QVariantMap &valueMap)
 {
-    QMutexLocker locker(&mutex);
+    if (isReadOnly(sql)) {
+        lock.lockForRead();
+    } else {
+        lock.lockForWrite();
+    }
+
     connection = getConnection();
     QSqlQuery query(connection);
     query.prepare(sql);
@@ -98,8 +146,60 @@ QSqlQuery Connection::execute(const QString &sql, const QVariantMap &valueMap)
     if (QSqlError::NoError != query.lastError().type()) {
         qCritical() << "execute pre sql error:" << query.lastError().text();
     }
+    lock.unlock();
     return query;
 }
 
+bool Connection::transaction()
+{
+    lock.lockForWrite();
+    connection = getConnection();
+    if (!connection.transaction()) {
+        qCritical() << "begin transaction error:" << connection.lastError().text();
+        lock.unlock();
+        return false;
+    }
+    inTransaction = true;
+    return true;
+}
+
+bool Connection::commit()
+{
+    if (!inTransaction) {
+        return false;
+    }
+    bool ret = connection.commit();
+    if (!ret) {
+        qCritical() << "commit error:" << connection.lastError().text();
+        connection.rollback();
+    }
+    inTransaction = false;
+    lock.unlock();
+    return ret;
+}
+
+bool Connection::rollback()
+{
+    if (!inTransaction) {
+        return false;
+    }
+    bool ret = connection.rollback();
+    inTransaction = false;
+    lock.unlock();
+    return ret;
+}
+
+qint64 Connection::dataVersion()
+{
+    QReadLocker locker(&lock);
+    connection = getConnection();
+    QSqlQuery query("PRAGMA data_version", connection);
+    if (!query.next()) {
+        qCritical() << "query data_version error:" << query.lastError().text();
+        return -1;
+    }
+    return query.value(0).toLongLong();
+}
+
 } // namespace util
 } // namespace linglong
@@ -10,6 +10,7 @@
 #include <QMutex>
 #include <QMutexLocker>
 #include <QQueue>
+#include <QReadWriteLock>
 #include <QString>
 #include <QtSql>
 
@@ -17,6 +18,23 @@
 
 namespace linglong {
 namespace util {
+/*
+ * 线程独占的数据库连接名称，保存在 QThreadStorage 中，线程退出时关闭并移除该连接。
+ * 名称带有进程内递增的序号，线程 id 被复用时也不会取到已退出线程的连接
+ */
+class ThreadConnection
+{
+public:
+    explicit ThreadConnection(const QString &prefix);
+    ~ThreadConnection();
+
+    const QString name;
+};
+
+/*
+ * 数据库访问对象，每个线程复用一个常驻的数据库连接，线程退出时关闭。
+ * 进程内查询可以并发执行，写入串行执行
+ */
 class Connection : public QObject
 {
     Q_OBJECT
@@ -27,9 +45,28 @@ public:
     QSqlQuery execute(const QString &sql); // 执行sql语句
     QSqlQuery execute(const QString &sql, const QVariantMap &valueMap);
 
+    /*
+     * 开始事务，提交或回滚前其它线程不能写入，未结束的事务在对象析构时回滚
+     *
+     * @return bool: true:成功 false:失败
+     */
+    bool transaction();
+    bool commit();
+    bool rollback();
+
+    /*
+     * 获取当前线程连接的数据版本，其它连接或进程提交修改后变化，本连接的写入不改变该值。
+     * 只能与同一线程之前获取的值比较
+     *
+     * @return qint64: 数据版本，失败时返回 -1
+     */
+    qint64 dataVersion();
+
 private:
-    QSqlDatabase getConnection();                   // 创建数据库连接
-    void closeConnection(QSqlDatabase &connection); // 关闭连接
+    QSqlDatabase getConnection(); // 获取当前线程的数据库连接
+
+    // 查询语句以读锁执行，其余语句以写锁执行
+    static bool isReadOnly(const QString &sql);
 
 private:
     QString databaseName; // 如果是 SQLite 则为数据库文件名
@@ -38,8 +75,10 @@ private:
     QString testStateSql; // 测试访问数据库的 SQL
 
     QSqlDatabase connection;
+    bool inTransaction = false;
 
-    static QMutex mutex;
+    // 进程内的读写锁，可重入，事务中的线程可以继续执行查询及写入
+    static QReadWriteLock lock;
 };
 } // namespace util
 } // namespace linglong
@@ -18,13 +18,12 @@ QNetworkAccessManager &networkMgr()
     return manager;
 }
 
-QNetworkReply *HttpRestClient::doRequest(const QByteArray &verb,
-                                         QNetworkRequest &request,
-                                         QIODevice *data,
-                                         QHttpMultiPart *multiPart,
-                                         const QByteArray &bytes)
+QNetworkReply *HttpRestClient::startRequest(const QByteArray &verb,
+                                            QNetworkRequest &request,
+                                            QIODevice *data,
+                                            QHttpMultiPart *multiPart,
+                                            const QByteArray &bytes)
 {
-    QEventLoop loop;
     request.setHeader(QNetworkRequest::UserAgentHeader, userAgent);
 
     if (multiPart == nullptr) {
@@ -40,7 +39,17 @@ QNetworkReply *HttpRestClient::doRequest(const QByteArray &verb,
     } else {
         reply = networkMgr().sendCustomRequest(request, verb, bytes);
     }
+    return reply;
+}
 
+QNetworkReply *HttpRestClient::doRequest(const QByteArray &verb,
+                                         QNetworkRequest &request,
+                                         QIODevice *data,
+                                         QHttpMultiPart *multiPart,
+                                         const QByteArray &bytes)
+{
+    QEventLoop loop;
+    auto reply = startRequest(verb, request, data, multiPart, bytes);
     QEventLoop::connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
     loop.exec();
     return reply;
@@ -78,5 +87,10 @@ QNetworkReply *HttpRestClient::put(QNetworkRequest &request, QHttpMultiPart *mul
     return doRequest("PUT", request, nullptr, multiPart, "");
 }
 
+QNetworkReply *HttpRestClient::putAsync(QNetworkRequest &request, QHttpMultiPart *multiPart)
+{
+    return startRequest("PUT", request, nullptr, multiPart, "");
+}
+
 } // namespace util
 } // namespace linglong
\ No newline at end of file
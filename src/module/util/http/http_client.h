@@ -28,9 +28,25 @@ public:
     QNetworkReply *put(QNetworkRequest &request, QHttpMultiPart *multiPart);
     QNetworkReply *del(QNetworkRequest &request);
 
+    /*
+     * 发起 PUT 请求后立即返回，不等待请求结束，可同时发起多个请求
+     *
+     * @param request: 请求
+     * @param multiPart: 请求内容，需保持有效直到 reply 结束
+     *
+     * @return QNetworkReply*: 请求对应的 reply，调用方等待 finished 信号并负责释放
+     */
+    QNetworkReply *putAsync(QNetworkRequest &request, QHttpMultiPart *multiPart);
+
     QString userAgent;
 
 private:
+    QNetworkReply *startRequest(const QByteArray &verb,
+                                QNetworkRequest &request,
+                                QIODevice *data,
+                                QHttpMultiPart *multiPart,
+                                const QByteArray &bytes);
+
     QNetworkReply *doRequest(const QByteArray &verb,
                              QNetworkRequest &request,
                              QIODevice *data,
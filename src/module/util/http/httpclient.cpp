@@ -7,17 +7,15 @@
 #include "httpclient.h"
 
 #include "module/util/file.h"
+#include "module/util/http/network_worker.h"
 #include "module/util/status_code.h"
 
 #include <sys/file.h>
 
 #include <QDebug>
-#include <QEventLoop>
 #include <QFile>
 #include <QJsonDocument>
 #include <QJsonObject>
-#include <QTimer>
-#include <QtNetwork/QNetworkAccessManager>
 #include <QtNetwork/QNetworkReply>
 #include <QtNetwork/QNetworkRequest>
 
@@ -91,6 +89,59 @@ size_t writeData(void *content, size_t size, size_t nmemb, void *stream)
     return size * nmemb;
 }
 
+namespace {
+
+// 查询软件包信息的超时时间
+const int kQueryTimeoutMs = 5 * 60 * 1000;
+
+/*
+ * 向服务器查询软件包数据，请求由常驻的网络线程发送，复用已建立的连接
+ *
+ * @param repoName: 查询仓库名
+ * @param repoUrl: 查询仓库Url地址
+ * @param pkgName: 软件包包名
+ * @param pkgVer: 软件包版本号
+ * @param pkgArch: 软件包对应的架构
+ * @param outMsg: 服务端返回的结果
+ *
+ * @return bool: true:成功 false:失败
+ */
+bool fuzzySearchApp(const QString &repoName,
+                    const QString &repoUrl,
+                    const QString &pkgName,
+                    const QString &pkgVer,
+                    const QString &pkgArch,
+                    QString &outMsg)
+{
+    QString postUrl = "";
+    if (repoUrl.endsWith("/")) {
+        postUrl = repoUrl + "api/v0/apps/fuzzysearchapp";
+    } else {
+        postUrl = repoUrl + "/api/v0/apps/fuzzysearchapp";
+    }
+
+    QJsonObject obj;
+    obj["AppId"] = pkgName;
+    obj["version"] = pkgVer;
+    obj["arch"] = pkgArch;
+    obj["repoName"] = repoName;
+    QNetworkRequest request((QUrl(postUrl)));
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
+    QJsonDocument doc(obj);
+
+    auto response = NETWORK_WORKER->sendAndWait(request, "POST", doc.toJson(), kQueryTimeoutMs);
+    outMsg = QString::fromUtf8(response.body);
+    if (response.error != QNetworkReply::NoError) {
+        outMsg.append(QString(" err info:%1").arg(response.errorString));
+        qCritical() << outMsg << response.error;
+        qDebug() << "queryRemoteApp param:" << postUrl << repoName << pkgName << pkgVer << pkgArch;
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
 /*
  * 向服务器请求指定包名\版本\架构数据
  *
@@ -114,45 +165,7 @@ bool HttpClient::queryRemoteApp(const QString &repoName,
         return false;
     }
 
-    QString postUrl = "";
-    if (configUrl.endsWith("/")) {
-        postUrl = configUrl + "api/v0/apps/fuzzysearchapp";
-    } else {
-        postUrl = configUrl + "/api/v0/apps/fuzzysearchapp";
-    }
-
-    bool ret = false;
-    QJsonObject obj;
-    obj["AppId"] = pkgName;
-    obj["version"] = pkgVer;
-    obj["arch"] = pkgArch;
-    obj["repoName"] = repoName;
-    const QUrl url(postUrl);
-    QNetworkRequest request(url);
-    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
-    QJsonDocument doc(obj);
-    QByteArray data = doc.toJson();
-    QNetworkAccessManager mgr;
-    QNetworkReply *reply = mgr.post(request, data);
-    QEventLoop eventLoop;
-    QObject::connect(reply, &QNetworkReply::finished, &eventLoop, [&]() {
-        outMsg = QString::fromUtf8(reply->readAll());
-        if (reply->error() == QNetworkReply::NoError) {
-            ret = true;
-        } else {
-            outMsg.append(QString(" err info:%1").arg(reply->errorString()));
-            qCritical() << outMsg << reply->error();
-            qDebug() << "queryRemoteApp param:" << postUrl << repoName << pkgName << pkgVer
-                     << pkgArch;
-            reply->abort();
-        }
-        reply->deleteLater();
-        eventLoop.quit();
-    });
-    // 5min 超时
-    QTimer::singleShot(5 * 60 * 1000, &eventLoop, &QEventLoop::quit);
-    eventLoop.exec();
-    return ret;
+    return fuzzySearchApp(repoName, configUrl, pkgName, pkgVer, pkgArch, outMsg);
 }
 
 /*
@@ -174,45 +187,7 @@ bool HttpClient::queryRemoteApp(const QString &repoName,
                                 const QString &pkgArch,
                                 QString &outMsg)
 {
-    QString postUrl = "";
-    if (repoUrl.endsWith("/")) {
-        postUrl = repoUrl + "api/v0/apps/fuzzysearchapp";
-    } else {
-        postUrl = repoUrl + "/api/v0/apps/fuzzysearchapp";
-    }
-
-    bool ret = false;
-    QJsonObject obj;
-    obj["AppId"] = pkgName;
-    obj["version"] = pkgVer;
-    obj["arch"] = pkgArch;
-    obj["repoName"] = repoName;
-    const QUrl url(postUrl);
-    QNetworkRequest request(url);
-    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
-    QJsonDocument doc(obj);
-    QByteArray data = doc.toJson();
-    QNetworkAccessManager mgr;
-    QNetworkReply *reply = mgr.post(request, data);
-    QEventLoop eventLoop;
-    QObject::connect(reply, &QNetworkReply::finished, &eventLoop, [&]() {
-        outMsg = QString::fromUtf8(reply->readAll());
-        if (reply->error() == QNetworkReply::NoError) {
-            ret = true;
-        } else {
-            outMsg.append(QString(" err info:%1").arg(reply->errorString()));
-            qCritical() << outMsg << reply->error();
-            qDebug() << "queryRemoteApp param:" << postUrl << repoName << pkgName << pkgVer
-                     << pkgArch;
-            reply->abort();
-        }
-        reply->deleteLater();
-        eventLoop.quit();
-    });
-    // 5min 超时
-    QTimer::singleShot(5 * 60 * 1000, &eventLoop, &QEventLoop::quit);
-    eventLoop.exec();
-    return ret;
+    return fuzzySearchApp(repoName, repoUrl, pkgName, pkgVer, pkgArch, outMsg);
 }
 
 /*
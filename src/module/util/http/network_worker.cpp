@@ -0,0 +1,133 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "network_worker.h"
+
+#include <QDebug>
+#include <QNetworkAccessManager>
+#include <QSemaphore>
+#include <QTimer>
+
+namespace linglong {
+namespace util {
+
+namespace {
+
+// 同一主机同时进行的请求数
+const int kMaxRequestsPerHost = 4;
+
+} // namespace
+
+NetworkWorker::NetworkWorker()
+{
+    thread.setObjectName("linglong-network");
+    moveToThread(&thread);
+    thread.start();
+}
+
+NetworkWorker::~NetworkWorker()
+{
+    if (thread.isRunning()) {
+        // QNetworkAccessManager 需要在所属线程中释放
+        QMetaObject::invokeMethod(this, "shutdown", Qt::BlockingQueuedConnection);
+        thread.quit();
+        thread.wait();
+    }
+}
+
+void NetworkWorker::shutdown()
+{
+    delete manager;
+    manager = nullptr;
+}
+
+void NetworkWorker::send(const QNetworkRequest &request,
+                         const QByteArray &verb,
+                         const QByteArray &body,
+                         int timeoutMs,
+                         const HttpCallback &callback)
+{
+    QNetworkRequest req(request);
+    req.setAttribute(QNetworkRequest::Http2AllowedAttribute, true);
+    req.setAttribute(QNetworkRequest::FollowRedirectsAttribute, true);
+    {
+        QMutexLocker locker(&queueMutex);
+        queues[req.url().host()].enqueue(PendingRequest{ req, verb, body, timeoutMs, callback });
+    }
+    QMetaObject::invokeMethod(this, "dispatch", Qt::QueuedConnection);
+}
+
+HttpResponse NetworkWorker::sendAndWait(const QNetworkRequest &request,
+                                        const QByteArray &verb,
+                                        const QByteArray &body,
+                                        int timeoutMs)
+{
+    Q_ASSERT(QThread::currentThread() != &thread);
+
+    HttpResponse result;
+    QSemaphore finished;
+    send(request, verb, body, timeoutMs, [&result, &finished](const HttpResponse &response) {
+        result = response;
+        finished.release();
+    });
+    finished.acquire();
+    return result;
+}
+
+void NetworkWorker::dispatch()
+{
+    if (manager == nullptr) {
+        manager = new QNetworkAccessManager();
+    }
+
+    QList<QPair<QString, PendingRequest>> ready;
+    {
+        QMutexLocker locker(&queueMutex);
+        for (auto iter = queues.begin(); iter != queues.end(); ++iter) {
+            int &running = runningPerHost[iter.key()];
+            while (running < kMaxRequestsPerHost && !iter.value().isEmpty()) {
+                ready.append(qMakePair(iter.key(), iter.value().dequeue()));
+                ++running;
+            }
+        }
+    }
+
+    for (const auto &item : ready) {
+        start(item.first, item.second);
+    }
+}
+
+void NetworkWorker::start(const QString &host, const PendingRequest &pending)
+{
+    auto reply = manager->sendCustomRequest(pending.request, pending.verb, pending.body);
+
+    auto timer = new QTimer(reply);
+    timer->setSingleShot(true);
+    connect(timer, &QTimer::timeout, reply, [reply]() {
+        qWarning() << "request" << reply->url() << "timeout";
+        reply->abort();
+    });
+    timer->start(pending.timeoutMs);
+
+    auto callback = pending.callback;
+    connect(reply, &QNetworkReply::finished, this, [this, reply, host, callback]() {
+        HttpResponse response;
+        response.error = reply->error();
+        response.errorString = reply->errorString();
+        response.statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        response.body = reply->readAll();
+        reply->deleteLater();
+
+        --runningPerHost[host];
+        if (callback) {
+            callback(response);
+        }
+        dispatch();
+    });
+}
+
+} // namespace util
+} // namespace linglong
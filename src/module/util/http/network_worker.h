@@ -0,0 +1,115 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_SRC_MODULE_UTIL_HTTP_NETWORK_WORKER_H_
+#define LINGLONG_SRC_MODULE_UTIL_HTTP_NETWORK_WORKER_H_
+
+#include "module/util/singleton.h"
+
+#include <QByteArray>
+#include <QMap>
+#include <QMutex>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QObject>
+#include <QQueue>
+#include <QThread>
+
+#include <functional>
+
+class QNetworkAccessManager;
+
+namespace linglong {
+namespace util {
+
+struct HttpResponse
+{
+    // 网络错误，NoError 时请求完成(不代表服务端返回成功)
+    QNetworkReply::NetworkError error = QNetworkReply::NoError;
+    QString errorString;
+    // http 状态码
+    int statusCode = 0;
+    QByteArray body;
+};
+
+typedef std::function<void(const HttpResponse &response)> HttpCallback;
+
+/*
+ * 常驻的网络请求线程，所有请求共用一个 QNetworkAccessManager，同一主机的连接及 TLS 会话被复用，
+ * 服务端支持时使用 HTTP/2。同一主机同时进行的请求数受限，其余请求排队
+ */
+class NetworkWorker : public QObject, public linglong::util::Singleton<NetworkWorker>
+{
+    Q_OBJECT
+
+    friend class linglong::util::Singleton<NetworkWorker>;
+
+public:
+    /*
+     * 发起请求，立即返回，可在任意线程调用
+     *
+     * @param request: 请求
+     * @param verb: 请求方法，如 GET、POST
+     * @param body: 请求内容
+     * @param timeoutMs: 超时时间，超时后请求被中止
+     * @param callback: 请求结束后在网络线程中调用，不能阻塞
+     */
+    void send(const QNetworkRequest &request,
+              const QByteArray &verb,
+              const QByteArray &body,
+              int timeoutMs,
+              const HttpCallback &callback);
+
+    /*
+     * 发起请求并等待结果，调用线程阻塞在信号量上，不运行嵌套的事件循环。
+     * 只能在工作线程中调用，不能在网络线程或处理 D-Bus 调用的主线程中调用
+     *
+     * @param request: 请求
+     * @param verb: 请求方法，如 GET、POST
+     * @param body: 请求内容
+     * @param timeoutMs: 超时时间，超时后请求被中止
+     *
+     * @return HttpResponse: 请求结果
+     */
+    HttpResponse sendAndWait(const QNetworkRequest &request,
+                             const QByteArray &verb,
+                             const QByteArray &body,
+                             int timeoutMs);
+
+private Q_SLOTS:
+    void dispatch();
+    void shutdown();
+
+private:
+    NetworkWorker();
+    ~NetworkWorker() override;
+
+    struct PendingRequest
+    {
+        QNetworkRequest request;
+        QByteArray verb;
+        QByteArray body;
+        int timeoutMs;
+        HttpCallback callback;
+    };
+
+    void start(const QString &host, const PendingRequest &pending);
+
+    QThread thread;
+    // 仅在网络线程中访问
+    QNetworkAccessManager *manager = nullptr;
+    QMap<QString, int> runningPerHost;
+
+    // 保护待发送的请求，key 为主机名
+    QMutex queueMutex;
+    QMap<QString, QQueue<PendingRequest>> queues;
+};
+
+} // namespace util
+} // namespace linglong
+
+#define NETWORK_WORKER linglong::util::NetworkWorker::instance()
+#endif
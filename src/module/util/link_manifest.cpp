@@ -0,0 +1,176 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "link_manifest.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSet>
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace linglong {
+namespace util {
+
+namespace {
+
+// 删除 dirFd 下的软链接，非软链接的文件保持不变
+bool removeLink(int dirFd, const QByteArray &path)
+{
+    struct stat st;
+    if (fstatat(dirFd, path.constData(), &st, AT_SYMLINK_NOFOLLOW) != 0) {
+        return errno == ENOENT;
+    }
+    if (!S_ISLNK(st.st_mode)) {
+        qWarning() << "skip removing non-symlink" << path;
+        return true;
+    }
+    if (unlinkat(dirFd, path.constData(), 0) != 0) {
+        qWarning() << "unlink" << path << "failed:" << strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+// 逐级创建 dirFd 下的父目录，已确认存在的目录记录在 createdDirs 中
+bool ensureParentDirs(int dirFd, const QString &path, QSet<QString> &createdDirs)
+{
+    int pos = 0;
+    while ((pos = path.indexOf('/', pos + 1)) > 0) {
+        const QString dir = path.left(pos);
+        if (createdDirs.contains(dir)) {
+            continue;
+        }
+        if (mkdirat(dirFd, dir.toLocal8Bit().constData(), 0755) != 0 && errno != EEXIST) {
+            qWarning() << "mkdir" << dir << "failed:" << strerror(errno);
+            return false;
+        }
+        createdDirs.insert(dir);
+    }
+    return true;
+}
+
+} // namespace
+
+QStringList buildLinkManifest(const QString &srcRoot)
+{
+    QStringList manifest;
+    QDir srcDir(srcRoot);
+    if (!srcDir.exists()) {
+        return manifest;
+    }
+
+    QDirIterator it(srcRoot,
+                    QDir::Files | QDir::NoDotAndDotDot,
+                    QDirIterator::Subdirectories | QDirIterator::FollowSymlinks);
+    while (it.hasNext()) {
+        it.next();
+        manifest.append(srcDir.relativeFilePath(it.filePath()));
+    }
+    manifest.sort();
+    return manifest;
+}
+
+bool loadLinkManifest(const QString &path, QStringList &manifest)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    manifest.clear();
+    while (!file.atEnd()) {
+        auto line = QString::fromUtf8(file.readLine()).trimmed();
+        if (!line.isEmpty()) {
+            manifest.append(line);
+        }
+    }
+    return true;
+}
+
+bool saveLinkManifest(const QString &path, const QStringList &manifest)
+{
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    // 先写入临时文件再替换，中断时不会留下不完整的清单
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "open" << path << "failed:" << file.errorString();
+        return false;
+    }
+    for (const auto &entry : manifest) {
+        file.write(entry.toUtf8());
+        file.write("\n");
+    }
+    return file.commit();
+}
+
+bool applyLinkManifest(const QString &dstRoot,
+                       const QStringList &oldManifest,
+                       const QString &srcRoot,
+                       const QStringList &newManifest)
+{
+    QDir().mkpath(dstRoot);
+    int dirFd = open(dstRoot.toLocal8Bit().constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd < 0) {
+        qWarning() << "open" << dstRoot << "failed:" << strerror(errno);
+        return false;
+    }
+
+    bool ret = true;
+    QSet<QString> newEntries;
+    for (const auto &entry : newManifest) {
+        newEntries.insert(entry);
+    }
+    for (const auto &entry : oldManifest) {
+        if (!newEntries.contains(entry)) {
+            ret = removeLink(dirFd, entry.toLocal8Bit()) && ret;
+        }
+    }
+
+    // 链接使用相对路径，目标为 ../(与文件深度相同) + dstRoot 到 srcRoot 的相对路径 + 文件路径
+    const QString srcRelative = QDir(dstRoot).relativeFilePath(QDir::cleanPath(srcRoot));
+    QSet<QString> createdDirs;
+    QByteArray current(PATH_MAX, '\0');
+    for (const auto &entry : newManifest) {
+        const auto path = entry.toLocal8Bit();
+        const QString targetPath =
+                QString("../").repeated(entry.count('/')) + srcRelative + "/" + entry;
+        const auto target = targetPath.toLocal8Bit();
+
+        auto len = readlinkat(dirFd, path.constData(), current.data(), current.size());
+        if (len >= 0) {
+            if (QByteArray(current.constData(), static_cast<int>(len)) == target) {
+                continue;
+            }
+            unlinkat(dirFd, path.constData(), 0);
+        } else if (errno == ENOENT && !ensureParentDirs(dirFd, entry, createdDirs)) {
+            ret = false;
+            continue;
+        }
+
+        if (symlinkat(target.constData(), dirFd, path.constData()) != 0) {
+            qWarning() << "link" << entry << "failed:" << strerror(errno);
+            ret = false;
+        }
+    }
+
+    close(dirFd);
+    return ret;
+}
+
+} // namespace util
+} // namespace linglong
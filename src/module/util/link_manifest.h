@@ -0,0 +1,61 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_SRC_MODULE_UTIL_LINK_MANIFEST_H_
+#define LINGLONG_SRC_MODULE_UTIL_LINK_MANIFEST_H_
+
+#include <QString>
+#include <QStringList>
+
+namespace linglong {
+namespace util {
+
+/*
+ * 链接清单记录软件包导出目录下所有文件的相对路径，安装时生成，切换版本时按新旧清单的
+ * 差异增删 entries/share 下的软链接，不需要再遍历旧版本的目录树
+ */
+
+/*!
+ * 遍历导出目录，生成排序后的文件相对路径清单
+ * @param srcRoot 软件包导出目录
+ * @return QStringList 文件相对路径清单
+ */
+QStringList buildLinkManifest(const QString &srcRoot);
+
+/*!
+ * 读取链接清单
+ * @param path 清单文件路径
+ * @param manifest 读取结果
+ * @return bool: true:成功 false:失败
+ */
+bool loadLinkManifest(const QString &path, QStringList &manifest);
+
+/*!
+ * 保存链接清单
+ * @param path 清单文件路径
+ * @param manifest 文件相对路径清单
+ * @return bool: true:成功 false:失败
+ */
+bool saveLinkManifest(const QString &path, const QStringList &manifest);
+
+/*!
+ * 按新旧清单的差异更新目标目录中的软链接，旧清单独有的链接被删除，新清单中的链接指向新的
+ * 导出目录，目标已正确的链接保持不变
+ * @param dstRoot 目标目录
+ * @param oldManifest 旧版本清单，没有旧版本时为空
+ * @param srcRoot 新版本导出目录，只删除链接时为空
+ * @param newManifest 新版本清单
+ * @return bool: true:成功 false:部分链接更新失败
+ */
+bool applyLinkManifest(const QString &dstRoot,
+                       const QStringList &oldManifest,
+                       const QString &srcRoot,
+                       const QStringList &newManifest);
+
+} // namespace util
+} // namespace linglong
+
+#endif
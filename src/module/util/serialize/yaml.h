@@ -148,6 +148,54 @@ T *formYaml(const YAML::Node &doc)
     return m;
 }
 
+/*
+ * 与 formYaml 相同，输入为已经转换好的 YAML 文档内容，用于缓存解析结果后重复创建对象
+ *
+ * @param doc: YAML 文档转换得到的 QVariantMap
+ *
+ * @return T *: 创建的对象
+ */
+template<typename T>
+T *formYamlVariant(const QVariantMap &doc)
+{
+    auto m = new T;
+    auto mo = m->metaObject();
+    for (int i = mo->propertyOffset(); i < mo->propertyCount(); ++i) {
+        auto k = mo->property(i).name();
+        auto t = mo->property(i).type();
+
+        if (!doc.contains(k)) {
+            continue;
+        }
+
+        QVariant v = doc.value(k);
+        // set parent
+        if (QVariant::UserType == t) {
+            switch (v.type()) {
+            case QVariant::Map: {
+                auto map = v.toMap();
+                map[Q_SERIALIZE_PARENT_KEY] = QVariant::fromValue(m);
+                m->setProperty(k, map);
+                break;
+            }
+            case QVariant::List: {
+                auto list = v.toList();
+                list.push_front(QVariant::fromValue(m));
+                m->setProperty(k, list);
+                break;
+            }
+            default:
+                m->setProperty(k, v);
+            }
+        } else {
+            m->setProperty(k, v);
+        }
+    }
+
+    m->onPostSerialize();
+    return m;
+}
+
 template<typename T>
 YAML::Node toYaml(T *m)
 {
@@ -0,0 +1,154 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "trace.h"
+
+#include <QJsonObject>
+
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace linglong {
+namespace util {
+
+namespace {
+
+// 保存的启动记录数
+const int kMaxTraces = 64;
+
+thread_local LaunchTrace *currentTrace = nullptr;
+
+quint64 currentThreadId()
+{
+    static thread_local quint64 tid = static_cast<quint64>(syscall(SYS_gettid));
+    return tid;
+}
+
+} // namespace
+
+LaunchTrace::LaunchTrace(const QString &name)
+    : name(name)
+    , startNs(TraceRecorder::now())
+{
+    spans.reserve(32);
+}
+
+TraceAttach::TraceAttach(LaunchTrace *trace)
+    : previous(currentTrace)
+{
+    currentTrace = trace;
+}
+
+TraceAttach::~TraceAttach()
+{
+    currentTrace = previous;
+}
+
+TraceScope::TraceScope(const char *name)
+    : trace(currentTrace)
+{
+    if (trace == nullptr) {
+        return;
+    }
+    index = trace->spans.size();
+    trace->spans.append(
+            TraceSpan{ name, TraceRecorder::now(), 0, trace->depth, currentThreadId() });
+    ++trace->depth;
+}
+
+TraceScope::~TraceScope()
+{
+    if (trace == nullptr) {
+        return;
+    }
+    --trace->depth;
+    auto &span = trace->spans[index];
+    span.durationNs = TraceRecorder::now() - span.startNs;
+}
+
+qint64 TraceRecorder::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<qint64>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+void TraceRecorder::record(const std::shared_ptr<LaunchTrace> &trace)
+{
+    QMutexLocker locker(&mutex);
+    recent.append(trace);
+    while (recent.size() > kMaxTraces) {
+        recent.removeFirst();
+    }
+}
+
+QList<std::shared_ptr<const LaunchTrace>> TraceRecorder::traces(const QString &id) const
+{
+    QMutexLocker locker(&mutex);
+    if (id.isEmpty()) {
+        return recent;
+    }
+
+    QList<std::shared_ptr<const LaunchTrace>> result;
+    for (const auto &trace : recent) {
+        if (trace->id == id) {
+            result.append(trace);
+        }
+    }
+    return result;
+}
+
+QJsonArray TraceRecorder::toBreakdown(const QList<std::shared_ptr<const LaunchTrace>> &traces)
+{
+    QJsonArray result;
+    for (const auto &trace : traces) {
+        QJsonArray spans;
+        qint64 endNs = trace->startNs;
+        for (const auto &span : trace->spans) {
+            QJsonObject obj;
+            obj["name"] = QString::fromLatin1(span.name);
+            obj["depth"] = span.depth;
+            obj["start"] = (span.startNs - trace->startNs) / 1000;
+            obj["duration"] = span.durationNs / 1000;
+            spans.append(obj);
+            endNs = qMax(endNs, span.startNs + span.durationNs);
+        }
+
+        QJsonObject obj;
+        obj["id"] = trace->id;
+        obj["name"] = trace->name;
+        obj["duration"] = (endNs - trace->startNs) / 1000;
+        obj["spans"] = spans;
+        result.append(obj);
+    }
+    return result;
+}
+
+QJsonArray TraceRecorder::toChromeTrace(const QList<std::shared_ptr<const LaunchTrace>> &traces)
+{
+    QJsonArray events;
+    const qint64 pid = getpid();
+    for (const auto &trace : traces) {
+        for (const auto &span : trace->spans) {
+            QJsonObject event;
+            event["name"] = QString::fromLatin1(span.name);
+            event["cat"] = "launch";
+            event["ph"] = "X";
+            // trace event 的时间单位为微秒
+            event["ts"] = static_cast<double>(span.startNs) / 1000;
+            event["dur"] = static_cast<double>(span.durationNs) / 1000;
+            event["pid"] = pid;
+            event["tid"] = static_cast<qint64>(span.threadId);
+            event["args"] = QJsonObject{ { "id", trace->id }, { "app", trace->name } };
+            events.append(event);
+        }
+    }
+    return events;
+}
+
+} // namespace util
+} // namespace linglong
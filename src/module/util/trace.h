@@ -0,0 +1,142 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_SRC_MODULE_UTIL_TRACE_H_
+#define LINGLONG_SRC_MODULE_UTIL_TRACE_H_
+
+#include "module/util/singleton.h"
+
+#include <QJsonArray>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+#include <memory>
+
+namespace linglong {
+namespace util {
+
+/*
+ * 一段耗时记录，时间为单调时钟的纳秒数
+ */
+struct TraceSpan
+{
+    const char *name;
+    qint64 startNs;
+    qint64 durationNs;
+    // 嵌套层级，0 为最外层
+    int depth;
+    quint64 threadId;
+};
+
+/*
+ * 一次应用启动的全部耗时记录。同一时间只在一个线程中记录，不加锁
+ */
+class LaunchTrace
+{
+public:
+    explicit LaunchTrace(const QString &name);
+
+    // 启动完成后设置为容器id
+    QString id;
+    QString name;
+    qint64 startNs;
+    QVector<TraceSpan> spans;
+    int depth = 0;
+};
+
+/*
+ * 在作用域内将当前线程的耗时记录写入 trace，离开作用域时恢复
+ */
+class TraceAttach
+{
+public:
+    explicit TraceAttach(LaunchTrace *trace);
+    ~TraceAttach();
+
+private:
+    LaunchTrace *previous;
+};
+
+/*
+ * 记录作用域的耗时，当前线程没有关联 trace 时不做任何事
+ */
+class TraceScope
+{
+public:
+    explicit TraceScope(const char *name);
+    ~TraceScope();
+
+private:
+    LaunchTrace *trace;
+    int index = -1;
+};
+
+/*
+ * 保存最近的启动记录，供 AppManager 查询
+ */
+class TraceRecorder : public linglong::util::Singleton<TraceRecorder>
+{
+    friend class linglong::util::Singleton<TraceRecorder>;
+
+public:
+    // 单调时钟当前时间，单位纳秒
+    static qint64 now();
+
+    /*
+     * 保存一次启动记录，超过上限时丢弃最早的记录
+     *
+     * @param trace: 启动记录
+     */
+    void record(const std::shared_ptr<LaunchTrace> &trace);
+
+    /*
+     * 查询启动记录
+     *
+     * @param id: 容器id，为空时返回全部记录
+     *
+     * @return QList: 启动记录，按启动时间排列
+     */
+    QList<std::shared_ptr<const LaunchTrace>> traces(const QString &id) const;
+
+    /*
+     * 转换为各阶段耗时，时间单位为微秒，start 相对于启动开始时间
+     *
+     * @param traces: 启动记录
+     *
+     * @return QJsonArray: [{id, name, duration, spans: [{name, depth, start, duration}]}]
+     */
+    static QJsonArray toBreakdown(const QList<std::shared_ptr<const LaunchTrace>> &traces);
+
+    /*
+     * 转换为 Chrome trace event 格式，可以在 chrome://tracing 或 Perfetto 中打开
+     *
+     * @param traces: 启动记录
+     *
+     * @return QJsonArray: trace event 列表
+     */
+    static QJsonArray toChromeTrace(const QList<std::shared_ptr<const LaunchTrace>> &traces);
+
+private:
+    TraceRecorder() = default;
+    ~TraceRecorder() override = default;
+
+    mutable QMutex mutex;
+    QList<std::shared_ptr<const LaunchTrace>> recent;
+};
+
+} // namespace util
+} // namespace linglong
+
+#define LINGLONG_TRACE_CONCAT_IMPL(a, b) a##b
+#define LINGLONG_TRACE_CONCAT(a, b) LINGLONG_TRACE_CONCAT_IMPL(a, b)
+// 记录当前作用域的耗时，name 必须是字符串常量
+#define LINGLONG_TRACE_SCOPE(name) \
+    linglong::util::TraceScope LINGLONG_TRACE_CONCAT(traceScope, __LINE__)(name)
+
+#define TRACE_RECORDER linglong::util::TraceRecorder::instance()
+#endif
@@ -6,41 +6,200 @@
 
 #include "job.h"
 
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QWaitCondition>
+
+namespace {
+
+// 同一阶段内 Progress 信号的最小间隔
+const qint64 kProgressIntervalMs = 250;
+
+thread_local Job *currentJob = nullptr;
+
+} // namespace
+
 class JobPrivate
 {
 public:
     explicit JobPrivate(Job *parent)
         : q_ptr(parent)
+        , cancellable(g_cancellable_new())
     {
     }
 
+    ~JobPrivate() { g_object_unref(cancellable); }
+
     Job *q_ptr = nullptr;
 
-    int progress;
+    QString id;
+    std::function<linglong::service::Reply()> func;
+
+    // 保护以下进度信息，进度可能在多个下载线程中更新
+    mutable QMutex mutex;
+    QString stage = "pending";
+    QElapsedTimer lastEmit;
+
+    // 暂停时取消当前的 cancellable，恢复时更换新的，已取消的 cancellable 不能重复使用
+    GCancellable *cancellable = nullptr;
+    bool paused = false;
+    bool cancelled = false;
+    QWaitCondition resumed;
 };
 
-Job::Job(std::function<void()> f)
-    : func(f)
-    , dd_ptr(new JobPrivate(this))
+Job::Job(const QString &id, std::function<linglong::service::Reply()> f)
+    : dd_ptr(new JobPrivate(this))
+{
+    Q_D(Job);
+    d->id = id;
+    d->func = f;
+}
+
+Job *Job::current()
 {
+    return currentJob;
 }
 
-int Job::Progress() const
+QString Job::id() const
 {
     Q_D(const Job);
-    return d->progress;
+    return d->id;
 }
 
 QString Job::Status() const
 {
-    return QString();
+    Q_D(const Job);
+    QMutexLocker locker(&d->mutex);
+    return d->stage;
+}
+
+void Job::updateProgress(qulonglong bytesFetched,
+                         qulonglong bytesTotal,
+                         uint objectsFetched,
+                         uint objectsTotal,
+                         const QString &stage)
+{
+    Q_D(Job);
+    {
+        QMutexLocker locker(&d->mutex);
+        // 暂停后被中断的步骤可能还会上报进度
+        if (d->paused && stage != "paused") {
+            return;
+        }
+        bool stageChanged = d->stage != stage;
+        bool done = objectsTotal > 0 && objectsFetched == objectsTotal;
+        if (!stageChanged && !done && d->lastEmit.isValid()
+            && d->lastEmit.elapsed() < kProgressIntervalMs) {
+            return;
+        }
+        d->stage = stage;
+        d->lastEmit.start();
+    }
+    Q_EMIT this->Progress(bytesFetched, bytesTotal, objectsFetched, objectsTotal, stage);
+}
+
+void Job::updateStage(const QString &stage)
+{
+    updateProgress(0, 0, 0, 0, stage);
+}
+
+GCancellable *Job::cancellable() const
+{
+    Q_D(const Job);
+    QMutexLocker locker(&d->mutex);
+    return G_CANCELLABLE(g_object_ref(d->cancellable));
+}
+
+bool Job::pause()
+{
+    Q_D(Job);
+    {
+        QMutexLocker locker(&d->mutex);
+        if (d->cancelled || d->paused || d->stage == "finished") {
+            return false;
+        }
+        d->paused = true;
+        g_cancellable_cancel(d->cancellable);
+    }
+    updateStage("paused");
+    return true;
+}
+
+bool Job::resume()
+{
+    Q_D(Job);
+    {
+        QMutexLocker locker(&d->mutex);
+        if (d->cancelled || !d->paused) {
+            return false;
+        }
+        g_object_unref(d->cancellable);
+        d->cancellable = g_cancellable_new();
+        d->paused = false;
+        d->resumed.wakeAll();
+    }
+    updateStage("running");
+    return true;
+}
+
+void Job::cancel()
+{
+    Q_D(Job);
+    QMutexLocker locker(&d->mutex);
+    d->cancelled = true;
+    d->paused = false;
+    g_cancellable_cancel(d->cancellable);
+    d->resumed.wakeAll();
+}
+
+bool Job::isCancelled() const
+{
+    Q_D(const Job);
+    QMutexLocker locker(&d->mutex);
+    return d->cancelled;
+}
+
+bool Job::runStep(Job *job, const std::function<bool(GCancellable *cancellable)> &step)
+{
+    if (job == nullptr) {
+        return step(nullptr);
+    }
+
+    while (true) {
+        g_autoptr(GCancellable) cancellable = job->cancellable();
+        if (step(cancellable)) {
+            return true;
+        }
+
+        // 非暂停导致的失败直接返回，暂停时等待恢复或取消
+        QMutexLocker locker(&job->dd_ptr->mutex);
+        if (!job->dd_ptr->paused) {
+            return false;
+        }
+        while (job->dd_ptr->paused && !job->dd_ptr->cancelled) {
+            job->dd_ptr->resumed.wait(&job->dd_ptr->mutex);
+        }
+        if (job->dd_ptr->cancelled) {
+            return false;
+        }
+        qInfo() << "job" << job->dd_ptr->id << "resumed";
+    }
 }
 
 void Job::run()
 {
-    func();
-    Q_EMIT this->Finish();
-    this->deleteLater();
+    Q_D(Job);
+    currentJob = this;
+    updateStage("running");
+    auto reply = d->func();
+    currentJob = nullptr;
+
+    {
+        QMutexLocker locker(&d->mutex);
+        d->stage = "finished";
+    }
+    Q_EMIT this->Finish(reply.code, reply.message);
 }
 
 Job::~Job() = default;
@@ -7,28 +7,114 @@
 #ifndef LINGLONG_SRC_PACKAGE_MANAGER_IMPL_JOB_H_
 #define LINGLONG_SRC_PACKAGE_MANAGER_IMPL_JOB_H_
 
+#include "module/dbus_ipc/reply.h"
+
+#include <gio/gio.h>
+
+#include <QObject>
 #include <QScopedPointer>
-#include <QThread>
+
+#include <functional>
 
 class JobPrivate;
 
-class Job : public QThread
+/**
+ * @brief 后台任务，注册在 /org/deepin/linglong/Job/List/{jobId}
+ * @details 任务执行过程中以 Progress 信号推送进度，同一阶段内的进度信号做了限流，
+ *          结束时发送 Finish 信号，客户端订阅信号即可，不需要轮询。暂停及取消通过 GCancellable
+ *          中断正在进行的下载或签出，暂停的步骤在恢复后重新执行
+ */
+class Job : public QObject
 {
     Q_OBJECT
 public:
-    Job(std::function<void()> f);
+    Job(const QString &id, std::function<linglong::service::Reply()> f);
     ~Job() override;
 
+    /**
+     * @brief 获取当前线程正在执行的任务
+     *
+     * @return Job* 不在任务中执行时为空
+     */
+    static Job *current();
+
+    QString id() const;
+
+    /**
+     * @brief 在调用线程中执行任务，结束后发送 Finish 信号
+     */
+    void run();
+
+    /**
+     * @brief 更新任务进度，阶段变化或距上次发送超过限流间隔时才发送 Progress 信号
+     *
+     * @param bytesFetched 已下载字节数
+     * @param bytesTotal 需要下载的字节数，未知时为0
+     * @param objectsFetched 已下载的对象数
+     * @param objectsTotal 需要下载的对象数，未知时为0
+     * @param stage 当前阶段
+     */
+    void updateProgress(qulonglong bytesFetched,
+                        qulonglong bytesTotal,
+                        uint objectsFetched,
+                        uint objectsTotal,
+                        const QString &stage);
+
+    /**
+     * @brief 更新任务阶段
+     *
+     * @param stage 当前阶段
+     */
+    void updateStage(const QString &stage);
+
+    /**
+     * @brief 获取当前步骤使用的 GCancellable，每次恢复后都会更换
+     *
+     * @return GCancellable* 新增引用，调用者负责释放
+     */
+    GCancellable *cancellable() const;
+
+    /**
+     * @brief 暂停任务，中断当前步骤
+     *
+     * @return bool 任务已结束或已取消时返回 false
+     */
+    bool pause();
+
+    /**
+     * @brief 恢复暂停的任务
+     *
+     * @return bool 任务未暂停时返回 false
+     */
+    bool resume();
+
+    /**
+     * @brief 取消任务，中断当前步骤并唤醒等待恢复的任务
+     */
+    void cancel();
+
+    bool isCancelled() const;
+
+    /**
+     * @brief 执行任务中可中断的步骤，步骤因暂停中断时等待恢复后重新执行
+     *
+     * @param job 当前任务，为空时直接执行
+     * @param step 步骤，参数为本次执行使用的 GCancellable
+     *
+     * @return bool 步骤执行成功返回 true，失败或任务被取消时返回 false
+     */
+    static bool runStep(Job *job, const std::function<bool(GCancellable *cancellable)> &step);
+
 public Q_SLOTS:
     QString Status() const;
-    int Progress() const;
-    void run() override;
 
 Q_SIGNALS: // SIGNALS
-    void Finish();
-
-public:
-    std::function<void()> func;
+    void Progress(qulonglong bytesFetched,
+                  qulonglong bytesTotal,
+                  uint objectsFetched,
+                  uint objectsTotal,
+                  const QString &stage);
+    void Finish(int code, const QString &message);
 
 private:
     QScopedPointer<JobPrivate> dd_ptr;
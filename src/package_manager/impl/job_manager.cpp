@@ -7,12 +7,20 @@
 #include "job_manager.h"
 
 #include "job.h"
+#include "module/jobadaptor.h"
 #include "module/repo/ostree_repohelper.h"
 
 #include <QDBusConnection>
-#include <QProcess>
+#include <QMap>
+#include <QMutex>
 #include <QTimer>
-#include <QUuid>
+
+namespace {
+
+// 任务结束后保留的时间
+const int kFinishedJobKeepMs = 1000 * 30;
+
+} // namespace
 
 class JobManagerPrivate
 {
@@ -23,20 +31,74 @@ public:
     }
 
     JobManager *q_ptr = nullptr;
+
+    QMutex mutex;
+    QMap<QString, Job *> jobs;
 };
 
-JobManager::JobManager() = default;
+JobManager::JobManager()
+    : dd_ptr(new JobManagerPrivate(this))
+{
+}
 
 JobManager::~JobManager() = default;
 
-QString JobManager::CreateJob(std::function<void()> f)
+QString JobManager::jobPath(const QString &jobId)
 {
-    auto jobId = QUuid::createUuid().toString(QUuid::Id128);
-    auto jobPath = "/org/deepin/linglong/Job/List/" + jobId;
-    auto jr = new Job(f);
-    jr->start();
+    // dbus 对象路径只允许字母、数字及下划线，其余字节(包括下划线)转义为 _xx，不同的 jobId 不会冲突
+    QString name;
+    for (const char ch : jobId.toUtf8()) {
+        if ((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9')) {
+            name.append(QLatin1Char(ch));
+        } else {
+            name.append(QString("_%1").arg(static_cast<uchar>(ch), 2, 16, QLatin1Char('0')));
+        }
+    }
+    if (name.isEmpty()) {
+        name = "_";
+    }
+    return "/org/deepin/linglong/Job/List/" + name;
+}
 
-    return jobId;
+Job *JobManager::CreateJob(const QString &jobId, std::function<linglong::service::Reply()> f)
+{
+    Q_D(JobManager);
+
+    QMutexLocker locker(&d->mutex);
+    auto path = jobPath(jobId);
+    auto existing = d->jobs.value(jobId);
+    if (existing != nullptr) {
+        if (existing->Status() != "finished") {
+            qWarning() << "job" << jobId << "already exists";
+            return nullptr;
+        }
+        // 已结束的任务直接替换
+        QDBusConnection::systemBus().unregisterObject(path);
+        d->jobs.remove(jobId);
+    }
+
+    auto job = new Job(jobId, f);
+    new JobAdaptor(job);
+    if (!QDBusConnection::systemBus().registerObject(path, job)) {
+        qWarning() << "register job" << path << "failed";
+    }
+    d->jobs.insert(jobId, job);
+
+    QObject::connect(job, &Job::Finish, this, [this, job, jobId, path]() {
+        QTimer::singleShot(kFinishedJobKeepMs, this, [this, job, jobId, path]() {
+            Q_D(JobManager);
+            {
+                QMutexLocker locker(&d->mutex);
+                if (d->jobs.value(jobId) == job) {
+                    QDBusConnection::systemBus().unregisterObject(path);
+                    d->jobs.remove(jobId);
+                }
+            }
+            job->deleteLater();
+        });
+    });
+
+    return job;
 }
 
 // dbus-send --system --type=method_call --print-reply --dest=org.deepin.linglong.PackageManager
@@ -48,31 +110,14 @@ void JobManager::Start(const QString &jobId)
         return;
     }
 
-    int processId = OSTREE_REPO_HELPER->getOstreeJobId(jobId);
-    if (processId == -1) {
-        qWarning() << jobId << " not exist";
-        return;
-    }
-    qInfo() << "restart job:" << jobId << ", process:" << processId;
-    QProcess process;
-    QStringList argStrList = { "-CONT", QString::number(processId) };
-    process.start("kill", argStrList);
-    if (!process.waitForStarted()) {
-        qCritical() << "kill -CONT failed!";
+    Q_D(JobManager);
+    QMutexLocker locker(&d->mutex);
+    auto job = d->jobs.value(jobId);
+    if (job == nullptr || !job->resume()) {
+        qWarning() << jobId << "not exist or not paused";
         return;
     }
-    if (!process.waitForFinished(3000)) {
-        qCritical() << "run finish failed!";
-        return;
-    }
-
-    auto retStatus = process.exitStatus();
-    auto retCode = process.exitCode();
-    if (retStatus != 0 || retCode != 0) {
-        qCritical() << " run failed, retCode:" << retCode
-                    << ", info msg:" << QString::fromLocal8Bit(process.readAllStandardOutput())
-                    << ", err msg:" << QString::fromLocal8Bit(process.readAllStandardError());
-    }
+    qInfo() << "resume job:" << jobId;
 }
 
 // 下载应用的时候 正在下载runtime 如何停止？
@@ -83,31 +128,15 @@ void JobManager::Stop(const QString &jobId)
         return;
     }
 
-    int processId = OSTREE_REPO_HELPER->getOstreeJobId(jobId);
-    if (processId == -1) {
-        qWarning() << jobId << " not exist";
-        return;
-    }
-    qInfo() << "pause job:" << jobId << ", process:" << processId;
-    QProcess process;
-    QStringList argStrList = { "-STOP", QString::number(processId) };
-    process.start("kill", argStrList);
-    if (!process.waitForStarted()) {
-        qCritical() << "kill -STOP failed!";
-        return;
-    }
-    if (!process.waitForFinished(3000)) {
-        qCritical() << "run finish failed!";
+    // 暂停中断当前的下载或签出，恢复后该步骤重新执行
+    Q_D(JobManager);
+    QMutexLocker locker(&d->mutex);
+    auto job = d->jobs.value(jobId);
+    if (job == nullptr || !job->pause()) {
+        qWarning() << jobId << "not exist or already finished";
         return;
     }
-
-    auto retStatus = process.exitStatus();
-    auto retCode = process.exitCode();
-    if (retStatus != 0 || retCode != 0) {
-        qCritical() << " run failed, retCode:" << retCode
-                    << ", info msg:" << QString::fromLocal8Bit(process.readAllStandardOutput())
-                    << ", err msg:" << QString::fromLocal8Bit(process.readAllStandardError());
-    }
+    qInfo() << "pause job:" << jobId;
 }
 
 // Fix to do 取消之后再下载问题
@@ -118,35 +147,28 @@ void JobManager::Cancel(const QString &jobId)
         return;
     }
 
-    int processId = OSTREE_REPO_HELPER->getOstreeJobId(jobId);
-    if (processId == -1) {
-        qWarning() << jobId << " not exist";
-        return;
+    Q_D(JobManager);
+    {
+        QMutexLocker locker(&d->mutex);
+        auto job = d->jobs.value(jobId);
+        if (job != nullptr) {
+            job->cancel();
+            qInfo() << "cancel job:" << jobId;
+            return;
+        }
     }
 
-    qInfo() << "cancel job:" << jobId << ", process:" << processId;
-    QProcess process;
-    QStringList argStrList = { "-9", QString::number(processId) };
-    process.start("kill", argStrList);
-    if (!process.waitForStarted()) {
-        qCritical() << "kill failed!";
-        return;
-    }
-    if (!process.waitForFinished(3000)) {
-        qCritical() << "run finish failed!";
+    // 兼容以 ref 取消下载的调用方式
+    if (!OSTREE_REPO_HELPER->cancelPull(jobId)) {
+        qWarning() << jobId << " not exist";
         return;
     }
-
-    auto retStatus = process.exitStatus();
-    auto retCode = process.exitCode();
-    if (retStatus != 0 || retCode != 0) {
-        qCritical() << " run failed, retCode:" << retCode
-                    << ", info msg:" << QString::fromLocal8Bit(process.readAllStandardOutput())
-                    << ", err msg:" << QString::fromLocal8Bit(process.readAllStandardError());
-    }
+    qInfo() << "cancel job:" << jobId;
 }
 
 QStringList JobManager::List()
 {
-    return OSTREE_REPO_HELPER->getOstreeJobList();
+    Q_D(JobManager);
+    QMutexLocker locker(&d->mutex);
+    return d->jobs.keys();
 }
@@ -7,6 +7,7 @@
 #ifndef LINGLONG_SRC_PACKAGE_MANAGER_IMPL_JOB_MANAGER_H_
 #define LINGLONG_SRC_PACKAGE_MANAGER_IMPL_JOB_MANAGER_H_
 
+#include "module/dbus_ipc/reply.h"
 #include "module/runtime/container.h"
 #include "module/util/singleton.h"
 
@@ -28,7 +29,25 @@ class JobManager : public QObject,
     friend class linglong::util::Singleton<JobManager>;
 
 public:
-    QString CreateJob(std::function<void()> f);
+    /**
+     * @brief 创建任务并注册到 dbus，同一 jobId 同时只能存在一个任务
+     * @details 任务由调用方执行，结束后保留一段时间再注销，便于晚订阅的客户端查询状态
+     *
+     * @param jobId 任务id
+     * @param f 任务内容
+     *
+     * @return Job* 已存在同一 jobId 的任务时为空
+     */
+    Job *CreateJob(const QString &jobId, std::function<linglong::service::Reply()> f);
+
+    /**
+     * @brief 获取任务在 dbus 上的对象路径，客户端可在任务创建前订阅
+     *
+     * @param jobId 任务id
+     *
+     * @return QString 对象路径
+     */
+    static QString jobPath(const QString &jobId);
 
 public Q_SLOTS:
     QStringList List();
@@ -6,12 +6,16 @@
 
 #include "package_manager.h"
 
+#include "job.h"
+#include "job_manager.h"
 #include "module/dbus_ipc/dbus_system_helper_common.h"
 #include "module/repo/ostree_repohelper.h"
+#include "module/repo/remote_ref_index.h"
 #include "module/util/app_status.h"
 #include "module/util/appinfo_cache.h"
 #include "module/util/file.h"
 #include "module/util/http/httpclient.h"
+#include "module/util/link_manifest.h"
 #include "module/util/runner.h"
 #include "module/util/status_code.h"
 #include "module/util/sysinfo.h"
@@ -23,14 +27,32 @@
 #include <QDBusInterface>
 #include <QDBusReply>
 #include <QDebug>
+#include <QFileInfo>
 #include <QJsonArray>
+#include <QMutex>
 #include <QSettings>
 
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
 #include <pwd.h>
 #include <sys/types.h>
 
 namespace linglong {
 namespace service {
+
+namespace {
+
+// 安装、更新等操作可接受的远端软件包信息缓存时间，单位秒
+const qint64 kMetadataMaxAge = 60;
+// 查询时缓存在该时间内直接使用
+const qint64 kQueryFreshAge = 10 * 60;
+// 查询时缓存超过 kQueryFreshAge 但未超过该时间时先返回缓存，同时在后台更新
+const qint64 kQueryStaleAge = 7 * 24 * 60 * 60;
+
+} // namespace
+
 PackageManagerPrivate::PackageManagerPrivate(PackageManager *parent)
     : sysLinglongInstalltions(linglong::util::getLinglongRootPath() + "/entries/share")
     , kAppInstallPath(linglong::util::getLinglongRootPath() + "/layers/")
@@ -45,6 +67,7 @@ PackageManagerPrivate::PackageManagerPrivate(PackageManager *parent)
                                 }
                                 return QDBusConnection::systemBus();
                             }())
+    , cacheRefresher(sysLinglongInstalltions)
     , q_ptr(parent)
 {
     linglong::util::getLocalConfig("repoName", remoteRepoName);
@@ -161,29 +184,96 @@ bool PackageManagerPrivate::getAppInfofromServer(const QString &pkgName,
         return false;
     }
 
+    APPINFO_CACHE->update(remoteRepoName, pkgName, pkgVer, pkgArch, appData);
     return true;
 }
 
 /*
- * 将在线包数据部分签出到指定目录
+ * 查询指定包名/版本/架构的软件包数据，缓存时间不超过 maxAge 时直接使用缓存
  *
  * @param pkgName: 软件包包名
  * @param pkgVer: 软件包版本号
  * @param pkgArch: 软件包对应的架构
- * @param channel: 软件包对应的渠道
- * @param module: 软件包类型
- * @param dstPath: 在线包数据部分存储路径
+ * @param maxAge: 可接受的缓存时间，单位秒
+ * @param appData: 查询结果
  * @param err: 错误信息
  *
  * @return bool: true:成功 false:失败
  */
-bool PackageManagerPrivate::downloadAppData(const QString &pkgName,
-                                            const QString &pkgVer,
-                                            const QString &pkgArch,
-                                            const QString &channel,
-                                            const QString &module,
-                                            const QString &dstPath,
-                                            QString &err)
+bool PackageManagerPrivate::getAppInfo(const QString &pkgName,
+                                       const QString &pkgVer,
+                                       const QString &pkgArch,
+                                       qint64 maxAge,
+                                       QString &appData,
+                                       QString &err)
+{
+    QVector<linglong::util::AppInfoRecord> records;
+    if (APPINFO_CACHE->lookup(remoteRepoName, pkgName, pkgVer, pkgArch, maxAge, records)) {
+        appData = linglong::util::AppInfoCache::toServerData(records);
+        return true;
+    }
+    return getAppInfofromServer(pkgName, pkgVer, pkgArch, appData, err);
+}
+
+/*
+ * 在后台重新查询过期的缓存，同一查询同时只有一个后台任务
+ *
+ * @param pkgName: 软件包包名
+ * @param pkgArch: 软件包对应的架构
+ */
+void PackageManagerPrivate::revalidateAppInfo(const QString &pkgName, const QString &pkgArch)
+{
+    const QString key = pkgName + "/" + pkgArch;
+    {
+        QMutexLocker locker(&revalidateMutex);
+        if (revalidating.contains(key)) {
+            return;
+        }
+        revalidating.insert(key);
+    }
+
+    QtConcurrent::run(QThreadPool::globalInstance(), [this, key, pkgName, pkgArch]() {
+        QString appData;
+        QString err;
+        if (!getAppInfofromServer(pkgName, "", pkgArch, appData, err)) {
+            qWarning() << "revalidate" << key << "failed:" << err;
+        }
+        QMutexLocker locker(&revalidateMutex);
+        revalidating.remove(key);
+    });
+}
+
+/*
+ * 获取软件包的安装目录
+ *
+ * @param appInfo: 软件包信息
+ *
+ * @return QString: 安装目录
+ */
+QString PackageManagerPrivate::getInstallPath(linglong::package::AppMetaInfo *appInfo)
+{
+    QString savePath =
+            kAppInstallPath + appInfo->appId + "/" + appInfo->version + "/" + appInfo->arch;
+    if ("devel" == appInfo->module) {
+        savePath.append("/" + appInfo->module);
+    }
+    return savePath;
+}
+
+/*
+ * 在同一次 pull 中下载多个在线包数据，全部下载完成后再签出到各自的安装目录
+ *
+ * @param pkgList: 待下载的软件包列表
+ * @param job: 接收下载进度的任务，可为空
+ * @param err: 错误信息
+ * @param onProgress: 并行下载时由调用方汇总进度，不为空时不再直接更新 job 的进度及阶段
+ *
+ * @return bool: true:成功 false:失败
+ */
+bool PackageManagerPrivate::downloadAppData(const linglong::package::AppMetaInfoList &pkgList,
+                                            Job *job,
+                                            QString &err,
+                                            const PullProgressHandler &onProgress)
 {
     bool ret = OSTREE_REPO_HELPER->ensureRepoEnv(kLocalRepoPath, err);
     if (!ret) {
@@ -192,34 +282,136 @@ bool PackageManagerPrivate::downloadAppData(const QString &pkgName,
     }
 
     // new format --> linglong/org.deepin.downloader/5.3.69/x86_64/devel
-    QString matchRef = QString("%1/%2/%3/%4/%5")
-                               .arg(channel)
-                               .arg(pkgName)
-                               .arg(pkgVer)
-                               .arg(pkgArch)
-                               .arg(module);
-    qInfo() << "downloadAppData ref:" << matchRef;
-
-    // ret = repo.repoPull(repoPath, qrepoList[0], pkgName, err);
-    ret = OSTREE_REPO_HELPER->repoPullbyCmd(kLocalRepoPath, remoteRepoName, matchRef, err);
-    if (!ret) {
-        qCritical() << err;
-        return false;
+    QStringList refs;
+    QMap<QString, QString> baseRefs;
+    for (const auto &pkg : pkgList) {
+        refs.append(QStringList{ pkg->channel, pkg->appId, pkg->version, pkg->arch, pkg->module }
+                            .join("/"));
+
+        // 已安装其他版本时以其作为增量下载的起点
+        const QString baseVersion = getBaseVersion(pkg);
+        if (!baseVersion.isEmpty()) {
+            const QString baseRef =
+                    QStringList{ pkg->channel, pkg->appId, baseVersion, pkg->arch, pkg->module }
+                            .join("/");
+            baseRefs.insert(refs.last(), baseRef);
+        }
     }
-    // checkout 目录
-    // const QString dstPath = repoPath + "/AppData";
-    ret = OSTREE_REPO_HELPER->checkOutAppData(kLocalRepoPath,
-                                              remoteRepoName,
-                                              matchRef,
-                                              dstPath,
-                                              err);
+    qInfo() << "downloadAppData refs:" << refs << "base refs:" << baseRefs;
+
+    PullProgressHandler jobProgress = onProgress;
+    if (job != nullptr && !onProgress) {
+        jobProgress = [job](const PullProgress &progress) {
+            job->updateProgress(progress.bytesTransferred,
+                                progress.bytesTotal,
+                                progress.fetched,
+                                progress.requested,
+                                "pulling");
+        };
+    }
+    // 暂停会中断下载，恢复后重新下载时已写入本地仓库的对象不会重复下载
+    ret = Job::runStep(job, [&](GCancellable *cancellable) {
+        return OSTREE_REPO_HELPER->repoPullRefs(kLocalRepoPath,
+                                                remoteRepoName,
+                                                refs,
+                                                baseRefs,
+                                                jobProgress,
+                                                cancellable,
+                                                err);
+    });
     if (!ret) {
+        if (job != nullptr && job->isCancelled()) {
+            err = "download cancelled";
+        }
         qCritical() << err;
         return false;
     }
-    qInfo() << "downloadAppData success, path:" << dstPath;
 
-    return ret;
+    if (job != nullptr && !onProgress) {
+        job->updateStage("checkout");
+    }
+
+    for (int i = 0; i < pkgList.size(); ++i) {
+        const QString dstPath = getInstallPath(pkgList.at(i));
+
+        // 安装目录已存在(如已安装同版本的其他模块)时直接合并签出
+        if (linglong::util::dirExists(dstPath)) {
+            ret = Job::runStep(job, [&](GCancellable *cancellable) {
+                return OSTREE_REPO_HELPER->checkOutAppData(kLocalRepoPath,
+                                                           remoteRepoName,
+                                                           refs.at(i),
+                                                           dstPath,
+                                                           cancellable,
+                                                           err);
+            });
+            if (!ret) {
+                qCritical() << err;
+                return false;
+            }
+            qInfo() << "downloadAppData success, path:" << dstPath;
+            continue;
+        }
+
+        // 先签出到同级临时目录再整体重命名，签出中断不会留下不完整的安装目录。本地仓库为
+        // bare-user-only 模式，签出的文件均硬链接到仓库对象，与旧版本相同的文件不会重复写入
+        QFileInfo dstInfo(dstPath);
+        const QString stagePath = dstInfo.absolutePath() + "/." + dstInfo.fileName() + ".checkout";
+        ret = Job::runStep(job, [&](GCancellable *cancellable) {
+            linglong::util::removeDir(stagePath);
+            return OSTREE_REPO_HELPER->checkOutAppData(kLocalRepoPath,
+                                                       remoteRepoName,
+                                                       refs.at(i),
+                                                       stagePath,
+                                                       cancellable,
+                                                       err);
+        });
+        if (!ret) {
+            linglong::util::removeDir(stagePath);
+            qCritical() << err;
+            return false;
+        }
+        if (rename(stagePath.toStdString().c_str(), dstPath.toStdString().c_str()) != 0) {
+            err = "rename " + stagePath + " to " + dstPath + " failed: " + strerror(errno);
+            linglong::util::removeDir(stagePath);
+            qCritical() << err;
+            return false;
+        }
+        qInfo() << "downloadAppData success, path:" << dstPath;
+    }
+
+    return true;
+}
+
+/*
+ * 查找软件包已安装的最高版本，作为增量下载的起点
+ *
+ * @param appInfo: 待下载的软件包信息
+ *
+ * @return QString: 已安装的最高版本，未安装其他版本时为空
+ */
+QString PackageManagerPrivate::getBaseVersion(linglong::package::AppMetaInfo *appInfo)
+{
+    linglong::package::AppMetaInfoList installedList;
+    linglong::util::getInstalledAppInfo(appInfo->appId,
+                                        "",
+                                        appInfo->arch,
+                                        appInfo->channel,
+                                        appInfo->module,
+                                        "",
+                                        installedList);
+
+    QString baseVersion;
+    for (const auto &installed : installedList) {
+        if (installed->version == appInfo->version) {
+            continue;
+        }
+        if (baseVersion.isEmpty()
+            || linglong::util::AppVersion(installed->version)
+                       .isBigThan(linglong::util::AppVersion(baseVersion))) {
+            baseVersion = installed->version;
+        }
+    }
+    return baseVersion;
 }
 
 Reply PackageManagerPrivate::GetDownloadStatus(const ParamOption &paramOption, int type)
@@ -243,8 +435,8 @@ Reply PackageManagerPrivate::GetDownloadStatus(const ParamOption &paramOption, i
             }
         }
         QString appData = "";
-        // 安装不查缓存
-        auto ret = getAppInfofromServer(appId, "", arch, appData, reply.message);
+        // 安装只使用短时间内的缓存，避免安装到旧版本
+        auto ret = getAppInfo(appId, "", arch, kMetadataMaxAge, appData, reply.message);
         if (!ret) {
             reply.code = STATUS_CODE(kPkgInstallFailed);
             return reply;
@@ -278,24 +470,11 @@ Reply PackageManagerPrivate::GetDownloadStatus(const ParamOption &paramOption, i
         return appState[key];
     } else {
         // Fix to do get more specific param 首次安装应用的时候 安装runtime 提示不准
-        QString fileName = QStringList{ channel, appId, latestVersion, arch, appModule }.join("-");
-        QString filePath = "/tmp/.linglong/" + fileName;
-        QFile progressFile(filePath);
-        if (progressFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
-            QStringList ret = QString(progressFile.readAll())
-                                      .split(QRegExp("[\r\n]"),
-#ifdef QT_DEPRECATED_VERSION_5_15
-                                             Qt::SkipEmptyParts
-#else
-                                             QString::SkipEmptyParts
-#endif
-                                      );
-            if (ret.size() > 1) {
-                QStringList processList = ret.at(1).trimmed().split("\u001B8");
-                reply.message = processList.at(processList.size() - 1).trimmed();
-            }
+        QString ref = QStringList{ channel, appId, latestVersion, arch, appModule }.join("/");
+        PullProgress progress;
+        if (OSTREE_REPO_HELPER->getPullProgress(ref, progress)) {
+            reply.message = progress.toString();
             qInfo() << reply.message;
-            progressFile.close();
         }
         if (type > 0) {
             reply.code = STATUS_CODE(kPkgUpdating);
@@ -317,67 +496,31 @@ Reply PackageManagerPrivate::GetDownloadStatus(const ParamOption &paramOption, i
 }
 
 /*
- * 安装应用runtime
- *
- * @param appInfo: runtime对象
- * @param err: 错误信息
- *
- * @return bool: true:成功 false:失败
- */
-bool PackageManagerPrivate::installRuntime(linglong::package::AppMetaInfo *appInfo, QString &err)
-{
-    QString savePath =
-            kAppInstallPath + appInfo->appId + "/" + appInfo->version + "/" + appInfo->arch;
-    if ("devel" == appInfo->module) {
-        savePath.append("/" + appInfo->module);
-    }
-    bool ret = downloadAppData(appInfo->appId,
-                               appInfo->version,
-                               appInfo->arch,
-                               appInfo->channel,
-                               appInfo->module,
-                               savePath,
-                               err);
-    if (!ret) {
-        err = "installRuntime download runtime data err";
-        return false;
-    }
-
-    // 更新本地数据库文件
-    QString userName = linglong::util::getUserName();
-    if (noDBusMode) {
-        userName = "deepin-linglong";
-    }
-    appInfo->kind = "runtime";
-    linglong::util::insertAppRecord(appInfo, userName);
-
-    return true;
-}
-
-/*
- * 检查应用runtime安装状态
+ * 从服务器解析应用依赖的runtime
  *
  * @param runtime: 应用runtime字符串
  * @param channel: 软件包对应的渠道
  * @param module: 软件包类型
+ * @param runtimeInfo: 解析出的runtime
  * @param err: 错误信息
  *
- * @return bool: true:安装成功或已安装返回true false:安装失败
+ * @return bool: true:成功 false:失败
  */
-bool PackageManagerPrivate::checkAppRuntime(const QString &runtime,
-                                            const QString &channel,
-                                            const QString &module,
-                                            QString &err)
+bool PackageManagerPrivate::resolveAppRuntime(const QString &runtime,
+                                              const QString &channel,
+                                              const QString &module,
+                                              linglong::package::AppMetaInfo *&runtimeInfo,
+                                              QString &err)
 {
     // runtime ref in repo org.deepin.Runtime/20/x86_64
-    QStringList runtimeInfo = runtime.split("/");
-    if (runtimeInfo.size() < 3) {
+    QStringList runtimeList = runtime.split("/");
+    if (runtimeList.size() < 3) {
         err = "app runtime:" + runtime + " runtime format err";
         return false;
     }
-    const QString runtimeId = runtimeInfo.at(0);
-    const QString runtimeVer = runtimeInfo.at(1);
-    const QString runtimeArch = runtimeInfo.at(2);
+    const QString runtimeId = runtimeList.at(0);
+    const QString runtimeVer = runtimeList.at(1);
+    const QString runtimeArch = runtimeList.at(2);
 
     // runtimeId 校验
     if (runtimeId.isEmpty()) {
@@ -397,7 +540,7 @@ bool PackageManagerPrivate::checkAppRuntime(const QString &runtime,
         version = runtimeVer;
     }
     QString appData = "";
-    bool ret = getAppInfofromServer(runtimeId, version, runtimeArch, appData, err);
+    bool ret = getAppInfo(runtimeId, version, runtimeArch, kMetadataMaxAge, appData, err);
     if (!ret) {
         return false;
     }
@@ -409,71 +552,31 @@ bool PackageManagerPrivate::checkAppRuntime(const QString &runtime,
         return false;
     }
     // 查找最高版本，多版本场景安装应用appId要求完全匹配
-    linglong::package::AppMetaInfo *appInfo = getLatestRuntime(runtimeId, runtimeVer, appList);
+    runtimeInfo = getLatestRuntime(runtimeId, runtimeVer, appList);
     // fix 当前服务端不支持按channel查询，返回的结果是默认channel，需要刷新channel/module
-    appInfo->channel = channel;
-    appInfo->module = module;
-    // 判断app依赖的runtime是否安装 runtime 不区分用户
-    if (!linglong::util::getAppInstalledStatus(appInfo->appId,
-                                               appInfo->version,
-                                               appInfo->arch,
-                                               channel,
-                                               module,
-                                               "")) {
-        ret = installRuntime(appInfo, err);
-    }
-    return ret;
+    runtimeInfo->channel = channel;
+    runtimeInfo->module = module;
+    return true;
 }
 
 /*
- * 针对非deepin发行版检查应用base安装状态
+ * 针对非deepin发行版从服务器解析runtime依赖的base
  *
- * @param runtime: runtime ref
+ * @param runtimeInfo: 应用依赖的runtime
  * @param channel: 软件包对应的渠道
  * @param module: 软件包类型
+ * @param baseInfo: 解析出的base
  * @param err: 错误信息
  *
- * @return bool: true:安装成功或已安装返回true false:安装失败
+ * @return bool: true:成功 false:失败
  */
-bool PackageManagerPrivate::checkAppBase(const QString &runtime,
-                                         const QString &channel,
-                                         const QString &module,
-                                         QString &err)
+bool PackageManagerPrivate::resolveAppBase(linglong::package::AppMetaInfo *runtimeInfo,
+                                           const QString &channel,
+                                           const QString &module,
+                                           linglong::package::AppMetaInfo *&baseInfo,
+                                           QString &err)
 {
-    // 通过runtime获取base ref
-    QStringList runtimeList = runtime.split("/");
-    if (runtimeList.size() < 3) {
-        err = "app runtime:" + runtime + " runtime format err";
-        return false;
-    }
-    const QString runtimeId = runtimeList.at(0);
-    const QString runtimeVer = runtimeList.at(1);
-    const QString runtimeArch = runtimeList.at(2);
-
-    // runtimeId 校验
-    if (runtimeId.isEmpty()) {
-        err = "app runtime:" + runtime + " runtimeId format err";
-        return false;
-    }
-
-    linglong::package::AppMetaInfoList appList;
-    QString appData = "";
-
-    bool ret = getAppInfofromServer(runtimeId, runtimeVer, runtimeArch, appData, err);
-    if (!ret) {
-        return false;
-    }
-    ret = loadAppInfo(appData, appList, err);
-    if (!ret || appList.size() < 1) {
-        err = runtime + " not found in repo";
-        qCritical() << err;
-        return false;
-    }
-
-    linglong::package::AppMetaInfo *latestRuntimeInfo =
-            getLatestRuntime(runtimeId, runtimeVer, appList);
-
-    auto baseRef = latestRuntimeInfo->runtime;
+    auto baseRef = runtimeInfo->runtime;
     QStringList baseList = baseRef.split('/');
     if (baseList.size() < 3) {
         err = "app base:" + baseRef + " base format err";
@@ -483,30 +586,24 @@ bool PackageManagerPrivate::checkAppBase(const QString &runtime,
     const QString baseVer = baseList.at(1);
     const QString baseArch = baseList.at(2);
 
-    bool retbase = true;
-
     linglong::package::AppMetaInfoList baseRuntimeList;
     QString baseData = "";
 
-    ret = getAppInfofromServer(baseId, baseVer, baseArch, baseData, err);
+    bool ret = getAppInfo(baseId, baseVer, baseArch, kMetadataMaxAge, baseData, err);
     if (!ret) {
         return false;
     }
     ret = loadAppInfo(baseData, baseRuntimeList, err);
-    if (!ret || appList.size() < 1) {
+    if (!ret || baseRuntimeList.size() < 1) {
         err = baseRef + " not found in repo";
         qCritical() << err;
         return false;
     }
     // fix to do base runtime debug info, base runtime update
-    auto baseInfo = baseRuntimeList.at(0);
+    baseInfo = baseRuntimeList.at(0);
     baseInfo->channel = channel;
     baseInfo->module = module;
-    // 判断app依赖的runtime是否安装 runtime 不区分用户
-    if (!linglong::util::getAppInstalledStatus(baseId, baseVer, baseArch, channel, module, "")) {
-        retbase = installRuntime(baseInfo, err);
-    }
-    return retbase;
+    return true;
 }
 
 /*
@@ -582,6 +679,7 @@ void PackageManagerPrivate::addAppConfig(const QString &appId,
                                          const QString &arch)
 {
     // 是否为多版本
+    QStringList oldManifest;
     if (linglong::util::getAppInstalledStatus(appId, "", arch, "", "", "")) {
         linglong::package::AppMetaInfoList pkgList;
         // 查找当前已安装软件包的最高版本
@@ -592,27 +690,16 @@ void PackageManagerPrivate::addAppConfig(const QString &appId,
         if (curVersion.isBigThan(dstVersion)) {
             return;
         }
-        // 目标版本较已有版本高，先删除旧的desktop
-        const QString installPath = kAppInstallPath + it->appId + "/" + it->version;
-        // 删掉安装配置链接文件
-        if (linglong::util::dirExists(installPath + "/" + arch + "/outputs/share")) {
-            const QString appEntriesDirPath = installPath + "/" + arch + "/outputs/share";
-            linglong::util::removeDstDirLinkFiles(appEntriesDirPath, sysLinglongInstalltions);
-        } else {
-            const QString appEntriesDirPath = installPath + "/" + arch + "/entries";
-            linglong::util::removeDstDirLinkFiles(appEntriesDirPath, sysLinglongInstalltions);
-        }
+        // 目标版本较已有版本高，旧版本独有的链接文件被删除
+        oldManifest = getLinkManifest(appId, it->version, arch);
     }
 
-    const QString savePath = kAppInstallPath + appId + "/" + version + "/" + arch;
     // 链接应用配置文件到系统配置目录
-    if (linglong::util::dirExists(savePath + "/outputs/share")) {
-        const QString appEntriesDirPath = savePath + "/outputs/share";
-        linglong::util::linkDirFiles(appEntriesDirPath, sysLinglongInstalltions);
-    } else {
-        const QString appEntriesDirPath = savePath + "/entries";
-        linglong::util::linkDirFiles(appEntriesDirPath, sysLinglongInstalltions);
-    }
+    auto newManifest = getLinkManifest(appId, version, arch);
+    linglong::util::applyLinkManifest(sysLinglongInstalltions,
+                                      oldManifest,
+                                      getEntriesPath(appId, version, arch),
+                                      newManifest);
 }
 
 /*
@@ -626,6 +713,9 @@ void PackageManagerPrivate::delAppConfig(const QString &appId,
                                          const QString &version,
                                          const QString &arch)
 {
+    auto oldManifest = getLinkManifest(appId, version, arch);
+    QFile::remove(getLinkManifestPath(appId, version, arch));
+
     // 是否为多版本
     if (linglong::util::getAppInstalledStatus(appId, "", arch, "", "", "")) {
         linglong::package::AppMetaInfoList pkgList;
@@ -638,38 +728,86 @@ void PackageManagerPrivate::delAppConfig(const QString &appId,
             return;
         }
 
-        // 目标版本较已有版本高，先删除旧的desktop
-        const QString installPath = kAppInstallPath + appId + "/" + version;
-        // 删掉安装配置链接文件
-        if (linglong::util::dirExists(installPath + "/" + arch + "/outputs/share")) {
-            const QString appEntriesDirPath = installPath + "/" + arch + "/outputs/share";
-            linglong::util::removeDstDirLinkFiles(appEntriesDirPath, sysLinglongInstalltions);
-        } else {
-            const QString appEntriesDirPath = installPath + "/" + arch + "/entries";
-            linglong::util::removeDstDirLinkFiles(appEntriesDirPath, sysLinglongInstalltions);
-        }
-
-        const QString savePath = kAppInstallPath + appId + "/" + it->version + "/" + arch;
-        // 链接应用配置文件到系统配置目录
-        if (linglong::util::dirExists(savePath + "/outputs/share")) {
-            const QString appEntriesDirPath = savePath + "/outputs/share";
-            linglong::util::linkDirFiles(appEntriesDirPath, sysLinglongInstalltions);
-        } else {
-            const QString appEntriesDirPath = savePath + "/entries";
-            linglong::util::linkDirFiles(appEntriesDirPath, sysLinglongInstalltions);
-        }
+        // 卸载的是当前链接的版本，链接切换到剩余的最高版本
+        linglong::util::applyLinkManifest(sysLinglongInstalltions,
+                                          oldManifest,
+                                          getEntriesPath(appId, it->version, arch),
+                                          getLinkManifest(appId, it->version, arch));
         return;
     }
-    // 目标版本较已有版本高，先删除旧的desktop
-    const QString installPath = kAppInstallPath + appId + "/" + version;
     // 删掉安装配置链接文件
-    if (linglong::util::dirExists(installPath + "/" + arch + "/outputs/share")) {
-        const QString appEntriesDirPath = installPath + "/" + arch + "/outputs/share";
-        linglong::util::removeDstDirLinkFiles(appEntriesDirPath, sysLinglongInstalltions);
-    } else {
-        const QString appEntriesDirPath = installPath + "/" + arch + "/entries";
-        linglong::util::removeDstDirLinkFiles(appEntriesDirPath, sysLinglongInstalltions);
+    linglong::util::applyLinkManifest(sysLinglongInstalltions, oldManifest, "", {});
+}
+
+/*
+ * 获取软件包导出到系统的文件所在目录
+ *
+ * @param appId: 应用的appId
+ * @param version: 应用的版本号
+ * @param arch: 应用对应的架构
+ *
+ * @return QString: 导出目录
+ */
+QString PackageManagerPrivate::getEntriesPath(const QString &appId,
+                                              const QString &version,
+                                              const QString &arch)
+{
+    const QString savePath = kAppInstallPath + appId + "/" + version + "/" + arch;
+    if (linglong::util::dirExists(savePath + "/outputs/share")) {
+        return savePath + "/outputs/share";
     }
+    return savePath + "/entries";
+}
+
+QString PackageManagerPrivate::getLinkManifestPath(const QString &appId,
+                                                   const QString &version,
+                                                   const QString &arch)
+{
+    return linglong::util::getLinglongRootPath() + "/entries/manifests/" + appId + "/" + version
+            + "/" + arch;
+}
+
+/*
+ * 读取软件包的链接清单，清单不存在时(如此前安装的软件包)遍历导出目录生成并保存
+ *
+ * @param appId: 应用的appId
+ * @param version: 应用的版本号
+ * @param arch: 应用对应的架构
+ *
+ * @return QStringList: 导出文件的相对路径清单
+ */
+QStringList PackageManagerPrivate::getLinkManifest(const QString &appId,
+                                                   const QString &version,
+                                                   const QString &arch)
+{
+    const QString manifestPath = getLinkManifestPath(appId, version, arch);
+    QStringList manifest;
+    if (linglong::util::loadLinkManifest(manifestPath, manifest)) {
+        return manifest;
+    }
+
+    const QString entriesPath = getEntriesPath(appId, version, arch);
+    if (!linglong::util::dirExists(entriesPath)) {
+        return manifest;
+    }
+    manifest = linglong::util::buildLinkManifest(entriesPath);
+    if (!linglong::util::saveLinkManifest(manifestPath, manifest)) {
+        qWarning() << "save link manifest" << manifestPath << "failed";
+    }
+    return manifest;
+}
+
+/*
+ * 更新desktop、mime type及glib schemas数据库
+ */
+void PackageManagerPrivate::updateSystemCaches()
+{
+    // 无 dbus 模式下命令执行完即退出，不能推迟刷新
+    if (noDBusMode) {
+        cacheRefresher.refreshNow();
+        return;
+    }
+    cacheRefresher.schedule();
 }
 
 /*!
@@ -714,8 +852,8 @@ Reply PackageManagerPrivate::Install(const InstallParamOption &installParamOptio
     }
 
     QString appData = "";
-    // 安装不查缓存
-    auto ret = getAppInfofromServer(appId, version, arch, appData, reply.message);
+    // 安装只使用短时间内的缓存，避免安装到旧版本
+    auto ret = getAppInfo(appId, version, arch, kMetadataMaxAge, appData, reply.message);
     if (!ret) {
         reply.code = STATUS_CODE(kPkgInstallFailed);
         appState.insert(appId + "/" + version + "/" + arch, reply);
@@ -757,39 +895,55 @@ Reply PackageManagerPrivate::Install(const InstallParamOption &installParamOptio
         return reply;
     }
 
-    // 检查软件包依赖的runtime安装状态
-    ret = checkAppRuntime(appInfo->runtime, channel, appModule, reply.message);
+    // 先解析出应用依赖的runtime及base，全部下载完成后再签出、登记
+    linglong::package::AppMetaInfoList pkgList;
+    linglong::package::AppMetaInfoList dependList;
+    linglong::package::AppMetaInfo *runtimeInfo = nullptr;
+    ret = resolveAppRuntime(appInfo->runtime, channel, appModule, runtimeInfo, reply.message);
     if (!ret) {
         qCritical() << reply.message;
         reply.code = STATUS_CODE(kInstallRuntimeFailed);
         appState.insert(appId + "/" + version + "/" + arch, reply);
         return reply;
     }
+    // 判断app依赖的runtime是否安装 runtime 不区分用户
+    if (!linglong::util::getAppInstalledStatus(runtimeInfo->appId,
+                                               runtimeInfo->version,
+                                               runtimeInfo->arch,
+                                               channel,
+                                               appModule,
+                                               "")) {
+        dependList.append(runtimeInfo);
+    }
 
-    // 检查软件包依赖的base安装状态
     if (!linglong::util::isDeepinSysProduct()) {
-        ret = checkAppBase(appInfo->runtime, channel, appModule, reply.message);
+        linglong::package::AppMetaInfo *baseInfo = nullptr;
+        ret = resolveAppBase(runtimeInfo, channel, appModule, baseInfo, reply.message);
         if (!ret) {
             qCritical() << reply.message;
             reply.code = STATUS_CODE(kInstallBaseFailed);
             appState.insert(appId + "/" + version + "/" + arch, reply);
             return reply;
         }
+        const QStringList baseList = runtimeInfo->runtime.split('/');
+        if (!linglong::util::getAppInstalledStatus(baseList.at(0),
+                                                   baseList.at(1),
+                                                   baseList.at(2),
+                                                   channel,
+                                                   appModule,
+                                                   "")) {
+            dependList.append(baseInfo);
+        }
     }
 
-    // 下载在线包数据到目标目录
-    QString savePath =
-            kAppInstallPath + appInfo->appId + "/" + appInfo->version + "/" + appInfo->arch;
-    if ("devel" == appModule) {
-        savePath.append("/" + appModule);
-    }
-    ret = downloadAppData(appInfo->appId,
-                          appInfo->version,
-                          appInfo->arch,
-                          channel,
-                          appModule,
-                          savePath,
-                          reply.message);
+    // fix 当前服务端不支持按channel查询，返回的结果是默认channel，需要刷新channel/module
+    appInfo->channel = channel;
+    appInfo->module = appModule;
+    pkgList << dependList << appInfo;
+
+    // runtime、base 与应用在同一次下载中完成，共享的对象只下载一次
+    QString savePath = getInstallPath(appInfo);
+    ret = downloadAppData(pkgList, Job::current(), reply.message);
     if (!ret) {
         qCritical() << "downloadAppData app:" << appInfo->appId << ", version:" << appInfo->version
                     << " error";
@@ -798,47 +952,20 @@ Reply PackageManagerPrivate::Install(const InstallParamOption &installParamOptio
         return reply;
     }
 
+    // 依赖全部就绪后再更新本地数据库 runtime 不区分用户
+    for (const auto &depend : dependList) {
+        depend->kind = "runtime";
+        linglong::util::insertAppRecord(depend, userName);
+    }
+
     // 链接应用配置文件到系统配置目录
     addAppConfig(appInfo->appId, appInfo->version, appInfo->arch);
 
-    // 更新desktop database
-    auto retRunner = linglong::runner::Runner("update-desktop-database",
-                                              { sysLinglongInstalltions + "/applications/" },
-                                              1000 * 60 * 1);
-    if (!retRunner) {
-        qWarning() << "warning: update desktop database of " + sysLinglongInstalltions
-                        + "/applications/ failed!";
-    }
-
-    // 更新mime type database
-    if (linglong::util::dirExists(sysLinglongInstalltions + "/mime/packages")) {
-        auto retUpdateMime = linglong::runner::Runner("update-mime-database",
-                                                      { sysLinglongInstalltions + "/mime/" },
-                                                      1000 * 60 * 1);
-        if (!retUpdateMime) {
-            qWarning() << "warning: update mime type database of " + sysLinglongInstalltions
-                            + "/mime/ failed!";
-        }
-    }
-
-    // 更新 glib-2.0/schemas
-    if (linglong::util::dirExists(sysLinglongInstalltions + "/glib-2.0/schemas")) {
-        auto retUpdateSchemas =
-                linglong::runner::Runner("glib-compile-schemas",
-                                         { sysLinglongInstalltions + "/glib-2.0/schemas" },
-                                         1000 * 60 * 1);
-        if (!retUpdateSchemas) {
-            qWarning() << "warning: update schemas of " + sysLinglongInstalltions
-                            + "/glib-2.0/schemas failed!";
-        }
-    }
+    // 更新desktop、mime type及glib schemas数据库
+    updateSystemCaches();
 
     // 更新本地数据库文件
     appInfo->kind = "app";
-    // fix 当前服务端不支持按channel查询，返回的结果是默认channel，需要刷新channel/module
-    appInfo->channel = channel;
-    appInfo->module = appModule;
-
     linglong::util::insertAppRecord(appInfo, userName);
 
     // process portal after install
@@ -887,21 +1014,33 @@ QueryReply PackageManagerPrivate::Query(const QueryParamOption &paramOption)
     QString arch = linglong::util::hostArch();
 
     QString appData = "";
-    int status = STATUS_CODE(kFail);
+    QVector<linglong::util::AppInfoRecord> records;
+    bool cached = false;
     if (!paramOption.force) {
-        status = linglong::util::queryLocalCache(appId, appData);
+        // 缓存过期但未超过 kQueryStaleAge 时先返回缓存，同时在后台更新
+        qint64 age = 0;
+        cached = APPINFO_CACHE->lookup(remoteRepoName,
+                                       appId,
+                                       "",
+                                       arch,
+                                       kQueryStaleAge,
+                                       records,
+                                       &age);
+        if (cached && age > kQueryFreshAge) {
+            revalidateAppInfo(appId, arch);
+        }
     }
 
-    bool fromServer = false;
     // 缓存查不到从服务器查
-    if (status != STATUS_CODE(kSuccess)) {
+    if (cached) {
+        appData = linglong::util::AppInfoCache::toServerData(records);
+    } else {
         ret = getAppInfofromServer(appId, "", arch, appData, reply.message);
         if (!ret) {
             reply.code = STATUS_CODE(kErrorPkgQueryFailed);
             qCritical() << reply.message;
             return reply;
         }
-        fromServer = true;
     }
 
     QJsonValue jsonValue;
@@ -911,11 +1050,6 @@ QueryReply PackageManagerPrivate::Query(const QueryParamOption &paramOption)
         qCritical() << reply.message;
         return reply;
     }
-    // 若从服务器查询得到正确的数据则更新缓存
-    if (fromServer) {
-        linglong::util::updateCache(appId, appData);
-    }
-
     QJsonDocument document = QJsonDocument(jsonValue.toArray());
     reply.code = STATUS_CODE(kErrorPkgQuerySuccess);
     reply.message = "query " + appId + " success";
@@ -923,7 +1057,8 @@ QueryReply PackageManagerPrivate::Query(const QueryParamOption &paramOption)
     return reply;
 }
 
-Reply PackageManagerPrivate::Uninstall(const UninstallParamOption &paramOption)
+Reply PackageManagerPrivate::Uninstall(const UninstallParamOption &paramOption,
+                                       bool refreshCaches)
 {
     Q_Q(PackageManager);
     Reply reply;
@@ -1035,36 +1170,9 @@ Reply PackageManagerPrivate::Uninstall(const UninstallParamOption &paramOption)
         linglong::util::deleteAppRecord(appId, it->version, arch, channel, appModule, userName);
 
         delAppConfig(appId, it->version, arch);
-        // 更新desktop database
-        auto retRunner = linglong::runner::Runner("update-desktop-database",
-                                                  { sysLinglongInstalltions + "/applications/" },
-                                                  1000 * 60 * 1);
-        if (!retRunner) {
-            qWarning() << "warning: update desktop database of " + sysLinglongInstalltions
-                            + "/applications/ failed!";
-        }
-
-        // 更新mime type database
-        if (linglong::util::dirExists(sysLinglongInstalltions + "/mime/packages")) {
-            auto retUpdateMime = linglong::runner::Runner("update-mime-database",
-                                                          { sysLinglongInstalltions + "/mime/" },
-                                                          1000 * 60 * 1);
-            if (!retUpdateMime) {
-                qWarning() << "warning: update mime type database of " + sysLinglongInstalltions
-                                + "/mime/ failed!";
-            }
-        }
-
-        // 更新 glib-2.0/schemas
-        if (linglong::util::dirExists(sysLinglongInstalltions + "/glib-2.0/schemas")) {
-            auto retUpdateSchemas =
-                    linglong::runner::Runner("glib-compile-schemas",
-                                             { sysLinglongInstalltions + "/glib-2.0/schemas" },
-                                             1000 * 60 * 1);
-            if (!retUpdateSchemas) {
-                qWarning() << "warning: update schemas of " + sysLinglongInstalltions
-                                + "/glib-2.0/schemas failed!";
-            }
+        if (refreshCaches) {
+            // 更新desktop、mime type及glib schemas数据库
+            updateSystemCaches();
         }
 
         // 删除应用对应的安装目录
@@ -1144,6 +1252,14 @@ Reply PackageManagerPrivate::Uninstall(const UninstallParamOption &paramOption)
         reply.message = "uninstall " + appId + ", version:" + it->version + " success";
         delVersionList.append(it->version);
     }
+
+    // 仓库数据默认在后台清理，无 dbus 模式下命令执行完即退出，需要立即清理
+    if (noDBusMode) {
+        QString pruneErr;
+        if (!OSTREE_REPO_HELPER->repoPrune(pruneErr)) {
+            qWarning() << pruneErr;
+        }
+    }
     reply.code = STATUS_CODE(kPkgUninstallSuccess);
     if (paramOption.delAllVersion && pkgList.size() > 1) {
         reply.message = "uninstall " + appId + " " + delVersionList.join(",") + " success";
@@ -1201,7 +1317,7 @@ Reply PackageManagerPrivate::Update(const ParamOption &paramOption)
     auto installedApp = pkgList.at(0);
     QString currentVersion = installedApp->version;
     QString appData = QString();
-    auto ret = getAppInfofromServer(appId, "", arch, appData, reply.message);
+    auto ret = getAppInfo(appId, "", arch, kMetadataMaxAge, appData, reply.message);
     if (!ret) {
         reply.message = "query server app:" + appId + " info err";
         qCritical() << reply.message;
@@ -1234,6 +1350,8 @@ Reply PackageManagerPrivate::Update(const ParamOption &paramOption)
         return reply;
     }
 
+    // 新版本以已安装版本为起点增量下载，签出的文件与旧版本共享仓库对象，卸载旧版本时只删除
+    // 新版本不再引用的数据
     InstallParamOption installParamOption;
     installParamOption.appId = appId;
     installParamOption.version = serverApp->version;
@@ -1256,7 +1374,7 @@ Reply PackageManagerPrivate::Update(const ParamOption &paramOption)
     uninstallParamOption.version = currentVersion;
     uninstallParamOption.channel = channel;
     uninstallParamOption.appModule = appModule;
-    reply = Uninstall(uninstallParamOption);
+    reply = Uninstall(uninstallParamOption, true);
     if (reply.code != STATUS_CODE(kPkgUninstallSuccess)) {
         reply.message = "uninstall app:" + appId + ", version:" + currentVersion + " err";
         qCritical() << reply.message;
@@ -1273,6 +1391,379 @@ Reply PackageManagerPrivate::Update(const ParamOption &paramOption)
     return reply;
 }
 
+namespace {
+
+// 批量更新时同时下载的任务数
+const int kUpdateWorkers = 4;
+
+/*
+ * 汇总并行下载的进度。各下载上报的是自身的累计值，直接转发会使任务进度来回跳动，
+ * 这里按下载分别记录，合并后再更新任务进度，已结束的下载仍计入总数
+ */
+class PullProgressAggregator
+{
+public:
+    explicit PullProgressAggregator(Job *job)
+        : job(job)
+    {
+    }
+
+    /*
+     * 获取某个下载使用的进度回调
+     *
+     * @param key: 下载的标识，如 ref
+     *
+     * @return PullProgressHandler: 进度回调，任务为空时为空
+     */
+    PullProgressHandler handler(const QString &key)
+    {
+        if (job == nullptr) {
+            return nullptr;
+        }
+        return [this, key](const PullProgress &progress) {
+            QMutexLocker locker(&mutex);
+            pulls.insert(key, progress);
+
+            PullProgress total;
+            for (const auto &pull : pulls) {
+                total.bytesTransferred += pull.bytesTransferred;
+                total.bytesTotal += pull.bytesTotal;
+                total.fetched += pull.fetched;
+                total.requested += pull.requested;
+            }
+            job->updateProgress(total.bytesTransferred,
+                                total.bytesTotal,
+                                total.fetched,
+                                total.requested,
+                                "pulling");
+        };
+    }
+
+private:
+    Job *job;
+    QMutex mutex;
+    QMap<QString, PullProgress> pulls;
+};
+
+// 在最多 kUpdateWorkers 个线程中并行执行任务，返回各任务的执行结果
+template<typename T, typename Func>
+QVector<bool> runBounded(const QList<T> &items, Func func)
+{
+    QThreadPool workers;
+    workers.setMaxThreadCount(kUpdateWorkers);
+
+    QList<QFuture<bool>> futures;
+    for (const auto &item : items) {
+        futures.append(QtConcurrent::run(&workers, [&func, item]() -> bool {
+            return func(item);
+        }));
+    }
+
+    QVector<bool> results;
+    for (auto &future : futures) {
+        results.append(future.result());
+    }
+    return results;
+}
+
+} // namespace
+
+Reply PackageManagerPrivate::UpdateMany(const QStringList &appIds)
+{
+    Reply reply;
+    Job *job = Job::current();
+    const QString arch = linglong::util::hostArch();
+    const QString userName =
+            noDBusMode ? QString("deepin-linglong") : linglong::util::getUserName();
+
+    QString err;
+    if (!OSTREE_REPO_HELPER->ensureRepoEnv(kLocalRepoPath, err)) {
+        reply.message = "update failed, " + err;
+        qCritical() << reply.message;
+        reply.code = STATUS_CODE(kErrorPkgUpdateFailed);
+        return reply;
+    }
+
+    // 查询已安装的应用，同一应用只更新已安装的最高版本
+    QString installedData;
+    linglong::package::AppMetaInfoList installedList;
+    if (!linglong::util::queryAllInstalledApp("", installedData, err)
+        || !linglong::util::getAppMetaInfoListByJson(installedData, installedList)) {
+        reply.message = "query installed app failed, " + err;
+        qCritical() << reply.message;
+        reply.code = STATUS_CODE(kErrorPkgUpdateFailed);
+        return reply;
+    }
+
+    QMap<QString, linglong::package::AppMetaInfo *> currentApps;
+    for (const auto &installed : installedList) {
+        if (installed->kind != "app" || installed->arch != arch
+            || (!appIds.isEmpty() && !appIds.contains(installed->appId))) {
+            continue;
+        }
+        const QString key = QStringList{ installed->channel, installed->appId, installed->module }
+                                    .join("/");
+        auto current = currentApps.value(key);
+        if (current == nullptr
+            || linglong::util::AppVersion(installed->version)
+                       .isBigThan(linglong::util::AppVersion(current->version))) {
+            currentApps.insert(key, installed.data());
+        }
+    }
+
+    // 所有应用共用一次 summary 查询确定最新版本
+    QMap<QString, QString> remoteRefs;
+    if (!OSTREE_REPO_HELPER->getRemoteRefs(kLocalRepoPath, remoteRepoName, remoteRefs, err)) {
+        reply.message = "query remote refs failed, " + err;
+        qCritical() << reply.message;
+        reply.code = STATUS_CODE(kErrorPkgUpdateFailed);
+        return reply;
+    }
+    linglong::repo::RemoteRefIndex refIndex;
+    refIndex.build(remoteRefs);
+
+    // 待更新应用的已安装版本与目标版本
+    struct UpdateTask
+    {
+        linglong::package::AppMetaInfo *current;
+        QString version;
+        linglong::package::AppMetaInfo *target;
+        // 工作线程中的错误信息，线程结束后统一写入 appState
+        QString error;
+    };
+    QVector<UpdateTask> tasks;
+    for (auto current : currentApps) {
+        linglong::repo::RemoteRefEntry entry;
+        if (!refIndex.findLatest(current->appId, arch, current->module, entry)
+            || (!entry.channel.isEmpty() && entry.channel != current->channel)
+            || !linglong::util::AppVersion(entry.version)
+                        .isBigThan(linglong::util::AppVersion(current->version))) {
+            continue;
+        }
+        tasks.append(UpdateTask{ current, entry.version, nullptr });
+        reply.code = STATUS_CODE(kPkgUpdating);
+        reply.message = current->appId + " is updating...";
+        appState.insert(current->appId + "//" + arch, reply);
+        qInfo() << "UpdateMany" << current->appId << current->version << "-->" << entry.version;
+    }
+    if (tasks.isEmpty()) {
+        reply.code = STATUS_CODE(kErrorPkgUpdateSuccess);
+        reply.message = "all apps are up to date";
+        qInfo() << reply.message;
+        return reply;
+    }
+
+    // 只在调用线程中执行，runBounded 的工作线程不访问 appState
+    QStringList failedApps;
+    auto setFailed = [&](linglong::package::AppMetaInfo *current, const QString &message) {
+        Reply failed;
+        failed.code = STATUS_CODE(kErrorPkgUpdateFailed);
+        failed.message = message;
+        qCritical() << failed.message;
+        appState.insert(current->appId + "//" + arch, failed);
+        failedApps.append(current->appId);
+    };
+    auto mergeErrors = [&](const QList<UpdateTask *> &finished) {
+        for (auto task : finished) {
+            if (!task->error.isEmpty()) {
+                setFailed(task->current, task->error);
+                task->error.clear();
+            }
+        }
+    };
+
+    // 只为有更新的应用查询目标版本的元数据，每个任务只写入各自的 target
+    QList<UpdateTask *> taskList;
+    for (auto &task : tasks) {
+        taskList.append(&task);
+    }
+    runBounded(taskList, [&](UpdateTask *task) -> bool {
+        QString appData;
+        QString fetchErr;
+        linglong::package::AppMetaInfoList appList;
+        if (!getAppInfo(task->current->appId,
+                        task->version,
+                        arch,
+                        kMetadataMaxAge,
+                        appData,
+                        fetchErr)
+            || !loadAppInfo(appData, appList, fetchErr) || appList.isEmpty()) {
+            task->error = "query server app:" + task->current->appId + " info err";
+            return false;
+        }
+        task->target = getLatestApp(task->current->appId, appList);
+        task->target->channel = task->current->channel;
+        task->target->module = task->current->module;
+        return true;
+    });
+    mergeErrors(taskList);
+
+    // 解析依赖的 runtime 及 base，多个应用共享的依赖只解析和下载一次
+    QMap<QString, linglong::package::AppMetaInfo *> runtimes;
+    QMap<QString, linglong::package::AppMetaInfo *> dependMap;
+    QMap<QString, QStringList> dependsOfApp;
+    for (const auto &task : tasks) {
+        auto target = task.target;
+        if (target == nullptr) {
+            continue;
+        }
+
+        linglong::package::AppMetaInfo *runtimeInfo = runtimes.value(target->runtime);
+        if (runtimeInfo == nullptr) {
+            if (!resolveAppRuntime(target->runtime,
+                                   target->channel,
+                                   target->module,
+                                   runtimeInfo,
+                                   err)) {
+                setFailed(task.current, err);
+                continue;
+            }
+            runtimes.insert(target->runtime, runtimeInfo);
+        }
+
+        linglong::package::AppMetaInfoList depends{ runtimeInfo };
+        if (!linglong::util::isDeepinSysProduct()) {
+            linglong::package::AppMetaInfo *baseInfo = runtimes.value(runtimeInfo->runtime);
+            if (baseInfo == nullptr) {
+                if (!resolveAppBase(runtimeInfo,
+                                    target->channel,
+                                    target->module,
+                                    baseInfo,
+                                    err)) {
+                    setFailed(task.current, err);
+                    continue;
+                }
+                runtimes.insert(runtimeInfo->runtime, baseInfo);
+            }
+            depends.append(baseInfo);
+        }
+
+        for (const auto &depend : depends) {
+            if (linglong::util::getAppInstalledStatus(depend->appId,
+                                                      depend->version,
+                                                      depend->arch,
+                                                      depend->channel,
+                                                      depend->module,
+                                                      "")) {
+                continue;
+            }
+            const QString ref = QStringList{ depend->channel, depend->appId, depend->version,
+                                             depend->arch, depend->module }
+                                        .join("/");
+            dependMap.insert(ref, depend.data());
+            dependsOfApp[target->appId].append(ref);
+        }
+    }
+
+    // 先下载共享的依赖，再并行下载各应用，各下载的进度汇总后再更新任务进度
+    PullProgressAggregator progress(job);
+    QStringList dependRefs = dependMap.keys();
+    auto dependResults = runBounded(dependRefs, [&](const QString &ref) -> bool {
+        QString pullErr;
+        if (!downloadAppData({ dependMap.value(ref) }, job, pullErr, progress.handler(ref))) {
+            qCritical() << "UpdateMany download" << ref << "failed:" << pullErr;
+            return false;
+        }
+        return true;
+    });
+    QStringList failedDepends;
+    for (int i = 0; i < dependRefs.size(); ++i) {
+        if (!dependResults.at(i)) {
+            failedDepends.append(dependRefs.at(i));
+            continue;
+        }
+        auto depend = dependMap.value(dependRefs.at(i));
+        depend->kind = "runtime";
+        linglong::util::insertAppRecord(depend, userName);
+    }
+
+    QList<UpdateTask *> pending;
+    for (auto task : taskList) {
+        if (task->target == nullptr || failedApps.contains(task->current->appId)) {
+            continue;
+        }
+        bool dependReady = true;
+        for (const auto &ref : dependsOfApp.value(task->target->appId)) {
+            dependReady = dependReady && !failedDepends.contains(ref);
+        }
+        if (!dependReady) {
+            setFailed(task->current, "download runtime of " + task->current->appId + " err");
+            continue;
+        }
+        pending.append(task);
+    }
+
+    auto appResults = runBounded(pending, [&](UpdateTask *task) -> bool {
+        auto target = task->target;
+        const QString ref = QStringList{ target->channel, target->appId, target->version,
+                                         target->arch, target->module }
+                                    .join("/");
+        QString pullErr;
+        if (!downloadAppData({ target }, job, pullErr, progress.handler(ref))) {
+            task->error = "download app:" + task->current->appId + ", version:"
+                    + task->target->version + " err";
+            return false;
+        }
+        return true;
+    });
+    mergeErrors(pending);
+
+    // 登记新版本并卸载旧版本，desktop 等数据库最后统一刷新一次
+    QStringList updatedApps;
+    for (int i = 0; i < pending.size(); ++i) {
+        if (!appResults.at(i)) {
+            continue;
+        }
+        auto current = pending.at(i)->current;
+        auto target = pending.at(i)->target;
+
+        // 与 Install 一致，先链接再写入数据库，addAppConfig 据此找到旧版本
+        addAppConfig(target->appId, target->version, target->arch);
+        target->kind = "app";
+        linglong::util::insertAppRecord(target,
+                                        noDBusMode ? QString("deepin-linglong") : current->user);
+
+        package::Ref ref("", target->channel, target->appId, target->version, arch, target->module);
+        const QString installPath = getInstallPath(target);
+        QDBusReply<void> helperRet =
+                systemHelperInterface.RebuildInstallPortal(installPath, ref.toString(), {});
+        if (!helperRet.isValid()) {
+            qWarning() << "process post install portal failed:" << helperRet.error();
+        }
+
+        UninstallParamOption uninstallParamOption;
+        uninstallParamOption.appId = current->appId;
+        uninstallParamOption.version = current->version;
+        uninstallParamOption.channel = current->channel;
+        uninstallParamOption.appModule = current->module;
+        Reply uninstallReply = Uninstall(uninstallParamOption, false);
+        if (uninstallReply.code != STATUS_CODE(kPkgUninstallSuccess)) {
+            setFailed(current,
+                      "uninstall app:" + current->appId + ", version:" + current->version
+                              + " err");
+            continue;
+        }
+
+        Reply updated;
+        updated.code = STATUS_CODE(kErrorPkgUpdateSuccess);
+        updated.message = "update " + current->appId + " success, version:" + current->version
+                + " --> " + target->version;
+        appState.insert(current->appId + "//" + arch, updated);
+        updatedApps.append(current->appId);
+    }
+
+    updateSystemCaches();
+
+    reply.code = failedApps.isEmpty() ? STATUS_CODE(kErrorPkgUpdateSuccess)
+                                      : STATUS_CODE(kErrorPkgUpdateFailed);
+    reply.message = "updated: " + updatedApps.join(",");
+    if (!failedApps.isEmpty()) {
+        reply.message += ", failed: " + failedApps.join(",");
+    }
+    qInfo() << "UpdateMany" << reply.message;
+    return reply;
+}
+
 QString PackageManagerPrivate::getUserName(uid_t uid)
 {
     struct passwd *user;
@@ -1285,14 +1776,14 @@ QString PackageManagerPrivate::getUserName(uid_t uid)
 
 PackageManager::PackageManager()
     : pool(new QThreadPool)
+    , queryPool(new QThreadPool)
     , dd_ptr(new PackageManagerPrivate(this))
 {
     // 检查安装数据库信息
     linglong::util::checkInstalledAppDb();
     linglong::util::updateInstalledAppInfoDb();
     pool->setMaxThreadCount(POOL_MAX_THREAD);
-    // 检查应用缓存信息
-    linglong::util::checkAppCache();
+    queryPool->setMaxThreadCount(QUERY_POOL_MAX_THREAD);
 }
 
 PackageManager::~PackageManager() { }
@@ -1424,9 +1915,15 @@ Reply PackageManager::Install(const InstallParamOption &installParamOption)
         return reply;
     }
 
-    QFuture<void> future = QtConcurrent::run(pool.data(), [=]() {
-        d->Install(installParamOption);
+    // 同一应用正在安装时客户端继续等待已有任务
+    auto job = JobManager::instance()->CreateJob("install/" + appId, [=]() -> Reply {
+        return d->Install(installParamOption);
     });
+    if (job != nullptr) {
+        QtConcurrent::run(pool.data(), [job]() {
+            job->run();
+        });
+    }
     reply.code = STATUS_CODE(kPkgInstalling);
     reply.message = installParamOption.appId + " is installing";
     return reply;
@@ -1445,7 +1942,7 @@ Reply PackageManager::Uninstall(const UninstallParamOption &paramOption)
     }
 
     // QFuture<void> future = QtConcurrent::run(pool.data(), [=]() { d->Uninstall(paramOption); });
-    return d->Uninstall(paramOption);
+    return d->Uninstall(paramOption, true);
 }
 
 Reply PackageManager::Update(const ParamOption &paramOption)
@@ -1460,14 +1957,61 @@ Reply PackageManager::Update(const ParamOption &paramOption)
         return reply;
     }
 
-    QFuture<void> future = QtConcurrent::run(pool.data(), [=]() {
-        d->Update(paramOption);
+    auto job = JobManager::instance()->CreateJob("update/" + appId, [=]() -> Reply {
+        return d->Update(paramOption);
     });
+    if (job != nullptr) {
+        QtConcurrent::run(pool.data(), [job]() {
+            job->run();
+        });
+    }
     reply.code = STATUS_CODE(kPkgUpdating);
     reply.message = appId + " is updating";
     return reply;
 }
 
+Reply PackageManager::UpdateMany(const QStringList &appIds)
+{
+    Q_D(PackageManager);
+
+    Reply reply;
+    if (appIds.isEmpty()) {
+        reply.message = "appId input err";
+        reply.code = STATUS_CODE(kUserInputParamErr);
+        return reply;
+    }
+
+    auto job = JobManager::instance()->CreateJob("update/" + appIds.join(","), [=]() -> Reply {
+        return d->UpdateMany(appIds);
+    });
+    if (job != nullptr) {
+        QtConcurrent::run(pool.data(), [job]() {
+            job->run();
+        });
+    }
+    reply.code = STATUS_CODE(kPkgUpdating);
+    reply.message = appIds.join(",") + " is updating";
+    return reply;
+}
+
+Reply PackageManager::UpdateAll()
+{
+    Q_D(PackageManager);
+
+    auto job = JobManager::instance()->CreateJob("update/all", [=]() -> Reply {
+        return d->UpdateMany({});
+    });
+    if (job != nullptr) {
+        QtConcurrent::run(pool.data(), [job]() {
+            job->run();
+        });
+    }
+    Reply reply;
+    reply.code = STATUS_CODE(kPkgUpdating);
+    reply.message = "all apps are updating";
+    return reply;
+}
+
 QueryReply PackageManager::Query(const QueryParamOption &paramOption)
 {
     Q_D(PackageManager);
@@ -1480,7 +2024,20 @@ QueryReply PackageManager::Query(const QueryParamOption &paramOption)
         qCritical() << reply.message;
         return reply;
     }
-    return d->Query(paramOption);
+    if (!calledFromDBus()) {
+        return d->Query(paramOption);
+    }
+
+    // 查询可能需要访问服务器，在线程池中执行并延迟应答，D-Bus 主线程继续处理其它调用
+    // 查询使用单独的线程池，等待服务器应答时不会占用安装、更新任务的线程
+    setDelayedReply(true);
+    auto dbusMessage = message();
+    auto dbusConnection = connection();
+    QtConcurrent::run(queryPool.data(), [d, dbusMessage, dbusConnection, paramOption]() {
+        auto result = d->Query(paramOption);
+        dbusConnection.send(dbusMessage.createReply(QVariant::fromValue(result)));
+    });
+    return reply;
 }
 
 void PackageManager::setNoDBusMode(bool enable)
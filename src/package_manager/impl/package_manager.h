@@ -67,6 +67,8 @@ public Q_SLOTS:
 
     /**
      * @brief 安装软件包
+     * @details 安装在任务 install/{appId} 中执行，进度及结果通过该任务的 Progress、Finish
+     *          信号推送，对象路径见 JobManager::jobPath
      *
      * @param installParamOption 安装参数
      *
@@ -87,6 +89,7 @@ public Q_SLOTS:
 
     /**
      * @brief 更新软件包
+     * @details 更新在任务 update/{appId} 中执行
      *
      * @param paramOption 更新包参数
      *
@@ -94,6 +97,25 @@ public Q_SLOTS:
      */
     Reply Update(const ParamOption &paramOption);
 
+    /**
+     * @brief 批量更新软件包，共享的 runtime 只下载一次
+     * @details 更新在任务 update/{appId1,appId2...} 中执行，各应用的更新结果可通过
+     *          GetDownloadStatus 查询
+     *
+     * @param appIds 待更新的应用列表
+     *
+     * @return Reply 同Install
+     */
+    Reply UpdateMany(const QStringList &appIds);
+
+    /**
+     * @brief 更新全部已安装的应用
+     * @details 更新在任务 update/all 中执行
+     *
+     * @return Reply 同Install
+     */
+    Reply UpdateAll();
+
     /**
      * @brief 查询软件包信息
      *
@@ -108,6 +130,7 @@ public Q_SLOTS:
 
 public:
     QScopedPointer<QThreadPool> pool; ///< 下载、卸载、更新应用线程池
+    QScopedPointer<QThreadPool> queryPool; ///< 查询线程池，与下载线程池分开避免查询占满安装线程
 
     /**
      * @brief 设置是否为nodbus安装模式
@@ -129,5 +152,6 @@ protected:
 } // namespace linglong
 
 #define POOL_MAX_THREAD 10 ///< 下载、卸载、更新应用线程池最大线程数
+#define QUERY_POOL_MAX_THREAD 4 ///< 查询线程池最大线程数
 #define PACKAGE_MANAGER linglong::service::PackageManager::instance()
 #endif
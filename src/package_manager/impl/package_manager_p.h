@@ -12,6 +12,13 @@
 #include "module/dbus_ipc/reply.h"
 #include "module/dbus_system_helper.h"
 #include "module/package/package.h"
+#include "module/repo/ostree_repohelper.h"
+#include "system_cache_refresher.h"
+
+#include <QMutex>
+#include <QSet>
+
+class Job;
 
 namespace linglong {
 namespace service {
@@ -26,10 +33,20 @@ public:
 
 private:
     Reply Install(const InstallParamOption &installParamOption);
-    Reply Uninstall(const UninstallParamOption &paramOption);
+    Reply Uninstall(const UninstallParamOption &paramOption, bool refreshCaches);
     QueryReply Query(const QueryParamOption &paramOption);
     Reply Update(const ParamOption &paramOption);
 
+    /*
+     * 批量更新应用，所有应用共用一次远端仓库 summary 查询，共享的 runtime 只下载一次，
+     * 下载任务在有限的线程中并行执行，desktop 等数据库在全部更新完成后统一刷新
+     *
+     * @param appIds: 待更新的应用列表，为空时更新全部已安装应用
+     *
+     * @return Reply: 更新结果
+     */
+    Reply UpdateMany(const QStringList &appIds);
+
     /**
      * @brief 查询软件包下载安装状态
      *
@@ -107,64 +124,99 @@ private:
                               const QString &pkgArch,
                               QString &appData,
                               QString &err);
+
     /*
-     * 将在线包数据部分签出到指定目录
+     * 查询指定包名/版本/架构的软件包数据，缓存时间不超过 maxAge 时直接使用缓存
      *
      * @param pkgName: 软件包包名
      * @param pkgVer: 软件包版本号
      * @param pkgArch: 软件包对应的架构
-     * @param dstPath: 在线包数据部分存储路径
+     * @param maxAge: 可接受的缓存时间，单位秒
+     * @param appData: 查询结果
      * @param err: 错误信息
      *
      * @return bool: true:成功 false:失败
      */
-    bool downloadAppData(const QString &pkgName,
-                         const QString &pkgVer,
-                         const QString &pkgArch,
-                         const QString &channel,
-                         const QString &module,
-                         const QString &dstPath,
-                         QString &err);
+    bool getAppInfo(const QString &pkgName,
+                    const QString &pkgVer,
+                    const QString &pkgArch,
+                    qint64 maxAge,
+                    QString &appData,
+                    QString &err);
+
+    /*
+     * 在后台重新查询过期的缓存，同一查询同时只有一个后台任务
+     *
+     * @param pkgName: 软件包包名
+     * @param pkgArch: 软件包对应的架构
+     */
+    void revalidateAppInfo(const QString &pkgName, const QString &pkgArch);
+    /*
+     * 获取软件包的安装目录
+     *
+     * @param appInfo: 软件包信息
+     *
+     * @return QString: 安装目录
+     */
+    QString getInstallPath(linglong::package::AppMetaInfo *appInfo);
 
     /*
-     * 安装应用runtime
+     * 在同一次 pull 中下载多个在线包数据，全部下载完成后再签出到各自的安装目录
      *
-     * @param appInfo: runtime对象
+     * @param pkgList: 待下载的软件包列表
+     * @param job: 接收下载进度的任务，可为空
      * @param err: 错误信息
+     * @param onProgress: 并行下载时由调用方汇总进度，不为空时不再直接更新 job 的进度及阶段
      *
      * @return bool: true:成功 false:失败
      */
-    bool installRuntime(linglong::package::AppMetaInfo *appInfo, QString &err);
+    bool downloadAppData(const linglong::package::AppMetaInfoList &pkgList,
+                         Job *job,
+                         QString &err,
+                         const PullProgressHandler &onProgress = nullptr);
+
+    /*
+     * 查找软件包已安装的最高版本，作为增量下载的起点
+     *
+     * @param appInfo: 待下载的软件包信息
+     *
+     * @return QString: 已安装的最高版本，未安装其他版本时为空
+     */
+    QString getBaseVersion(linglong::package::AppMetaInfo *appInfo);
 
     /*
-     * 检查应用runtime安装状态
+     * 从服务器解析应用依赖的runtime
      *
      * @param runtime: 应用runtime字符串
      * @param channel: 软件包对应的渠道
      * @param module: 软件包类型
+     * @param runtimeInfo: 解析出的runtime
      * @param err: 错误信息
      *
-     * @return bool: true:安装成功或已安装返回true false:安装失败
+     * @return bool: true:成功 false:失败
      */
-    bool checkAppRuntime(const QString &runtime,
-                         const QString &channel,
-                         const QString &module,
-                         QString &err);
+    bool resolveAppRuntime(const QString &runtime,
+                           const QString &channel,
+                           const QString &module,
+                           linglong::package::AppMetaInfo *&runtimeInfo,
+                           QString &err);
 
     /*
-     * 针对非deepin发行版检查应用base安装状态
+     * 针对非deepin发行版从服务器解析runtime依赖的base
      *
-     * @param runtime: runtime ref
+     * @param runtimeInfo: 应用依赖的runtime
      * @param channel: 软件包对应的渠道
      * @param module: 软件包类型
+     * @param baseInfo: 解析出的base
      * @param err: 错误信息
      *
-     * @return bool: true:安装成功或已安装返回true false:安装失败
+     * @return bool: true:成功 false:失败
      */
-    bool checkAppBase(const QString &runtime,
-                      const QString &channel,
-                      const QString &module,
-                      QString &err);
+    bool resolveAppBase(linglong::package::AppMetaInfo *runtimeInfo,
+                        const QString &channel,
+                        const QString &module,
+                        linglong::package::AppMetaInfo *&baseInfo,
+                        QString &err);
 
     /*
      * 安装应用时更新包括desktop文件在内的配置文件
@@ -184,6 +236,44 @@ private:
      */
     void delAppConfig(const QString &appId, const QString &version, const QString &arch);
 
+    /*
+     * 获取软件包导出到系统的文件所在目录
+     *
+     * @param appId: 应用的appId
+     * @param version: 应用的版本号
+     * @param arch: 应用对应的架构
+     *
+     * @return QString: 导出目录
+     */
+    QString getEntriesPath(const QString &appId, const QString &version, const QString &arch);
+
+    /*
+     * 获取软件包链接清单的保存路径
+     *
+     * @param appId: 应用的appId
+     * @param version: 应用的版本号
+     * @param arch: 应用对应的架构
+     *
+     * @return QString: 清单文件路径
+     */
+    QString getLinkManifestPath(const QString &appId, const QString &version, const QString &arch);
+
+    /*
+     * 读取软件包的链接清单，清单不存在时(如此前安装的软件包)遍历导出目录生成并保存
+     *
+     * @param appId: 应用的appId
+     * @param version: 应用的版本号
+     * @param arch: 应用对应的架构
+     *
+     * @return QStringList: 导出文件的相对路径清单
+     */
+    QStringList getLinkManifest(const QString &appId, const QString &version, const QString &arch);
+
+    /*
+     * 更新desktop、mime type及glib schemas数据库，短时间内的多次调用合并为一次后台刷新
+     */
+    void updateSystemCaches();
+
     /*
      * 通过用户uid获取对应的用户名
      *
@@ -206,6 +296,12 @@ private:
 
     OrgDeepinLinglongSystemHelperInterface systemHelperInterface;
 
+    SystemCacheRefresher cacheRefresher;
+
+    // 保护正在后台更新的缓存查询
+    QMutex revalidateMutex;
+    QSet<QString> revalidating;
+
 public:
     PackageManager *const q_ptr;
     Q_DECLARE_PUBLIC(PackageManager);
@@ -0,0 +1,160 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "system_cache_refresher.h"
+
+#include "module/util/file.h"
+#include "module/util/runner.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QStringList>
+#include <QtConcurrent/QtConcurrent>
+
+namespace linglong {
+namespace service {
+
+namespace {
+
+// 最后一次请求后等待的时间，窗口内的请求合并为一次刷新
+const int kRefreshDelayMs = 1000;
+// 第一次请求后最长等待的时间
+const qint64 kRefreshMaxDelayMs = 1000 * 10;
+// 单个刷新工具的超时时间
+const int kToolTimeoutMs = 1000 * 60 * 1;
+
+struct CacheTool
+{
+    // 输入目录，相对 share 目录
+    QString inputDir;
+    QString program;
+    // 工具的参数，相对 share 目录
+    QString targetDir;
+    // 输入目录不存在时是否跳过
+    bool requireInput;
+};
+
+const CacheTool kCacheTools[] = {
+    { "applications", "update-desktop-database", "applications/", false },
+    { "mime/packages", "update-mime-database", "mime/", true },
+    { "glib-2.0/schemas", "glib-compile-schemas", "glib-2.0/schemas", true },
+};
+
+// 刷新工具写入输入目录的文件
+const QStringList kGeneratedFiles = { "mimeinfo.cache", "gschemas.compiled" };
+
+} // namespace
+
+SystemCacheRefresher::SystemCacheRefresher(const QString &sharePath, QObject *parent)
+    : QObject(parent)
+    , sharePath(sharePath)
+{
+    timer.setSingleShot(true);
+    connect(&timer, &QTimer::timeout, this, &SystemCacheRefresher::onTimeout);
+    pool.setMaxThreadCount(1);
+}
+
+SystemCacheRefresher::~SystemCacheRefresher()
+{
+    pool.waitForDone();
+}
+
+void SystemCacheRefresher::schedule()
+{
+    // 定时器只能在所属线程中启动
+    QMetaObject::invokeMethod(this, "arm", Qt::QueuedConnection);
+}
+
+void SystemCacheRefresher::arm()
+{
+    QMutexLocker locker(&requestMutex);
+    if (!firstRequest.isValid()) {
+        firstRequest.start();
+    }
+    auto remaining = kRefreshMaxDelayMs - firstRequest.elapsed();
+    timer.start(static_cast<int>(qBound<qint64>(0, remaining, kRefreshDelayMs)));
+}
+
+void SystemCacheRefresher::onTimeout()
+{
+    {
+        QMutexLocker locker(&requestMutex);
+        firstRequest.invalidate();
+    }
+    QtConcurrent::run(&pool, [this]() {
+        refresh();
+    });
+}
+
+void SystemCacheRefresher::refreshNow()
+{
+    refresh();
+}
+
+QByteArray SystemCacheRefresher::directorySignature(const QString &path)
+{
+    if (!linglong::util::dirExists(path)) {
+        return QByteArray();
+    }
+
+    // 导出的文件多为指向安装目录的软链接，同时记录链接本身及其目标
+    QStringList entries;
+    QDirIterator it(path,
+                    QDir::Files | QDir::System | QDir::NoDotAndDotDot,
+                    QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        const auto info = it.fileInfo();
+        if (kGeneratedFiles.contains(info.fileName())) {
+            continue;
+        }
+        entries.append(QStringList{ QDir(path).relativeFilePath(info.filePath()),
+                                    info.symLinkTarget(),
+                                    QString::number(info.size()),
+                                    QString::number(info.lastModified().toMSecsSinceEpoch()) }
+                               .join(":"));
+    }
+    entries.sort();
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData("dir");
+    for (const auto &entry : entries) {
+        hash.addData(entry.toUtf8());
+        hash.addData("\n");
+    }
+    return hash.result();
+}
+
+void SystemCacheRefresher::refresh()
+{
+    QMutexLocker locker(&refreshMutex);
+
+    for (const auto &tool : kCacheTools) {
+        const QString inputPath = sharePath + "/" + tool.inputDir;
+        const auto signature = directorySignature(inputPath);
+        if (tool.requireInput && signature.isEmpty()) {
+            continue;
+        }
+        if (signatures.contains(tool.inputDir) && signatures.value(tool.inputDir) == signature) {
+            qDebug() << tool.inputDir << "not changed, skip" << tool.program;
+            continue;
+        }
+
+        const QString targetPath = sharePath + "/" + tool.targetDir;
+        if (!linglong::runner::Runner(tool.program, { targetPath }, kToolTimeoutMs)) {
+            qWarning() << "warning: run" << tool.program << "of" << targetPath << "failed!";
+            // 失败时不记录签名，下次刷新时重试
+            signatures.remove(tool.inputDir);
+            continue;
+        }
+        signatures.insert(tool.inputDir, signature);
+    }
+}
+
+} // namespace service
+} // namespace linglong
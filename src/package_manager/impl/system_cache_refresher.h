@@ -0,0 +1,78 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_SRC_PACKAGE_MANAGER_IMPL_SYSTEM_CACHE_REFRESHER_H_
+#define LINGLONG_SRC_PACKAGE_MANAGER_IMPL_SYSTEM_CACHE_REFRESHER_H_
+
+#include <QElapsedTimer>
+#include <QMap>
+#include <QMutex>
+#include <QObject>
+#include <QThreadPool>
+#include <QTimer>
+
+namespace linglong {
+namespace service {
+
+/**
+ * @brief 合并刷新 desktop、mime type 及 glib schemas 数据库
+ * @details 安装、卸载只登记刷新请求，短时间内的多次请求合并为一次，刷新在后台线程中执行，
+ *          只重新生成输入目录内容发生变化的数据库
+ */
+class SystemCacheRefresher : public QObject
+{
+    Q_OBJECT
+public:
+    /**
+     * @param sharePath 导出到系统的 share 目录，即 entries/share
+     */
+    explicit SystemCacheRefresher(const QString &sharePath, QObject *parent = nullptr);
+    ~SystemCacheRefresher() override;
+
+    /**
+     * @brief 登记一次刷新请求，可在任意线程调用
+     */
+    void schedule();
+
+    /**
+     * @brief 在调用线程中立即刷新，用于没有事件循环的场景
+     */
+    void refreshNow();
+
+private Q_SLOTS:
+    void arm();
+    void onTimeout();
+
+private:
+    /**
+     * @brief 计算目录内容的签名，目录内由刷新工具生成的文件不参与计算
+     *
+     * @param path 目录路径
+     *
+     * @return QByteArray 目录不存在时为空
+     */
+    static QByteArray directorySignature(const QString &path);
+
+    void refresh();
+
+    const QString sharePath;
+
+    QTimer timer;
+    // 保护 firstRequest，记录合并窗口内第一次请求的时间，避免持续请求时一直推迟刷新
+    QMutex requestMutex;
+    QElapsedTimer firstRequest;
+
+    // 刷新串行执行，保护 signatures
+    QMutex refreshMutex;
+    // 上次刷新成功时各输入目录的签名
+    QMap<QString, QByteArray> signatures;
+
+    QThreadPool pool;
+};
+
+} // namespace service
+} // namespace linglong
+#endif
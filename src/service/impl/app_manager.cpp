@@ -7,11 +7,13 @@
 #include "app_manager.h"
 
 #include "app_manager_p.h"
+#include "module/repo/layer_catalog.h"
 #include "module/runtime/app.h"
 #include "module/util/app_status.h"
 #include "module/util/file.h"
 #include "module/util/status_code.h"
 #include "module/util/sysinfo.h"
+#include "module/util/trace.h"
 
 #include <signal.h>
 #include <sys/types.h>
@@ -23,6 +25,29 @@ AppManagerPrivate::AppManagerPrivate(AppManager *parent)
     : repo(util::getLinglongRootPath())
     , q_ptr(parent)
 {
+    connect(&supervisor,
+            &ContainerSupervisor::exited,
+            this,
+            &AppManagerPrivate::onContainerExited);
+}
+
+void AppManagerPrivate::onContainerExited(const QString &containerId, int exitCode)
+{
+    Q_Q(AppManager);
+
+    // 最后一个持有者释放时删除应用
+    apps.take(containerId);
+    Q_EMIT q->ContainerExited(containerId, exitCode);
+}
+
+void AppManagerPrivate::trackLaunch(const QFuture<void> &future)
+{
+    QMutexLocker locker(&launchesMutex);
+    // 只保留未完成的任务，避免服务中的列表持续增长
+    for (auto it = launches.begin(); it != launches.end();) {
+        it = it->isFinished() ? launches.erase(it) : it + 1;
+    }
+    launches.append(future);
 }
 
 AppManager::AppManager()
@@ -30,10 +55,39 @@ AppManager::AppManager()
     , dd_ptr(new AppManagerPrivate(this))
 {
     runPool->setMaxThreadCount(RUN_POOL_MAX_THREAD);
+    // ll-box 设置了 PR_SET_PDEATHSIG，创建它的线程退出时容器会被杀死，线程不能回收
+    runPool->setExpiryTimeout(-1);
 }
 
 AppManager::~AppManager() { }
 
+void AppManager::waitForContainers()
+{
+    Q_D(AppManager);
+
+    // 不能使用 runPool->waitForDone，它会回收线程池中的线程，由这些线程创建的 ll-box 会随之被杀死
+    QList<QFuture<void>> launches;
+    {
+        QMutexLocker locker(&d->launchesMutex);
+        launches.swap(d->launches);
+    }
+    for (auto &launch : launches) {
+        launch.waitForFinished();
+    }
+
+    // 容器退出的通知在当前线程的事件循环中处理，检查与进入事件循环之间不会丢失
+    QEventLoop loop;
+    connect(this, &AppManager::ContainerExited, &loop, [d, &loop]() {
+        if (d->apps.isEmpty()) {
+            loop.quit();
+        }
+    });
+    if (d->apps.isEmpty()) {
+        return;
+    }
+    loop.exec();
+}
+
 /*
  * 执行软件包
  *
@@ -68,6 +122,29 @@ Reply AppManager::Start(const RunParamOption &paramOption)
         version = paramOption.version.trimmed();
     }
 
+    // 应用已经在运行时直接转发运行参数，不再查询安装状态及仓库
+    // 未指定版本时启动的是已安装的最新版本，只转发给该版本的实例
+    QString runningVersion = version;
+    if (runningVersion.isEmpty()) {
+        runningVersion = LAYER_CATALOG->latestVersion(
+                linglong::util::getLinglongRootPath() + "/layers", appId);
+    }
+    if (!runningVersion.isEmpty()) {
+        auto runningApp = d->apps.findApp(appId, runningVersion, arch);
+        if (runningApp) {
+            // 写入 ll-box 可能阻塞，不能占用 D-Bus 线程
+            const QString exec = paramOption.exec;
+            d->trackLaunch(QtConcurrent::run(runPool.data(), [runningApp, exec]() {
+                runningApp->exec(exec, "", "");
+            }));
+            return reply;
+        }
+    }
+
+    // 启动耗时记录，启动线程完成后保存
+    auto trace = std::make_shared<util::LaunchTrace>(appId);
+    util::TraceAttach traceAttach(trace.get());
+
     if (paramOption.noDbusProxy) {
         paramMap.insert(linglong::util::kKeyNoProxy, "");
     }
@@ -111,7 +188,13 @@ Reply AppManager::Start(const RunParamOption &paramOption)
     }
 
     // 判断是否已安装
-    if (!linglong::util::getAppInstalledStatus(appId, version, arch, channel, appModule, "")) {
+    bool installed = false;
+    {
+        LINGLONG_TRACE_SCOPE("getAppInstalledStatus");
+        installed =
+                linglong::util::getAppInstalledStatus(appId, version, arch, channel, appModule, "");
+    }
+    if (!installed) {
         reply.message = appId + ", version:" + version + ", arch:" + arch + ", channel:" + channel
                 + ", module:" + appModule + " not installed";
         qCritical() << reply.message;
@@ -140,36 +223,43 @@ Reply AppManager::Start(const RunParamOption &paramOption)
     const QString userSystemdServicePath =
             linglong::util::ensureUserDir({ ".config/systemd/user" });
     if (linglong::util::dirExists(appUserServicePath)) {
+        LINGLONG_TRACE_SCOPE("linkDirFiles");
         linglong::util::linkDirFiles(appUserServicePath, userSystemdServicePath);
     }
 
     QFuture<void> future = QtConcurrent::run(runPool.data(), [=]() {
+        util::TraceAttach traceAttach(trace.get());
         // 判断是否存在
         linglong::package::Ref ref("", channel, appId, version, arch, appModule);
 
-        // 判断是否是正在运行应用
-        auto latestAppRef = d->repo.latestOfRef(appId, version);
-        for (const auto &app : d->apps) {
-            if (latestAppRef.toString() == app->container()->packageName) {
-                app->exec(desktopExec, "", "");
-                return;
-            }
-        }
-
         auto app = linglong::runtime::App::load(&d->repo, ref, desktopExec);
         if (nullptr == app) {
             // FIXME: set job status to failed
             qCritical() << "load app failed " << app;
+            TRACE_RECORDER->record(trace);
             return;
         }
         app->saveUserEnvList(userEnvList);
         app->setAppParamMap(paramMap);
-        auto it = d->apps.insert(app->container()->id, QPointer<linglong::runtime::App>(app));
-        app->start();
-        d->apps.erase(it);
-        app->deleteLater();
+        pid_t boxPid = app->launch();
+        trace->id = app->container()->id;
+        TRACE_RECORDER->record(trace);
+        if (boxPid < 0) {
+            qCritical() << "start container failed" << app->container()->id;
+            delete app;
+            return;
+        }
+
+        // 启动线程立即返回，应用由 AppManager 所在线程持有，容器退出时释放
+        app->moveToThread(d->thread());
+        const QString containerId = app->container()->id;
+        d->apps.insert(containerId,
+                       ContainerRegistry::AppPtr(app, [](linglong::runtime::App *app) {
+                           app->deleteLater();
+                       }));
+        d->supervisor.watch(containerId, boxPid);
     });
-    // future.waitForFinished();
+    d->trackLaunch(future);
     return reply;
 }
 
@@ -179,14 +269,11 @@ Reply AppManager::Exec(const ExecParamOption &paramOption)
     Reply reply;
     reply.code = STATUS_CODE(kFail);
     reply.message = "No such container " + paramOption.containerID;
-    auto const &containerID = paramOption.containerID;
-    for (auto it : d->apps) {
-        if (it->container()->id == containerID) {
-            it->exec(paramOption.cmd, paramOption.env, paramOption.cwd);
-            reply.code = STATUS_CODE(kSuccess);
-            reply.message = "Exec successed";
-            return reply;
-        }
+    auto app = d->apps.find(paramOption.containerID);
+    if (app) {
+        app->exec(paramOption.cmd, paramOption.env, paramOption.cwd);
+        reply.code = STATUS_CODE(kSuccess);
+        reply.message = "Exec successed";
     }
     return reply;
 }
@@ -202,14 +289,13 @@ Reply AppManager::Stop(const QString &containerId)
 {
     Q_D(AppManager);
     Reply reply;
-    auto it = d->apps.find(containerId);
-    if (it == d->apps.end()) {
+    auto app = d->apps.find(containerId);
+    if (!app) {
         reply.code = STATUS_CODE(kUserInputParamErr);
         reply.message = "containerId:" + containerId + " not exist";
         qCritical() << reply.message;
         return reply;
     }
-    auto app = it->data();
     pid_t pid = app->container()->pid;
     int ret = kill(pid, SIGKILL);
     if (ret != 0) {
@@ -223,12 +309,25 @@ Reply AppManager::Stop(const QString &containerId)
     return reply;
 }
 
+QueryReply AppManager::ListLaunchTrace(const QString &containerId, const QString &format)
+{
+    auto traces = TRACE_RECORDER->traces(containerId);
+    auto result = "chrome" == format ? util::TraceRecorder::toChromeTrace(traces)
+                                     : util::TraceRecorder::toBreakdown(traces);
+
+    QueryReply reply;
+    reply.code = STATUS_CODE(kSuccess);
+    reply.message = "Success";
+    reply.result = QString::fromUtf8(QJsonDocument(result).toJson(QJsonDocument::Compact));
+    return reply;
+}
+
 QueryReply AppManager::ListContainer()
 {
     Q_D(AppManager);
     QJsonArray jsonArray;
 
-    for (const auto &app : d->apps) {
+    for (const auto &app : d->apps.list()) {
         auto container = QPointer<Container>(new Container);
         container->id = app->container()->id;
         container->pid = app->container()->pid;
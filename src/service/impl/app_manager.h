@@ -86,6 +86,17 @@ public Q_SLOTS:
      */
     QueryReply ListContainer();
 
+    /**
+     * @brief 查询最近的应用启动耗时
+     *
+     * @param containerId 容器id，为空时查询全部记录
+     * @param format 为 "chrome" 时返回 Chrome trace event 格式，否则返回各阶段耗时
+     *
+     * @return QueryReply \n
+     *         result 为 json 数组，时间单位为微秒
+     */
+    QueryReply ListLaunchTrace(const QString &containerId, const QString &format);
+
     /**
      * @brief 执行终端命令
      *
@@ -96,8 +107,23 @@ public Q_SLOTS:
      */
     Reply RunCommand(const QString &exe, const QStringList args);
 
+Q_SIGNALS:
+    /**
+     * @brief 应用容器退出
+     *
+     * @param containerId 容器id
+     * @param exitCode 退出码，被信号终止时为 128 + 信号值
+     */
+    void ContainerExited(const QString &containerId, int exitCode);
+
 public:
-    QScopedPointer<QThreadPool> runPool; ///< 启动应用线程池
+    /**
+     * @brief 等待已提交的启动任务完成并且所有容器退出，用于不经过服务直接运行应用。
+     *        不回收启动线程池中的线程
+     */
+    void waitForContainers();
+
+    QScopedPointer<QThreadPool> runPool; ///< 启动应用线程池，只负责准备并启动容器
 
 private:
     QScopedPointer<AppManagerPrivate> dd_ptr;
@@ -111,6 +137,6 @@ protected:
 } // namespace service
 } // namespace linglong
 
-#define RUN_POOL_MAX_THREAD 100000000 ///< 启动应用线程池最大线程数
+#define RUN_POOL_MAX_THREAD 4 ///< 启动应用线程池最大线程数
 #define APP_MANAGER linglong::service::AppManager::instance()
 #endif
@@ -7,9 +7,14 @@
 #ifndef LINGLONG_SRC_SERVICE_IMPL_APP_MANAGER_P_H_
 #define LINGLONG_SRC_SERVICE_IMPL_APP_MANAGER_P_H_
 
+#include "container_registry.h"
+#include "container_supervisor.h"
 #include "module/repo/ostree_repo.h"
 #include "module/runtime/app.h"
 
+#include <QFuture>
+#include <QMutex>
+
 namespace linglong {
 namespace service {
 class AppManager;
@@ -22,8 +27,19 @@ public:
     ~AppManagerPrivate() override = default;
 
 private:
-    QMap<QString, QPointer<linglong::runtime::App>> apps;
+    // 容器退出后移除应用并通知调用方，在 AppManager 所在线程中执行
+    void onContainerExited(const QString &containerId, int exitCode);
+
+    // 记录提交到启动线程池的任务，同时移除已完成的任务
+    void trackLaunch(const QFuture<void> &future);
+
+    ContainerRegistry apps;
     linglong::repo::OSTreeRepo repo;
+    ContainerSupervisor supervisor;
+
+    // 已提交到启动线程池的任务（启动容器及转发运行参数），不经过服务直接运行时等待其完成
+    QMutex launchesMutex;
+    QList<QFuture<void>> launches;
 
 public:
     AppManager *const q_ptr;
@@ -0,0 +1,92 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "container_registry.h"
+
+#include "module/package/ref.h"
+#include "module/runtime/app.h"
+
+#include <atomic>
+
+namespace linglong {
+namespace service {
+
+ContainerRegistry::ContainerRegistry()
+    : index(std::make_shared<const Index>())
+{
+}
+
+std::shared_ptr<const ContainerRegistry::Index> ContainerRegistry::snapshot() const
+{
+    return std::atomic_load(&index);
+}
+
+void ContainerRegistry::insert(const QString &containerId, const AppPtr &app)
+{
+    // 启动时解析一次，查找时不再解析 ref
+    package::Ref ref(app->container()->packageName);
+
+    QMutexLocker locker(&writeMutex);
+    auto next = std::make_shared<Index>(*snapshot());
+    next->byId.insert(containerId, Entry{ ref.appId, ref.version, ref.arch, app });
+    next->idsByAppId.insert(ref.appId, containerId);
+    std::atomic_store(&index, std::shared_ptr<const Index>(next));
+}
+
+ContainerRegistry::AppPtr ContainerRegistry::take(const QString &containerId)
+{
+    QMutexLocker locker(&writeMutex);
+    auto current = snapshot();
+    auto iter = current->byId.constFind(containerId);
+    if (iter == current->byId.constEnd()) {
+        return nullptr;
+    }
+
+    auto app = iter->app;
+    auto next = std::make_shared<Index>(*current);
+    next->idsByAppId.remove(iter->appId, containerId);
+    next->byId.remove(containerId);
+    std::atomic_store(&index, std::shared_ptr<const Index>(next));
+    return app;
+}
+
+ContainerRegistry::AppPtr ContainerRegistry::find(const QString &containerId) const
+{
+    return snapshot()->byId.value(containerId).app;
+}
+
+ContainerRegistry::AppPtr ContainerRegistry::findApp(const QString &appId,
+                                                     const QString &version,
+                                                     const QString &arch) const
+{
+    auto current = snapshot();
+    for (auto iter = current->idsByAppId.constFind(appId);
+         iter != current->idsByAppId.constEnd() && iter.key() == appId;
+         ++iter) {
+        const auto entry = current->byId.value(iter.value());
+        if ((version.isEmpty() || entry.version == version) && entry.arch == arch) {
+            return entry.app;
+        }
+    }
+    return nullptr;
+}
+
+QList<ContainerRegistry::AppPtr> ContainerRegistry::list() const
+{
+    QList<AppPtr> apps;
+    for (const auto &entry : snapshot()->byId) {
+        apps.append(entry.app);
+    }
+    return apps;
+}
+
+bool ContainerRegistry::isEmpty() const
+{
+    return snapshot()->byId.isEmpty();
+}
+
+} // namespace service
+} // namespace linglong
@@ -0,0 +1,110 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_SRC_SERVICE_IMPL_CONTAINER_REGISTRY_H_
+#define LINGLONG_SRC_SERVICE_IMPL_CONTAINER_REGISTRY_H_
+
+#include <QHash>
+#include <QList>
+#include <QMultiHash>
+#include <QMutex>
+#include <QString>
+
+#include <memory>
+
+namespace linglong {
+namespace runtime {
+class App;
+}
+} // namespace linglong
+
+namespace linglong {
+namespace service {
+
+/**
+ * @brief 正在运行的容器索引，按容器id及appId查找
+ * @details 读操作不加锁，只读取当前快照；写操作串行执行，复制快照修改后整体替换。
+ *          返回的应用由共享指针持有，容器退出后在调用方释放前仍然有效
+ */
+class ContainerRegistry
+{
+public:
+    typedef std::shared_ptr<linglong::runtime::App> AppPtr;
+
+    ContainerRegistry();
+
+    /**
+     * @brief 添加已启动的容器
+     *
+     * @param containerId 容器id
+     * @param app 容器对应的应用
+     */
+    void insert(const QString &containerId, const AppPtr &app);
+
+    /**
+     * @brief 移除容器
+     *
+     * @param containerId 容器id
+     *
+     * @return AppPtr 容器对应的应用，不存在时为空
+     */
+    AppPtr take(const QString &containerId);
+
+    /**
+     * @brief 按容器id查找
+     *
+     * @param containerId 容器id
+     *
+     * @return AppPtr 容器对应的应用，不存在时为空
+     */
+    AppPtr find(const QString &containerId) const;
+
+    /**
+     * @brief 查找正在运行的应用实例
+     *
+     * @param appId 应用id
+     * @param version 版本，为空时匹配任意版本
+     * @param arch 架构
+     *
+     * @return AppPtr 找到的应用，不存在时为空
+     */
+    AppPtr findApp(const QString &appId, const QString &version, const QString &arch) const;
+
+    /**
+     * @brief 获取全部正在运行的应用
+     *
+     * @return QList<AppPtr> 应用列表
+     */
+    QList<AppPtr> list() const;
+
+    bool isEmpty() const;
+
+private:
+    struct Entry
+    {
+        QString appId;
+        QString version;
+        QString arch;
+        AppPtr app;
+    };
+
+    struct Index
+    {
+        QHash<QString, Entry> byId;
+        // appId -> 容器id
+        QMultiHash<QString, QString> idsByAppId;
+    };
+
+    std::shared_ptr<const Index> snapshot() const;
+
+    // 串行化写操作
+    QMutex writeMutex;
+    std::shared_ptr<const Index> index;
+};
+
+} // namespace service
+} // namespace linglong
+#endif
@@ -0,0 +1,124 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include "container_supervisor.h"
+
+#include <QDebug>
+#include <QSocketNotifier>
+
+#include <errno.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+namespace linglong {
+namespace service {
+
+namespace {
+
+// 不支持 pidfd 时检查子进程状态的间隔
+const int kPollIntervalMs = 500;
+
+int pidfdOpen(pid_t pid)
+{
+    return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+}
+
+} // namespace
+
+ContainerSupervisor::ContainerSupervisor(QObject *parent)
+    : QObject(parent)
+{
+    pollTimer.setInterval(kPollIntervalMs);
+    connect(&pollTimer, &QTimer::timeout, this, &ContainerSupervisor::pollChildren);
+}
+
+ContainerSupervisor::~ContainerSupervisor()
+{
+    for (const auto &watch : watches) {
+        if (watch.pidfd >= 0) {
+            close(watch.pidfd);
+        }
+    }
+}
+
+void ContainerSupervisor::watch(const QString &containerId, pid_t pid)
+{
+    // QSocketNotifier 只能在所属线程中创建
+    QMetaObject::invokeMethod(this,
+                              "addWatch",
+                              Qt::QueuedConnection,
+                              Q_ARG(QString, containerId),
+                              Q_ARG(qint64, pid));
+}
+
+void ContainerSupervisor::addWatch(const QString &containerId, qint64 pid)
+{
+    Watch watch;
+    watch.containerId = containerId;
+    watch.pidfd = pidfdOpen(static_cast<pid_t>(pid));
+    if (watch.pidfd >= 0) {
+        watch.notifier = new QSocketNotifier(watch.pidfd, QSocketNotifier::Read, this);
+        connect(watch.notifier, &QSocketNotifier::activated, this, [this, pid]() {
+            reap(static_cast<pid_t>(pid));
+        });
+    } else {
+        qDebug() << "pidfd_open unavailable, poll" << pid << "instead";
+        pollTimer.start();
+    }
+    watches.insert(static_cast<pid_t>(pid), watch);
+
+    // 进程可能在开始监视前已经退出
+    reap(static_cast<pid_t>(pid));
+}
+
+void ContainerSupervisor::pollChildren()
+{
+    bool polling = false;
+    for (const auto pid : watches.keys()) {
+        if (watches.value(pid).pidfd < 0 && !reap(pid)) {
+            polling = true;
+        }
+    }
+    if (!polling) {
+        pollTimer.stop();
+    }
+}
+
+bool ContainerSupervisor::reap(pid_t pid)
+{
+    int status = 0;
+    pid_t ret = waitpid(pid, &status, WNOHANG);
+    if (ret == 0 || (ret < 0 && errno == EINTR)) {
+        return false;
+    }
+
+    auto watch = watches.take(pid);
+    if (watch.notifier != nullptr) {
+        watch.notifier->setEnabled(false);
+        watch.notifier->deleteLater();
+    }
+    if (watch.pidfd >= 0) {
+        close(watch.pidfd);
+    }
+
+    int exitCode = -1;
+    if (ret > 0 && WIFEXITED(status)) {
+        exitCode = WEXITSTATUS(status);
+    } else if (ret > 0 && WIFSIGNALED(status)) {
+        exitCode = 128 + WTERMSIG(status);
+    }
+    qInfo() << "container" << watch.containerId << "pid" << pid << "exited with" << exitCode;
+    Q_EMIT exited(watch.containerId, exitCode);
+    return true;
+}
+
+} // namespace service
+} // namespace linglong
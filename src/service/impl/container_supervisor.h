@@ -0,0 +1,73 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#ifndef LINGLONG_SRC_SERVICE_IMPL_CONTAINER_SUPERVISOR_H_
+#define LINGLONG_SRC_SERVICE_IMPL_CONTAINER_SUPERVISOR_H_
+
+#include <QMap>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+
+#include <sys/types.h>
+
+class QSocketNotifier;
+
+namespace linglong {
+namespace service {
+
+/**
+ * @brief 监视 ll-box 子进程，进程退出时回收并发出 exited 信号
+ * @details 通过 pidfd 在所属线程的事件循环中等待进程退出，不需要为每个容器占用一个线程。
+ *          内核不支持 pidfd_open 时退化为定时调用 waitpid(WNOHANG)
+ */
+class ContainerSupervisor : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ContainerSupervisor(QObject *parent = nullptr);
+    ~ContainerSupervisor() override;
+
+    /**
+     * @brief 开始监视容器进程，可在任意线程调用
+     *
+     * @param containerId 容器id
+     * @param pid ll-box 进程号，必须是当前进程的子进程
+     */
+    void watch(const QString &containerId, pid_t pid);
+
+Q_SIGNALS:
+    /**
+     * @brief 容器进程退出，在所属线程中发出
+     *
+     * @param containerId 容器id
+     * @param exitCode 退出码，被信号终止时为 128 + 信号值
+     */
+    void exited(const QString &containerId, int exitCode);
+
+private Q_SLOTS:
+    void addWatch(const QString &containerId, qint64 pid);
+    void pollChildren();
+
+private:
+    struct Watch
+    {
+        QString containerId;
+        int pidfd = -1;
+        QSocketNotifier *notifier = nullptr;
+    };
+
+    // 回收进程，未退出时返回 false
+    bool reap(pid_t pid);
+
+    QMap<pid_t, Watch> watches;
+    QTimer pollTimer;
+};
+
+} // namespace service
+} // namespace linglong
+#endif
@@ -0,0 +1,43 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <gtest/gtest.h>
+
+#include "module/repo/layer_catalog.h"
+#include "module/util/version/version.h"
+
+#include <QDir>
+#include <QTemporaryDir>
+
+TEST(Module_Repo, LayerCatalog)
+{
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+    const QString layersRoot = tempDir.path();
+    const QString appId = "org.deepin.Runtime";
+
+    QDir root(layersRoot);
+    for (const auto &version : { "20.5.0", "20.5.12", "20.50.1", "23.0.0", "20.5.2" }) {
+        ASSERT_TRUE(root.mkpath(appId + "/" + version));
+    }
+
+    EXPECT_EQ(LAYER_CATALOG->latestVersion(layersRoot, appId).toStdString(), "23.0.0");
+    EXPECT_EQ(LAYER_CATALOG->matchedVersion(layersRoot, appId, "20.5").toStdString(), "20.50.1");
+    EXPECT_EQ(LAYER_CATALOG->matchedVersion(layersRoot, appId, "20.5.").toStdString(), "20.5.12");
+    EXPECT_EQ(LAYER_CATALOG->matchedVersion(layersRoot, appId, "21"),
+              linglong::util::APP_MIN_VERSION);
+    EXPECT_TRUE(LAYER_CATALOG->latestVersion(layersRoot, "org.deepin.none").isEmpty());
+
+    // 目录变化后重新读取
+    ASSERT_TRUE(root.mkpath(appId + "/23.1.0"));
+    LAYER_CATALOG->invalidate(layersRoot, appId);
+    EXPECT_EQ(LAYER_CATALOG->latestVersion(layersRoot, appId).toStdString(), "23.1.0");
+
+    ASSERT_TRUE(root.rmdir(appId + "/23.1.0"));
+    ASSERT_TRUE(root.rmdir(appId + "/23.0.0"));
+    LAYER_CATALOG->invalidate(layersRoot, appId);
+    EXPECT_EQ(LAYER_CATALOG->latestVersion(layersRoot, appId).toStdString(), "20.50.1");
+}
@@ -0,0 +1,37 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <gtest/gtest.h>
+
+#include "module/repo/remote_ref_index.h"
+
+TEST(Module_Repo, RemoteRefIndex)
+{
+    QMap<QString, QString> refs;
+    refs.insert("linglong/org.deepin.calculator/5.7.10/x86_64/runtime", "c1");
+    refs.insert("linglong/org.deepin.calculator/5.7.9/x86_64/runtime", "c2");
+    refs.insert("linglong/org.deepin.calculator/5.7.21/arm64/runtime", "c3");
+    refs.insert("org.deepin.calculator/5.7.2/x86_64", "c4");
+
+    linglong::repo::RemoteRefIndex index;
+    index.build(refs);
+    EXPECT_FALSE(index.isEmpty());
+    EXPECT_EQ(index.entries("org.deepin.calculator").size(), 4);
+
+    linglong::repo::RemoteRefEntry entry;
+    EXPECT_TRUE(index.findLatest("org.deepin.calculator", "x86_64", "", entry));
+    EXPECT_EQ(entry.version.toStdString(), "5.7.10");
+    EXPECT_EQ(entry.checksum.toStdString(), "c1");
+
+    EXPECT_TRUE(index.findLatest("org.deepin.calculator", "", "", entry));
+    EXPECT_EQ(entry.version.toStdString(), "5.7.21");
+
+    EXPECT_TRUE(index.findVersion("org.deepin.calculator", "5.7.2", "x86_64", "", entry));
+    EXPECT_EQ(entry.ref.toStdString(), "org.deepin.calculator/5.7.2/x86_64");
+
+    EXPECT_FALSE(index.findVersion("org.deepin.calculator", "5.7.2", "arm64", "", entry));
+    EXPECT_FALSE(index.findLatest("org.deepin.music", "", "", entry));
+}
@@ -40,3 +40,31 @@ TEST(AppTest, StructTest)
 
     appYaml->deleteLater();
 }
+
+TEST(AppTest, FromYamlVariant)
+{
+    linglong::runtime::registerAllMetaType();
+
+    // 缓存的是 YAML 转换后的 QVariantMap，由其创建的对象需与直接解析 YAML 一致
+    auto yamlLoad = YAML::LoadFile("../../test/data/demo/app-test.yaml");
+    auto config = yamlLoad.as<QVariant>().toMap();
+    EXPECT_FALSE(config.isEmpty());
+
+    for (int i = 0; i < 2; ++i) {
+        auto app = formYamlVariant<linglong::runtime::App>(config);
+        ASSERT_NE(app, nullptr);
+
+        EXPECT_EQ(app->version, "1.0");
+        EXPECT_EQ(app->package->ref, "org.deepin.calculator/5.7.16/x86_64");
+        EXPECT_EQ(app->package->parent(), app);
+        EXPECT_EQ(app->runtime->ref, "org.deepin.Runtime/20.5.0/x86_64");
+
+        ASSERT_NE(app->permissions, nullptr);
+        ASSERT_NE(app->permissions->mounts.size(), 0);
+        EXPECT_EQ(app->permissions->mounts[0]->type, "bind");
+        EXPECT_EQ(app->permissions->mounts[0]->options, "rw,rbind");
+        EXPECT_EQ(app->permissions->mounts[0]->source, "/home/linglong/Desktop");
+
+        delete app;
+    }
+}
@@ -0,0 +1,198 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <gtest/gtest.h>
+
+#include "module/runtime/oci.h"
+#include "module/runtime/oci_writer.h"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMetaProperty>
+
+TEST(Module_Runtime, OciWriter)
+{
+    linglong::runtime::registerAllOciMetaType();
+
+    QFile jsonFile("../../test/data/demo/config.json");
+    ASSERT_TRUE(jsonFile.open(QIODevice::ReadOnly));
+    auto r = QJsonDocument::fromJson(jsonFile.readAll()).toVariant().value<Runtime *>();
+    ASSERT_NE(r, nullptr);
+
+    r->hostname = "quote\" backslash\\ newline\n 中文";
+    QPointer<Mount> m(new Mount(r));
+    m->type = "bind";
+    m->source = "/tmp/a b";
+    m->destination = "/tmp/\t";
+    m->options = QStringList{ "rbind", "ro" };
+    r->mounts.push_back(m);
+
+    // 与原有的 QVariant 序列化结果一致
+    auto expect = QJsonDocument::fromVariant(toVariant<Runtime>(r));
+    auto encoded = QJsonDocument::fromJson(linglong::runtime::encodeRuntime(r));
+    EXPECT_FALSE(encoded.isNull());
+    EXPECT_EQ(encoded, expect);
+
+    auto process = QJsonDocument::fromJson(linglong::runtime::encodeProcess(r->process));
+    EXPECT_EQ(process, QJsonDocument::fromVariant(toVariant<Process>(r->process)));
+
+    r->deleteLater();
+}
+
+TEST(Module_Runtime, OciWriterAnnotationsAndHooks)
+{
+    linglong::runtime::registerAllOciMetaType();
+
+    QFile jsonFile("../../test/data/demo/config.json");
+    ASSERT_TRUE(jsonFile.open(QIODevice::ReadOnly));
+    auto r = QJsonDocument::fromJson(jsonFile.readAll()).toVariant().value<Runtime *>();
+    ASSERT_NE(r, nullptr);
+
+    r->annotations = new Annotations(r);
+    r->annotations->containerRootPath = "/run/user/1000/linglong/0123456789abcdef";
+
+    r->annotations->overlayfs = new AnnotationsOverlayfsRootfs(r->annotations);
+    r->annotations->overlayfs->lowerParent = "/tmp/lower";
+    r->annotations->overlayfs->upper = "/tmp/upper";
+    r->annotations->overlayfs->workdir = "/tmp/work";
+    QPointer<Mount> overlayMount(new Mount(r->annotations->overlayfs));
+    overlayMount->type = "bind";
+    overlayMount->source = "/usr";
+    overlayMount->destination = "/usr";
+    overlayMount->options = QStringList{ "ro", "rbind" };
+    r->annotations->overlayfs->mounts.push_back(overlayMount);
+
+    r->annotations->native = new AnnotationsNativeRootfs(r->annotations);
+    QPointer<Mount> nativeMount(new Mount(r->annotations->native));
+    nativeMount->type = "tmpfs";
+    nativeMount->source = "tmpfs";
+    nativeMount->destination = "/tmp";
+    r->annotations->native->mounts.push_back(nativeMount);
+
+    r->annotations->dbusProxyInfo = new DBusProxy(r->annotations);
+    r->annotations->dbusProxyInfo->enable = true;
+    r->annotations->dbusProxyInfo->busType = "session";
+    r->annotations->dbusProxyInfo->appId = "org.deepin.demo";
+    r->annotations->dbusProxyInfo->proxyPath = "/run/user/1000/linglong/bus";
+    r->annotations->dbusProxyInfo->name = QStringList{ "org.deepin.demo.*" };
+    r->annotations->dbusProxyInfo->path = QStringList{ "/org/deepin/demo" };
+    r->annotations->dbusProxyInfo->interface = QStringList{ "org.deepin.demo.\"quoted\"" };
+
+    r->hooks = new Hooks(r);
+    QPointer<Hook> prestart(new Hook(r->hooks));
+    prestart->path = "/sbin/ldconfig";
+    prestart->args = QStringList{ "ldconfig", "-C", "/tmp/ld.so.cache" };
+    r->hooks->prestart.push_back(prestart);
+    QPointer<Hook> poststop(new Hook(r->hooks));
+    poststop->path = "/bin/sh";
+    poststop->args = QStringList{ "sh", "-c", "echo done" };
+    poststop->env = QStringList{ "LANG=C" };
+    r->hooks->poststop.push_back(poststop);
+
+    auto expect = QJsonDocument::fromVariant(toVariant<Runtime>(r));
+    auto encoded = QJsonDocument::fromJson(linglong::runtime::encodeRuntime(r));
+    EXPECT_FALSE(encoded.isNull());
+    EXPECT_EQ(encoded, expect);
+
+    r->deleteLater();
+}
+
+namespace {
+
+// 逐个检查 meta-object 上声明的属性都被写入了 JSON，oci.h 新增字段而 oci_writer 未同步时失败
+void expectAllProperties(const QMetaObject &meta, const QJsonValue &value)
+{
+    ASSERT_TRUE(value.isObject()) << meta.className();
+    auto object = value.toObject();
+    for (int i = meta.propertyOffset(); i < meta.propertyCount(); ++i) {
+        QString name = meta.property(i).name();
+        EXPECT_TRUE(object.contains(name)) << meta.className() << "." << name.toStdString();
+    }
+}
+
+} // namespace
+
+TEST(Module_Runtime, OciWriterCoversAllProperties)
+{
+    linglong::runtime::registerAllOciMetaType();
+
+    QFile jsonFile("../../test/data/demo/config.json");
+    ASSERT_TRUE(jsonFile.open(QIODevice::ReadOnly));
+    auto r = QJsonDocument::fromJson(jsonFile.readAll()).toVariant().value<Runtime *>();
+    ASSERT_NE(r, nullptr);
+    ASSERT_NE(r->root, nullptr);
+    ASSERT_NE(r->process, nullptr);
+    ASSERT_NE(r->linux, nullptr);
+    ASSERT_FALSE(r->linux->namespaces.isEmpty());
+    ASSERT_FALSE(r->mounts.isEmpty());
+
+    // 每一个可选的子对象和列表都至少填充一项，保证所有类都会出现在输出中
+    QPointer<IdMap> uidMap(new IdMap(r->linux));
+    uidMap->hostId = 1000;
+    uidMap->size = 1;
+    r->linux->uidMappings.push_back(uidMap);
+    QPointer<IdMap> gidMap(new IdMap(r->linux));
+    gidMap->hostId = 1000;
+    gidMap->size = 1;
+    r->linux->gidMappings.push_back(gidMap);
+
+    r->hooks = new Hooks(r);
+    for (auto list : { &r->hooks->prestart, &r->hooks->poststart, &r->hooks->poststop }) {
+        QPointer<Hook> hook(new Hook(r->hooks));
+        hook->path = "/bin/true";
+        list->push_back(hook);
+    }
+
+    r->annotations = new Annotations(r);
+    r->annotations->overlayfs = new AnnotationsOverlayfsRootfs(r->annotations);
+    QPointer<Mount> overlayMount(new Mount(r->annotations->overlayfs));
+    r->annotations->overlayfs->mounts.push_back(overlayMount);
+    r->annotations->native = new AnnotationsNativeRootfs(r->annotations);
+    QPointer<Mount> nativeMount(new Mount(r->annotations->native));
+    r->annotations->native->mounts.push_back(nativeMount);
+    r->annotations->dbusProxyInfo = new DBusProxy(r->annotations);
+
+    auto encoded = QJsonDocument::fromJson(linglong::runtime::encodeRuntime(r)).object();
+    ASSERT_FALSE(encoded.isEmpty());
+
+    expectAllProperties(Runtime::staticMetaObject, encoded);
+    expectAllProperties(Root::staticMetaObject, encoded.value("root"));
+    expectAllProperties(Process::staticMetaObject, encoded.value("process"));
+    expectAllProperties(Mount::staticMetaObject, encoded.value("mounts").toArray().first());
+
+    auto linuxObject = encoded.value("linux").toObject();
+    expectAllProperties(Linux::staticMetaObject, linuxObject);
+    expectAllProperties(Namespace::staticMetaObject,
+                        linuxObject.value("namespaces").toArray().first());
+    expectAllProperties(IdMap::staticMetaObject,
+                        linuxObject.value("uidMappings").toArray().first());
+    expectAllProperties(IdMap::staticMetaObject,
+                        linuxObject.value("gidMappings").toArray().first());
+
+    auto hooks = encoded.value("hooks").toObject();
+    expectAllProperties(Hooks::staticMetaObject, hooks);
+    for (const auto &stage : { "prestart", "poststart", "poststop" }) {
+        expectAllProperties(Hook::staticMetaObject, hooks.value(stage).toArray().first());
+    }
+
+    auto annotations = encoded.value("annotations").toObject();
+    expectAllProperties(Annotations::staticMetaObject, annotations);
+    auto overlayfs = annotations.value("overlayfs").toObject();
+    expectAllProperties(AnnotationsOverlayfsRootfs::staticMetaObject, overlayfs);
+    expectAllProperties(Mount::staticMetaObject, overlayfs.value("mounts").toArray().first());
+    auto native = annotations.value("native").toObject();
+    expectAllProperties(AnnotationsNativeRootfs::staticMetaObject, native);
+    expectAllProperties(Mount::staticMetaObject, native.value("mounts").toArray().first());
+    expectAllProperties(DBusProxy::staticMetaObject, annotations.value("dbusProxyInfo"));
+
+    // exec 使用的单独 process 编码同样需要覆盖所有字段
+    auto process = QJsonDocument::fromJson(linglong::runtime::encodeProcess(r->process));
+    expectAllProperties(Process::staticMetaObject, process.object());
+
+    r->deleteLater();
+}
@@ -0,0 +1,63 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <gtest/gtest.h>
+
+#include "module/util/link_manifest.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+
+namespace {
+
+void touch(const QString &path)
+{
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QFile file(path);
+    file.open(QIODevice::WriteOnly);
+}
+
+} // namespace
+
+TEST(Module_Util, LinkManifest)
+{
+    QTemporaryDir tmpDir;
+    ASSERT_TRUE(tmpDir.isValid());
+    const QString oldRoot = tmpDir.path() + "/layers/app/1.0/entries";
+    const QString newRoot = tmpDir.path() + "/layers/app/2.0/entries";
+    const QString dstRoot = tmpDir.path() + "/entries/share";
+
+    touch(oldRoot + "/applications/app.desktop");
+    touch(oldRoot + "/icons/old.png");
+    touch(newRoot + "/applications/app.desktop");
+    touch(newRoot + "/icons/hicolor/new.png");
+
+    auto oldManifest = linglong::util::buildLinkManifest(oldRoot);
+    EXPECT_EQ(oldManifest, QStringList({ "applications/app.desktop", "icons/old.png" }));
+
+    const QString manifestPath = tmpDir.path() + "/manifests/app/1.0/x86_64";
+    EXPECT_TRUE(linglong::util::saveLinkManifest(manifestPath, oldManifest));
+    QStringList loaded;
+    EXPECT_TRUE(linglong::util::loadLinkManifest(manifestPath, loaded));
+    EXPECT_EQ(loaded, oldManifest);
+
+    EXPECT_TRUE(linglong::util::applyLinkManifest(dstRoot, {}, oldRoot, oldManifest));
+    EXPECT_EQ(QFileInfo(dstRoot + "/icons/old.png").symLinkTarget(),
+              QFileInfo(oldRoot + "/icons/old.png").absoluteFilePath());
+
+    // 切换版本，旧版本独有的链接被删除，同名链接指向新版本
+    auto newManifest = linglong::util::buildLinkManifest(newRoot);
+    EXPECT_TRUE(linglong::util::applyLinkManifest(dstRoot, oldManifest, newRoot, newManifest));
+    EXPECT_FALSE(QFileInfo(dstRoot + "/icons/old.png").isSymLink());
+    EXPECT_EQ(QFileInfo(dstRoot + "/applications/app.desktop").symLinkTarget(),
+              QFileInfo(newRoot + "/applications/app.desktop").absoluteFilePath());
+    EXPECT_TRUE(QFileInfo(dstRoot + "/icons/hicolor/new.png").exists());
+
+    EXPECT_TRUE(linglong::util::applyLinkManifest(dstRoot, newManifest, "", {}));
+    EXPECT_FALSE(QFileInfo(dstRoot + "/applications/app.desktop").isSymLink());
+}
@@ -0,0 +1,50 @@
+/*
+ * SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+ *
+ * SPDX-License-Identifier: LGPL-3.0-or-later
+ */
+
+#include <gtest/gtest.h>
+
+#include "module/util/trace.h"
+
+#include <QJsonObject>
+
+TEST(Module_Util, Trace)
+{
+    // 未关联 trace 时不记录
+    {
+        LINGLONG_TRACE_SCOPE("ignored");
+    }
+
+    auto trace = std::make_shared<linglong::util::LaunchTrace>("org.deepin.demo");
+    {
+        linglong::util::TraceAttach attach(trace.get());
+        LINGLONG_TRACE_SCOPE("outer");
+        {
+            LINGLONG_TRACE_SCOPE("inner");
+        }
+    }
+    {
+        LINGLONG_TRACE_SCOPE("detached");
+    }
+
+    ASSERT_EQ(trace->spans.size(), 2);
+    EXPECT_STREQ(trace->spans[0].name, "outer");
+    EXPECT_EQ(trace->spans[0].depth, 0);
+    EXPECT_STREQ(trace->spans[1].name, "inner");
+    EXPECT_EQ(trace->spans[1].depth, 1);
+    EXPECT_GE(trace->spans[1].startNs, trace->spans[0].startNs);
+    EXPECT_GE(trace->spans[0].durationNs, trace->spans[1].durationNs);
+
+    trace->id = "trace-test-container";
+    TRACE_RECORDER->record(trace);
+    auto traces = TRACE_RECORDER->traces("trace-test-container");
+    ASSERT_EQ(traces.size(), 1);
+
+    auto breakdown = linglong::util::TraceRecorder::toBreakdown(traces);
+    EXPECT_EQ(breakdown.at(0).toObject()["spans"].toArray().size(), 2);
+    auto events = linglong::util::TraceRecorder::toChromeTrace(traces);
+    EXPECT_EQ(events.size(), 2);
+    EXPECT_EQ(events.at(0).toObject()["ph"].toString(), "X");
+}